@@ -0,0 +1,67 @@
+// -*- mode: js; js-indent-level: 4; indent-tabs-mode: nil -*-
+
+const Lang = imports.lang;
+const Shell = imports.gi.Shell;
+
+// PerfSpan:
+// @name: name of the span, as for Shell.PerfLog.define_span()
+// @description: human readable description of the span
+//
+// Records the duration of calls in the performance log, as a pair of
+// events '<name>Start' and '<name>Done'. Spans with the same name share
+// their events, so it's fine to create one for each instance of a class.
+//
+// This module is imported from low level modules like ui/tweener.js,
+// so it must not import anything from the shell itself.
+var PerfSpan = new Lang.Class({
+    Name: 'PerfSpan',
+
+    _init: function(name, description) {
+        this._perfLog = Shell.PerfLog.get_default();
+        this._span = this._perfLog.lookup_event(name + 'Start');
+        if (this._span == 0)
+            this._span = this._perfLog.define_span(name, description);
+    },
+
+    // measure:
+    // @func: function to call
+    //
+    // Calls @func, recording how long it takes; returns the value
+    // returned by @func
+    measure: function(func) {
+        if (!this._perfLog.get_enabled())
+            return func();
+
+        let id = this._perfLog.begin_span(this._span);
+        try {
+            return func();
+        } finally {
+            this._perfLog.end_span(this._span, id);
+        }
+    },
+
+    // wrap:
+    // @func: function to wrap
+    //
+    // Returns a function which calls @func with the same arguments and
+    // this, recording how long it takes. This is meant for wrapping
+    // signal handlers, like:
+    //
+    //   obj.connect('changed', span.wrap(Lang.bind(this, this._onChanged)));
+    wrap: function(func) {
+        let perfLog = this._perfLog;
+        let span = this._span;
+
+        return function() {
+            if (!perfLog.get_enabled())
+                return func.apply(this, arguments);
+
+            let id = perfLog.begin_span(span);
+            try {
+                return func.apply(this, arguments);
+            } finally {
+                perfLog.end_span(span, id);
+            }
+        };
+    }
+});
@@ -47,6 +47,12 @@ let METRICS = {
     leakedAfterOverview:
     { description: "Additional malloc'ed bytes the second time the overview is shown",
       units: "B" },
+    objectsAfterOverview:
+    { description: "Live GObject instances after the overview is shown once",
+      units: "objects" },
+    objectsLeakedAfterOverview:
+    { description: "Additional live GObject instances the second time the overview is shown",
+      units: "objects" },
     applicationsShowTimeFirst:
     { description: "Time to switch to applications view, first time",
       units: "us" },
@@ -135,6 +141,7 @@ let overviewShowStart;
 let overviewFrames;
 let overviewLatency;
 let mallocUsedSize = 0;
+let gobjectInstances = null;
 let overviewShowCount = 0;
 let firstOverviewUsedSize;
 let haveSwapComplete = false;
@@ -170,8 +177,11 @@ function script_applicationsShowDone(time) {
 function script_afterShowHide(time) {
     if (overviewShowCount == 1) {
         METRICS.usedAfterOverview.value = mallocUsedSize;
+        METRICS.objectsAfterOverview.value = gobjectInstances;
     } else {
         METRICS.leakedAfterOverview.value = mallocUsedSize - METRICS.usedAfterOverview.value;
+        if (gobjectInstances != null)
+            METRICS.objectsLeakedAfterOverview.value = gobjectInstances - METRICS.objectsAfterOverview.value;
     }
 }
 
@@ -179,6 +189,12 @@ function malloc_usedSize(time, bytes) {
     mallocUsedSize = bytes;
 }
 
+// Only recorded with GOBJECT_DEBUG=instance-count, which
+// gnome-shell-perf-tool sets
+function gobject_instances(time, count) {
+    gobjectInstances = count;
+}
+
 function _frameDone(time) {
     if (showingOverview) {
         if (overviewFrames == 0)
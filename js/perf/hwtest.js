@@ -298,11 +298,22 @@ function clutter_stagePaintStart(time) {
     stagePaintStart = time;
 }
 
+function _addRedrawTime(redrawTime) {
+    if (!(redrawTiming in redrawTimes))
+        redrawTimes[redrawTiming] = [];
+    redrawTimes[redrawTiming].push(redrawTime);
+}
+
+// Only logged when the GPU time can't be measured with timer queries
 function clutter_paintCompletedTimestamp(time) {
-    if (redrawTiming != null && stagePaintStart != null) {
-        if (!(redrawTiming in redrawTimes))
-            redrawTimes[redrawTiming] = [];
-        redrawTimes[redrawTiming].push(time - stagePaintStart);
-    }
+    if (redrawTiming != null && stagePaintStart != null)
+        _addRedrawTime(time - stagePaintStart);
     stagePaintStart = null;
 }
+
+// Logged a few frames after the measured one, which is fine since
+// we are redrawing the same thing over and over
+function clutter_paintGpuTime(time, gpuTime) {
+    if (redrawTiming != null)
+        _addRedrawTime(gpuTime);
+}
@@ -0,0 +1,379 @@
+// -*- mode: js; js-indent-level: 4; indent-tabs-mode: nil -*-
+
+const Clutter = imports.gi.Clutter;
+const GLib = imports.gi.GLib;
+const Mainloop = imports.mainloop;
+const Shell = imports.gi.Shell;
+const System = imports.system;
+
+const BoxPointer = imports.ui.boxpointer;
+const Main = imports.ui.main;
+const MessageTray = imports.ui.messageTray;
+const Scripting = imports.ui.scripting;
+
+// This performance script measures how responsive common interactions
+// are: typing into the overview search, a burst of notifications,
+// switching workspaces with many windows, opening popup menus and the
+// calendar, and showing the lock screen. It needs nothing but the
+// perf helper windows, so it can run in a nested or headless session.
+
+let METRICS = {
+    searchEchoLatency:
+    { description: "Time from a keystroke in the overview search to the first frame, average",
+      units: "us" },
+    searchEchoLatencyMax:
+    { description: "Time from a keystroke in the overview search to the first frame, worst",
+      units: "us" },
+    searchResultsTime:
+    { description: "Time from a keystroke in the overview search to updated results, average",
+      units: "us" },
+    searchResultsTimeMax:
+    { description: "Time from a keystroke in the overview search to updated results, worst",
+      units: "us" },
+    notificationBurstTime:
+    { description: "Time to process a burst of 100 notifications",
+      units: "us" },
+    notificationBurstMaxPaint:
+    { description: "Longest frame paint while processing a burst of 100 notifications",
+      units: "us" },
+    workspaceSwitchLatency:
+    { description: "Time to first frame after switching workspaces, 50 windows open",
+      units: "us" },
+    workspaceSwitchFps:
+    { description: "Frame rate when switching workspaces, 50 windows open",
+      units: "frames / s" },
+    workspaceSwitchMaxPaint:
+    { description: "Longest frame paint when switching workspaces, 50 windows open",
+      units: "us" },
+    popupMenuOpenTime:
+    { description: "Time to open the system menu, average",
+      units: "us" },
+    popupMenuCloseTime:
+    { description: "Time to close the system menu, average",
+      units: "us" },
+    popupMenuFps:
+    { description: "Frame rate when opening the system menu",
+      units: "frames / s" },
+    calendarOpenTimeFirst:
+    { description: "Time to open the calendar menu, first time",
+      units: "us" },
+    calendarOpenTimeSubsequent:
+    { description: "Time to open the calendar menu, second time",
+      units: "us" },
+    lockScreenShowTime:
+    { description: "Time to show the lock screen",
+      units: "us" },
+    lockScreenFps:
+    { description: "Frame rate when showing the lock screen",
+      units: "frames / s" }
+};
+
+const SEARCH_TEXT = 'settings';
+const N_NOTIFICATIONS = 100;
+const N_WORKSPACE_WINDOWS = 50;
+const N_MENU_CYCLES = 5;
+
+function operationStart(name) {
+    Shell.PerfLog.get_default().event_s('script.operationStart', name);
+}
+
+function operationDone(name) {
+    Shell.PerfLog.get_default().event_s('script.operationDone', name);
+}
+
+// Pauses the script until @condition returns true
+function waitUntil(condition) {
+    let cb;
+
+    let id = Mainloop.timeout_add(10, function() {
+        if (!condition())
+            return GLib.SOURCE_CONTINUE;
+
+        if (cb)
+            cb();
+        return GLib.SOURCE_REMOVE;
+    });
+    GLib.Source.set_name_by_id(id, '[gnome-shell] waitUntil');
+
+    return function(callback) {
+        cb = callback;
+    };
+}
+
+// Pauses the script until @object emits @signal; call before
+// triggering the signal, and yield the result afterwards
+function waitSignal(object, signal) {
+    let cb;
+    let emitted = false;
+
+    let id = object.connect(signal, function() {
+        object.disconnect(id);
+        emitted = true;
+        if (cb)
+            cb();
+    });
+
+    return function(callback) {
+        if (emitted)
+            callback();
+        else
+            cb = callback;
+    };
+}
+
+// Sends a key press and release through Clutter, as if typed on the
+// keyboard, without depending on the windowing system
+function typeCharacter(character) {
+    let keyboard = Clutter.DeviceManager.get_default().get_core_device(Clutter.InputDeviceType.KEYBOARD_DEVICE);
+    let keyval = Clutter.unicode_to_keysym(character.charCodeAt(0));
+    let types = [Clutter.EventType.KEY_PRESS, Clutter.EventType.KEY_RELEASE];
+
+    for (let i = 0; i < types.length; i++) {
+        let event = Clutter.Event.new(types[i]);
+        event.set_stage(global.stage);
+        event.set_time(global.get_current_time());
+        event.set_device(keyboard);
+        event.set_source_device(keyboard);
+        event.set_key_symbol(keyval);
+        event.set_key_unicode(character);
+        event.put();
+    }
+}
+
+function run() {
+    let perfLog = Shell.PerfLog.get_default();
+    perfLog.define_event('script.operationStart',
+                         'Starting an operation measured by the script', 's');
+    perfLog.define_event('script.operationDone',
+                         'Done with an operation measured by the script', 's');
+
+    // Enable recording of timestamps for different points in the frame cycle
+    global.frame_timestamps = true;
+
+    yield Scripting.sleep(1000);
+
+    // Typing into the overview search
+    let searchResults = Main.overview._controls.viewSelector._searchResults;
+
+    Main.overview.show();
+    yield Scripting.waitLeisure();
+
+    for (let i = 0; i < SEARCH_TEXT.length; i++) {
+        operationStart('searchKey');
+        typeCharacter(SEARCH_TEXT[i]);
+        yield waitUntil(function() { return !searchResults.searchInProgress; });
+        yield Scripting.waitLeisure();
+        operationDone('searchKey');
+    }
+
+    Main.overview.hide();
+    yield Scripting.waitLeisure();
+
+    // Opening and closing a popup menu
+    let systemMenu = Main.panel.statusArea.aggregateMenu.menu;
+
+    for (let i = 0; i < N_MENU_CYCLES; i++) {
+        operationStart('popupMenuOpen');
+        systemMenu.open(BoxPointer.PopupAnimation.FULL);
+        yield Scripting.waitLeisure();
+        operationDone('popupMenuOpen');
+
+        operationStart('popupMenuClose');
+        systemMenu.close(BoxPointer.PopupAnimation.FULL);
+        yield Scripting.waitLeisure();
+        operationDone('popupMenuClose');
+    }
+
+    // Opening the calendar
+    let calendarMenu = Main.panel.statusArea.dateMenu.menu;
+
+    for (let i = 0; i < 2; i++) {
+        operationStart('calendarOpen');
+        calendarMenu.open(BoxPointer.PopupAnimation.FULL);
+        yield Scripting.waitLeisure();
+        operationDone('calendarOpen');
+
+        calendarMenu.close(BoxPointer.PopupAnimation.NONE);
+        yield Scripting.waitLeisure();
+    }
+
+    // A burst of notifications
+    let source = new MessageTray.Source('Performance Test', 'dialog-information-symbolic');
+    Main.messageTray.add(source);
+
+    operationStart('notificationBurst');
+    for (let i = 0; i < N_NOTIFICATIONS; i++) {
+        let notification = new MessageTray.Notification(source,
+                                                        'Notification ' + i,
+                                                        'Sent as part of a burst of notifications');
+        source.notify(notification);
+    }
+    yield Scripting.waitLeisure();
+    operationDone('notificationBurst');
+
+    source.destroy();
+    yield Scripting.waitLeisure();
+
+    // Switching workspaces with many windows open
+    for (let i = 0; i < N_WORKSPACE_WINDOWS; i++)
+        yield Scripting.createTestWindow({ width: 640,
+                                           height: 480 });
+
+    yield Scripting.waitTestWindows();
+    yield Scripting.sleep(1000);
+    yield Scripting.waitLeisure();
+
+    if (global.screen.n_workspaces < 2)
+        global.screen.append_new_workspace(false, global.get_current_time());
+
+    for (let i = 0; i < 2; i++) {
+        let workspace = global.screen.get_workspace_by_index((i + 1) % 2);
+
+        operationStart('workspaceSwitch');
+        workspace.activate(global.get_current_time());
+        yield Scripting.waitLeisure();
+        operationDone('workspaceSwitch');
+    }
+
+    yield Scripting.destroyTestWindows();
+    yield Scripting.sleep(1000);
+
+    System.gc();
+    yield Scripting.waitLeisure();
+
+    // Showing the lock screen; this comes last, since it changes the
+    // session mode
+    let shown = waitSignal(Main.screenShield, 'lock-screen-shown');
+
+    operationStart('lockScreenShow');
+    Main.screenShield.lock(true);
+    if (Main.screenShield.actor.visible) {
+        yield shown;
+        yield Scripting.waitLeisure();
+        operationDone('lockScreenShow');
+
+        Main.screenShield.deactivate(false);
+        yield Scripting.waitLeisure();
+    } else {
+        log('Locking the screen failed, not measuring the lock screen');
+    }
+}
+
+// name => [{ latency, duration, fps, maxPaint }]
+let results = {};
+let currentOperation = null;
+let paintStart = 0;
+let haveSwapComplete = false;
+
+function script_operationStart(time, name) {
+    currentOperation = { name: name,
+                         start: time,
+                         frames: 0,
+                         firstFrame: 0,
+                         lastFrame: 0,
+                         maxPaint: 0 };
+}
+
+function script_operationDone(time, name) {
+    let operation = currentOperation;
+    if (operation == null || operation.name != name)
+        return;
+
+    currentOperation = null;
+
+    let fps = 0;
+    if (operation.frames > 1) {
+        let dt = (operation.lastFrame - operation.firstFrame) / 1000000;
+        // Same as for the overview in core.js, the first frame only
+        // starts the interval
+        fps = (operation.frames - 1) / dt;
+    }
+
+    if (!(name in results))
+        results[name] = [];
+
+    results[name].push({ latency: (operation.frames > 0 ? operation.firstFrame : time) - operation.start,
+                         duration: time - operation.start,
+                         fps: fps,
+                         maxPaint: operation.maxPaint });
+}
+
+function _frameDone(time) {
+    if (currentOperation == null)
+        return;
+
+    if (currentOperation.frames == 0)
+        currentOperation.firstFrame = time;
+    currentOperation.lastFrame = time;
+    currentOperation.frames++;
+}
+
+function clutter_stagePaintStart(time) {
+    paintStart = time;
+}
+
+function clutter_stagePaintDone(time) {
+    if (currentOperation != null && paintStart != 0)
+        currentOperation.maxPaint = Math.max(currentOperation.maxPaint,
+                                             time - paintStart);
+    paintStart = 0;
+
+    // See core.js for why this approximates the swap time
+    if (!haveSwapComplete)
+        _frameDone(time);
+}
+
+function glx_swapComplete(time, swapTime) {
+    haveSwapComplete = true;
+
+    _frameDone(swapTime);
+}
+
+function _average(name, field) {
+    let values = results[name].map(function(r) { return r[field]; });
+    return values.reduce(function(a, b) { return a + b; }, 0) / values.length;
+}
+
+function _maximum(name, field) {
+    let values = results[name].map(function(r) { return r[field]; });
+    return Math.max.apply(null, values);
+}
+
+function finish() {
+    if ('searchKey' in results) {
+        METRICS.searchEchoLatency.value = _average('searchKey', 'latency');
+        METRICS.searchEchoLatencyMax.value = _maximum('searchKey', 'latency');
+        METRICS.searchResultsTime.value = _average('searchKey', 'duration');
+        METRICS.searchResultsTimeMax.value = _maximum('searchKey', 'duration');
+    }
+
+    if ('notificationBurst' in results) {
+        METRICS.notificationBurstTime.value = results.notificationBurst[0].duration;
+        METRICS.notificationBurstMaxPaint.value = results.notificationBurst[0].maxPaint;
+    }
+
+    if ('workspaceSwitch' in results) {
+        METRICS.workspaceSwitchLatency.value = _average('workspaceSwitch', 'latency');
+        METRICS.workspaceSwitchFps.value = _average('workspaceSwitch', 'fps');
+        METRICS.workspaceSwitchMaxPaint.value = _maximum('workspaceSwitch', 'maxPaint');
+    }
+
+    if ('popupMenuOpen' in results) {
+        METRICS.popupMenuOpenTime.value = _average('popupMenuOpen', 'duration');
+        METRICS.popupMenuFps.value = _average('popupMenuOpen', 'fps');
+    }
+
+    if ('popupMenuClose' in results)
+        METRICS.popupMenuCloseTime.value = _average('popupMenuClose', 'duration');
+
+    if ('calendarOpen' in results) {
+        METRICS.calendarOpenTimeFirst.value = results.calendarOpen[0].duration;
+        if (results.calendarOpen.length > 1)
+            METRICS.calendarOpenTimeSubsequent.value = results.calendarOpen[1].duration;
+    }
+
+    if ('lockScreenShow' in results) {
+        METRICS.lockScreenShowTime.value = results.lockScreenShow[0].duration;
+        METRICS.lockScreenFps.value = results.lockScreenShow[0].fps;
+    }
+}
@@ -16,6 +16,7 @@ const LoginManager = imports.misc.loginManager;
 const DND = imports.ui.dnd;
 const Main = imports.ui.main;
 const Params = imports.misc.params;
+const Perf = imports.misc.perf;
 const Tweener = imports.ui.tweener;
 
 var STARTUP_ANIMATION_TIME = 0.5;
@@ -274,8 +275,10 @@ var LayoutManager = new Lang.Class({
                               Lang.bind(this, this._queueUpdateRegions));
         global.screen.connect('restacked',
                               Lang.bind(this, this._windowsRestacked));
+        let monitorsChangedSpan = new Perf.PerfSpan('layout.monitorsChanged',
+                                                    'Handling a change of the monitor configuration');
         global.screen.connect('monitors-changed',
-                              Lang.bind(this, this._monitorsChanged));
+                              monitorsChangedSpan.wrap(Lang.bind(this, this._monitorsChanged)));
         global.screen.connect('in-fullscreen-changed',
                               Lang.bind(this, this._updateFullscreen));
         this._monitorsChanged();
@@ -774,6 +774,86 @@ var Extensions = new Lang.Class({
     }
 });
 
+var PROFILER_N_ENTRIES = 20;
+var PROFILER_UPDATE_INTERVAL = 1; // seconds
+
+var Profiler = new Lang.Class({
+    Name: 'Profiler',
+
+    _init: function(lookingGlass) {
+        this._lookingGlass = lookingGlass;
+        this.actor = new St.BoxLayout({ name: 'Profiler', vertical: true, style: 'spacing: 8px' });
+
+        let buttonBox = new St.BoxLayout({ style: 'spacing: 6px' });
+        this.actor.add(buttonBox);
+
+        this._toggleButton = new St.Button({ style_class: 'lg-obj-inspector-button' });
+        this._toggleButton.connect('clicked', Lang.bind(this, function() {
+            global.actor_profiling = !global.actor_profiling;
+        }));
+        buttonBox.add(this._toggleButton);
+
+        this._lastFrameButton = new St.Button({ style_class: 'lg-obj-inspector-button',
+                                                toggle_mode: true });
+        this._lastFrameButton.connect('clicked', Lang.bind(this, this._update));
+        buttonBox.add(this._lastFrameButton);
+
+        this._table = new St.Label({ style: 'font-family: monospace' });
+        this.actor.add(this._table);
+
+        this._updateId = 0;
+        global.connect('notify::actor-profiling', Lang.bind(this, this._sync));
+        this.actor.connect('notify::mapped', Lang.bind(this, this._sync));
+        this._sync();
+    },
+
+    _sync: function() {
+        let running = global.actor_profiling && this.actor.mapped;
+
+        this._toggleButton.label = global.actor_profiling ? 'Stop profiling' : 'Start profiling';
+
+        if (running && this._updateId == 0) {
+            this._updateId = Mainloop.timeout_add_seconds(PROFILER_UPDATE_INTERVAL,
+                                                          Lang.bind(this, function() {
+                                                              this._update();
+                                                              return GLib.SOURCE_CONTINUE;
+                                                          }));
+            GLib.Source.set_name_by_id(this._updateId, '[gnome-shell] this._update');
+        } else if (!running && this._updateId != 0) {
+            Mainloop.source_remove(this._updateId);
+            this._updateId = 0;
+        }
+
+        this._update();
+    },
+
+    _update: function() {
+        let lastFrame = this._lastFrameButton.checked;
+        let entries = St.profiler_get_top(PROFILER_N_ENTRIES, lastFrame).deep_unpack();
+
+        this._lastFrameButton.label = lastFrame ? 'Last frame' : 'Total';
+
+        // Times are in nanoseconds, shown in microseconds
+        let format = function(name, total, paint, allocate, width, height, style, calls) {
+            let columns = [total, paint, allocate, width, height, style, calls].map(function(c) {
+                let s = String(c);
+                return ' '.repeat(Math.max(10 - s.length, 0)) + s;
+            });
+            return columns.join(' ') + '  ' + name;
+        };
+        let us = function(ns) { return Math.round(ns / 1000); };
+
+        let lines = [format('Actor', 'Total', 'Paint', 'Allocate', 'Width', 'Height', 'Style', 'Calls')];
+        for (let i = 0; i < entries.length; i++) {
+            let [name, total, paint, allocate, width, height, style, calls] = entries[i];
+            lines.push(format(name, us(total), us(paint), us(allocate),
+                              us(width), us(height), us(style), calls));
+        }
+
+        this._table.text = lines.join('\n');
+    }
+});
+
 var LookingGlass = new Lang.Class({
     Name: 'LookingGlass',
 
@@ -880,6 +960,9 @@ var LookingGlass = new Lang.Class({
         this._extensions = new Extensions(this);
         notebook.appendPage('Extensions', this._extensions.actor);
 
+        this._profiler = new Profiler(this);
+        notebook.appendPage('Profiler', this._profiler.actor);
+
         this._entry.clutter_text.connect('activate', Lang.bind(this, function (o, e) {
             // Hide any completions we are currently showing
             this._hideCompletions();
@@ -209,8 +209,9 @@ function _initializeUI() {
     let perfModuleName = GLib.getenv("SHELL_PERF_MODULE");
     if (perfModuleName) {
         let perfOutput = GLib.getenv("SHELL_PERF_OUTPUT");
+        let traceOutput = GLib.getenv("SHELL_PERF_TRACE_OUTPUT");
         let module = eval('imports.perf.' + perfModuleName + ';');
-        Scripting.runPerfScript(module, perfOutput);
+        Scripting.runPerfScript(module, perfOutput, traceOutput);
     }
 
     ExtensionDownloader.init();
@@ -28,6 +28,12 @@ const ScreenshotIface = '<node> \
     <arg type="b" direction="out" name="success"/> \
     <arg type="s" direction="out" name="filename_used"/> \
 </method> \
+<method name="ScreenshotAreas"> \
+    <arg type="a(iiii)" direction="in" name="areas"/> \
+    <arg type="as" direction="in" name="filenames"/> \
+    <arg type="b" direction="out" name="success"/> \
+    <arg type="as" direction="out" name="filenames_used"/> \
+</method> \
 <method name="ScreenshotWindow"> \
     <arg type="b" direction="in" name="include_frame"/> \
     <arg type="b" direction="in" name="include_cursor"/> \
@@ -43,6 +49,19 @@ const ScreenshotIface = '<node> \
     <arg type="b" direction="out" name="success"/> \
     <arg type="s" direction="out" name="filename_used"/> \
 </method> \
+<method name="ScreenshotAreaToFd"> \
+    <arg type="i" direction="in" name="x"/> \
+    <arg type="i" direction="in" name="y"/> \
+    <arg type="i" direction="in" name="width"/> \
+    <arg type="i" direction="in" name="height"/> \
+    <arg type="s" direction="in" name="format"/> \
+    <arg type="h" direction="out" name="fd"/> \
+</method> \
+<method name="ScreenshotToFd"> \
+    <arg type="b" direction="in" name="include_cursor"/> \
+    <arg type="s" direction="in" name="format"/> \
+    <arg type="h" direction="out" name="fd"/> \
+</method> \
 <method name="SelectArea"> \
     <arg type="i" direction="out" name="x"/> \
     <arg type="i" direction="out" name="y"/> \
@@ -72,11 +91,17 @@ var ScreenshotService = new Lang.Class({
         Gio.DBus.session.own_name('org.gnome.Shell.Screenshot', Gio.BusNameOwnerFlags.REPLACE, null, null);
     },
 
-    _createScreenshot: function(invocation) {
+    _createScreenshot: function(invocation, failedValue) {
         let sender = invocation.get_sender();
         if (this._screenShooter.has(sender) ||
             this._lockdownSettings.get_boolean('disable-save-to-disk')) {
-            invocation.return_value(GLib.Variant.new('(bs)', [false, '']));
+            // Methods returning a file descriptor have no value to fail with
+            if (failedValue === null)
+                invocation.return_error_literal(Gio.IOErrorEnum,
+                                                Gio.IOErrorEnum.FAILED,
+                                                "Can't take a screenshot now");
+            else
+                invocation.return_value(failedValue || GLib.Variant.new('(bs)', [false, '']));
             return null;
         }
 
@@ -90,6 +115,39 @@ var ScreenshotService = new Lang.Class({
         return shooter;
     },
 
+    _setFormatForName: function(shooter, format, invocation) {
+        let formats = { png: Shell.ScreenshotFormat.PNG,
+                        qoi: Shell.ScreenshotFormat.QOI,
+                        pam: Shell.ScreenshotFormat.PAM };
+
+        if (!(format in formats)) {
+            invocation.return_error_literal(Gio.IOErrorEnum,
+                                            Gio.IOErrorEnum.NOT_SUPPORTED,
+                                            "Unknown format");
+            return false;
+        }
+
+        shooter.set_format(formats[format]);
+        return true;
+    },
+
+    _onScreenshotFdComplete: function(obj, result, area, fd, invocation) {
+        this._removeShooterForSender(invocation.get_sender());
+
+        if (!result) {
+            invocation.return_error_literal(Gio.IOErrorEnum,
+                                            Gio.IOErrorEnum.FAILED,
+                                            "Failed to take the screenshot");
+            return;
+        }
+
+        // Appending duplicates the descriptor, which is closed afterwards
+        let fdList = new Gio.UnixFDList();
+        let index = fdList.append(fd);
+        invocation.return_value_with_unix_fd_list(GLib.Variant.new('(h)', [index]),
+                                                  fdList);
+    },
+
     _onNameVanished: function(connection, name) {
         this._removeShooterForSender(name);
     },
@@ -161,6 +219,37 @@ var ScreenshotService = new Lang.Class({
                                           flash, invocation));
     },
 
+    ScreenshotAreasAsync : function (params, invocation) {
+        let [areas, filenames] = params;
+        let values = [];
+        for (let i = 0; i < areas.length; i++) {
+            let [x, y, width, height] = this._scaleArea.apply(this, areas[i]);
+            if (!this._checkArea(x, y, width, height)) {
+                invocation.return_error_literal(Gio.IOErrorEnum,
+                                                Gio.IOErrorEnum.CANCELLED,
+                                                "Invalid params");
+                return;
+            }
+            values.push(x, y, width, height);
+        }
+        if (areas.length == 0 || areas.length != filenames.length) {
+            invocation.return_error_literal(Gio.IOErrorEnum,
+                                            Gio.IOErrorEnum.CANCELLED,
+                                            "Invalid params");
+            return;
+        }
+        let screenshot = this._createScreenshot(invocation,
+                                                GLib.Variant.new('(bas)', [false, []]));
+        if (!screenshot)
+            return;
+        // The format of each screenshot follows its own filename
+        screenshot.screenshot_areas(values, filenames,
+            Lang.bind(this, function(obj, result, filenamesUsed) {
+                this._removeShooterForSender(invocation.get_sender());
+                invocation.return_value(GLib.Variant.new('(bas)', [result, filenamesUsed]));
+            }));
+    },
+
     ScreenshotWindowAsync : function (params, invocation) {
         let [include_frame, include_cursor, flash, filename] = params;
         let screenshot = this._createScreenshot(invocation);
@@ -181,6 +270,41 @@ var ScreenshotService = new Lang.Class({
                                     flash, invocation));
     },
 
+    ScreenshotAreaToFdAsync : function (params, invocation) {
+        let [x, y, width, height, format] = params;
+        [x, y, width, height] = this._scaleArea(x, y, width, height);
+        if (!this._checkArea(x, y, width, height)) {
+            invocation.return_error_literal(Gio.IOErrorEnum,
+                                            Gio.IOErrorEnum.CANCELLED,
+                                            "Invalid params");
+            return;
+        }
+        let screenshot = this._createScreenshot(invocation, null);
+        if (!screenshot)
+            return;
+        if (!this._setFormatForName(screenshot, format, invocation)) {
+            this._removeShooterForSender(invocation.get_sender());
+            return;
+        }
+        screenshot.screenshot_area_to_fd(x, y, width, height,
+                                         Lang.bind(this, this._onScreenshotFdComplete,
+                                                   invocation));
+    },
+
+    ScreenshotToFdAsync : function (params, invocation) {
+        let [include_cursor, format] = params;
+        let screenshot = this._createScreenshot(invocation, null);
+        if (!screenshot)
+            return;
+        if (!this._setFormatForName(screenshot, format, invocation)) {
+            this._removeShooterForSender(invocation.get_sender());
+            return;
+        }
+        screenshot.screenshot_to_fd(include_cursor,
+                                    Lang.bind(this, this._onScreenshotFdComplete,
+                                              invocation));
+    },
+
     SelectAreaAsync: function (params, invocation) {
         let selectArea = new SelectArea();
         selectArea.show();
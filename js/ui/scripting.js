@@ -83,6 +83,7 @@ const PerfHelperIface = '<node> \
 </method> \
 <method name="WaitWindows" /> \
 <method name="DestroyWindows" /> \
+<method name="Exit" /> \
 </interface> \
 </node>';
 
@@ -92,6 +93,42 @@ function PerfHelper() {
 }
 
 let _perfHelper = null;
+let _perfHelperStarted = false;
+
+// When the shell runs nested or headless, the perf helper has to be
+// started by the shell itself, so that it connects to the display of
+// the shell rather than to the one the perf tool was started on.
+function _startPerfHelper(path, callback) {
+    let watchId = Gio.bus_watch_name(Gio.BusType.SESSION,
+                                     'org.gnome.Shell.PerfHelper',
+                                     Gio.BusNameWatcherFlags.NONE,
+                                     function() {
+                                         Gio.bus_unwatch_name(watchId);
+                                         callback();
+                                     },
+                                     null);
+
+    let env = GLib.get_environ();
+    env = GLib.environ_setenv(env, 'GDK_BACKEND', 'x11', true);
+    GLib.spawn_async(null, [path], env, GLib.SpawnFlags.DEFAULT, null);
+    _perfHelperStarted = true;
+}
+
+// Asks a perf helper we started to exit, like gnome-shell-perf-tool
+// does for the one it starts itself. This is synchronous, since the
+// shell exits right afterwards.
+function _stopPerfHelper() {
+    if (!_perfHelperStarted)
+        return;
+
+    _perfHelperStarted = false;
+    try {
+        _getPerfHelper().ExitSync();
+    } catch (e) {
+        log('Failed to stop the perf helper: ' + e);
+    }
+}
+
 function _getPerfHelper() {
     if (_perfHelper == null)
         _perfHelper = new PerfHelper();
@@ -324,6 +361,16 @@ function _collect(scriptModule, outputFile) {
     }
 }
 
+function _writeTrace(outputFile) {
+    let f = Gio.file_new_for_path(outputFile);
+    let raw = f.replace(null, false,
+                        Gio.FileCreateFlags.NONE,
+                        null);
+    let out = Gio.BufferedOutputStream.new_sized (raw, 4096);
+    Shell.PerfLog.get_default().dump_trace(out);
+    out.close(null);
+}
+
 /**
  * runPerfScript
  * @scriptModule: module object with run and finish functions
@@ -361,26 +408,48 @@ function _collect(scriptModule, outputFile) {
  * The resulting metrics will be written to @outputFile as JSON, or,
  * if @outputFile is not provided, logged.
  *
+ * If @traceOutputFile is provided, the event log is also written to it
+ * in the Trace Event Format, for viewing with standard trace viewers.
+ *
+ * If the SHELL_PERF_HELPER environment variable is set, the perf helper
+ * it points to is started before running the script, and stopped
+ * again before GNOME Shell exits.
+ *
  * After running the script and collecting statistics from the
  * event log, GNOME Shell will exit.
  **/
-function runPerfScript(scriptModule, outputFile) {
+function runPerfScript(scriptModule, outputFile, traceOutputFile) {
     Shell.PerfLog.get_default().set_enabled(true);
 
     let g = scriptModule.run();
 
-    _step(g,
-          function() {
-              try {
-                  _collect(scriptModule, outputFile);
-              } catch (err) {
-                  log("Script failed: " + err + "\n" + err.stack);
-                  Meta.exit(Meta.ExitCode.ERROR);
-              }
-              Meta.exit(Meta.ExitCode.SUCCESS);
-          },
-         function(err) {
-             log("Script failed: " + err + "\n" + err.stack);
-             Meta.exit(Meta.ExitCode.ERROR);
-         });
+    let exit = function(code) {
+        _stopPerfHelper();
+        Meta.exit(code);
+    };
+
+    let run = function() {
+        _step(g,
+              function() {
+                  try {
+                      _collect(scriptModule, outputFile);
+                      if (traceOutputFile)
+                          _writeTrace(traceOutputFile);
+                  } catch (err) {
+                      log("Script failed: " + err + "\n" + err.stack);
+                      exit(Meta.ExitCode.ERROR);
+                  }
+                  exit(Meta.ExitCode.SUCCESS);
+              },
+             function(err) {
+                 log("Script failed: " + err + "\n" + err.stack);
+                 exit(Meta.ExitCode.ERROR);
+             });
+    };
+
+    let perfHelperPath = GLib.getenv('SHELL_PERF_HELPER');
+    if (perfHelperPath)
+        _startPerfHelper(perfHelperPath, run);
+    else
+        run();
 }
@@ -1,10 +1,12 @@
 // -*- mode: js; js-indent-level: 4; indent-tabs-mode: nil -*-
 
+const ByteArray = imports.byteArray;
 const Gio = imports.gi.Gio;
 const GLib = imports.gi.GLib;
 const Lang = imports.lang;
 const Meta = imports.gi.Meta;
 const Shell = imports.gi.Shell;
+const St = imports.gi.St;
 
 const Config = imports.misc.config;
 const ExtensionSystem = imports.ui.extensionSystem;
@@ -49,12 +51,29 @@ const GnomeShellIface = '<node> \
     <arg type="u" direction="in" name="action"/> \
     <arg type="b" direction="out" name="success"/> \
 </method> \
+<method name="DumpFlightRecorder"> \
+    <arg type="u" direction="in" name="seconds"/> \
+    <arg type="s" direction="out" name="log"/> \
+</method> \
+<method name="GetActorProfile"> \
+    <arg type="u" direction="in" name="n_entries"/> \
+    <arg type="b" direction="in" name="last_frame"/> \
+    <arg type="a(sttttttu)" direction="out" name="entries"/> \
+</method> \
+<method name="GetFrameStatistics"> \
+    <arg type="a{sv}" direction="out" name="statistics"/> \
+</method> \
+<method name="GetInstanceCounts"> \
+    <arg type="a{su}" direction="out" name="subsystems"/> \
+    <arg type="a{su}" direction="out" name="types"/> \
+</method> \
 <signal name="AcceleratorActivated"> \
     <arg name="action" type="u" /> \
     <arg name="parameters" type="a{sv}" /> \
 </signal> \
 <property name="Mode" type="s" access="read" /> \
 <property name="OverviewActive" type="b" access="readwrite" /> \
+<property name="ActorProfiling" type="b" access="readwrite" /> \
 <property name="ShellVersion" type="s" access="read" /> \
 </interface> \
 </node>';
@@ -195,6 +214,65 @@ var GnomeShell = new Lang.Class({
         return invocation.return_value(GLib.Variant.new('(b)', [ungrabSucceeded]));
     },
 
+    /**
+     * DumpFlightRecorder:
+     * @seconds: how much history to return
+     *
+     * Returns the performance events recorded during the last
+     * @seconds seconds, in the JSON format of Shell.PerfLog.dump_log().
+     * This is only useful when the performance log is kept enabled,
+     * for example by setting SHELL_PERF_FLIGHT_RECORDER.
+     */
+    DumpFlightRecorder: function(seconds) {
+        let out = Gio.MemoryOutputStream.new_resizable();
+        Shell.PerfLog.get_default().dump_recent_log(seconds, out);
+        out.close(null);
+
+        return ByteArray.fromGBytes(out.steal_as_bytes()).toString();
+    },
+
+    /**
+     * GetActorProfile:
+     * @n_entries: the maximum number of entries to return
+     * @last_frame: whether to return the times of the last frame
+     *   rather than since profiling was enabled
+     *
+     * Returns the actor classes and named actors which took the most
+     * time painting and laying out, as collected while ActorProfiling
+     * is enabled. See St.profiler_get_top() for the format.
+     */
+    GetActorProfile: function(nEntries, lastFrame) {
+        return St.profiler_get_top(nEntries, lastFrame).deep_unpack();
+    },
+
+    /**
+     * GetFrameStatistics:
+     *
+     * Returns statistics about the frames drawn over the last minute:
+     * 'window' in seconds, 'frames', 'missed-vblanks' and
+     * 'missed-vblanks-total', the percentiles 'interval-p50',
+     * 'interval-p95', 'interval-p99', 'paint-p50', 'paint-p95' and
+     * 'paint-p99' in microseconds, and 'interval-histogram' and
+     * 'paint-histogram', as arrays of (lower bound in microseconds,
+     * count) pairs.
+     */
+    GetFrameStatistics: function() {
+        return global.get_frame_statistics().deep_unpack();
+    },
+
+    /**
+     * GetInstanceCounts:
+     *
+     * Returns the number of live GObject instances per subsystem, like
+     * 'St' or 'Gjs' for classes defined in JavaScript, and per type.
+     * Instances are only counted if the shell was started with
+     * GOBJECT_DEBUG=instance-count; otherwise both are empty.
+     */
+    GetInstanceCounts: function() {
+        return [Shell.instance_counter_get_subsystem_counts().deep_unpack(),
+                Shell.instance_counter_get_type_counts().deep_unpack()];
+    },
+
     _emitAcceleratorActivated: function(action, deviceid, timestamp) {
         let destination = this._grabbedAccelerators.get(action);
         if (!destination)
@@ -285,6 +363,14 @@ var GnomeShell = new Lang.Class({
             Main.overview.hide();
     },
 
+    get ActorProfiling() {
+        return global.actor_profiling;
+    },
+
+    set ActorProfiling(enabled) {
+        global.actor_profiling = enabled;
+    },
+
     ShellVersion: Config.PACKAGE_VERSION
 });
 
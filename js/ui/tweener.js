@@ -184,12 +184,17 @@ var ClutterFrameTicker = new Lang.Class({
             }));
 
         let perf_log = Shell.PerfLog.get_default();
-        perf_log.define_event("tweener.framePrepareStart",
-                              "Start of a new animation frame",
-                              "");
-        perf_log.define_event("tweener.framePrepareDone",
-                              "Finished preparing frame",
-                              "");
+        this._framePrepareStartEvent =
+            perf_log.define_event("tweener.framePrepareStart",
+                                  "Start of a new animation frame",
+                                  "");
+        this._framePrepareDoneEvent =
+            perf_log.define_event("tweener.framePrepareDone",
+                                  "Finished preparing frame",
+                                  "");
+        this._framePrepareSpan =
+            perf_log.define_span("tweener.prepareFrame",
+                                 "Preparing an animation frame");
     },
 
     _onNewFrame : function(frame) {
@@ -204,9 +209,16 @@ var ClutterFrameTicker = new Lang.Class({
         // currentTime is in milliseconds
         let perf_log = Shell.PerfLog.get_default();
         this._currentTime = GLib.get_monotonic_time() / 1000.0 - this._startTime;
-        perf_log.event("tweener.framePrepareStart");
+        if (!perf_log.get_enabled()) {
+            this.emit('prepare-frame');
+            return;
+        }
+
+        perf_log.record(this._framePrepareStartEvent);
+        let spanId = perf_log.begin_span(this._framePrepareSpan);
         this.emit('prepare-frame');
-        perf_log.event("tweener.framePrepareDone");
+        perf_log.end_span(this._framePrepareSpan, spanId);
+        perf_log.record(this._framePrepareDoneEvent);
     },
 
     getTime : function() {
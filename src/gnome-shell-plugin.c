@@ -111,6 +111,7 @@ struct _GnomeShellPlugin
   int glx_error_base;
   int glx_event_base;
   guint have_swap_event : 1;
+  guint swap_complete_event;
   CoglContext *cogl_context;
 
   ShellGlobal *global;
@@ -216,10 +217,11 @@ gnome_shell_plugin_start (MetaPlugin *plugin)
   shell_plugin->have_swap_event =
     gnome_shell_plugin_has_swap_event (shell_plugin);
 
-  shell_perf_log_define_event (shell_perf_log_get_default (),
-                               "glx.swapComplete",
-                               "GL buffer swap complete event received (with timestamp of completion)",
-                               "x");
+  shell_plugin->swap_complete_event =
+    shell_perf_log_define_event (shell_perf_log_get_default (),
+                                 "glx.swapComplete",
+                                 "GL buffer swap complete event received (with timestamp of completion)",
+                                 "x");
 
   shell_plugin->global = shell_global_get ();
   _shell_global_set_plugin (shell_plugin->global, META_PLUGIN (shell_plugin));
@@ -397,9 +399,9 @@ gnome_shell_plugin_xevent_filter (MetaPlugin *plugin,
                         NULL);
 
           if (frame_timestamps)
-            shell_perf_log_event_x (shell_perf_log_get_default (),
-                                    "glx.swapComplete",
-                                    swap_complete_event->ust);
+            shell_perf_log_record_x (shell_perf_log_get_default (),
+                                     shell_plugin->swap_complete_event,
+                                     swap_complete_event->ust);
         }
     }
 #endif
@@ -21,8 +21,10 @@
 #include <meta/prefs.h>
 #include <atk-bridge.h>
 
+#include "shell-app.h"
 #include "shell-global.h"
 #include "shell-global-private.h"
+#include "shell-instance-counter.h"
 #include "shell-perf-log.h"
 #include "st.h"
 
@@ -36,6 +38,8 @@ extern GType gnome_shell_plugin_get_type (void);
 #define WM_NAME "GNOME Shell"
 #define GNOME_WM_KEYBINDINGS "Mutter,GNOME Shell"
 
+#define FLIGHT_RECORDER_DEFAULT_SIZE_KIB 1024
+
 static gboolean is_gdm_mode = FALSE;
 static char *session_mode = NULL;
 static int caught_signal = 0;
@@ -246,10 +250,162 @@ malloc_statistics_callback (ShellPerfLog *perf_log,
 #endif
 }
 
+static void
+st_paint_statistics_callback (ShellPerfLog *perf_log,
+                              gpointer      data)
+{
+  guint64 n_draw_calls, n_rectangles;
+
+  st_theme_node_get_paint_statistics (&n_draw_calls, &n_rectangles);
+
+  shell_perf_log_update_statistic_x (perf_log,
+                                     "st.paintDrawCalls",
+                                     n_draw_calls);
+  shell_perf_log_update_statistic_x (perf_log,
+                                     "st.paintRectangles",
+                                     n_rectangles);
+}
+
+static void
+st_offscreen_pool_statistics_callback (ShellPerfLog *perf_log,
+                                       gpointer      data)
+{
+  StOffscreenPoolStatistics statistics;
+
+  st_offscreen_pool_get_statistics (&statistics);
+
+  shell_perf_log_update_statistic_x (perf_log,
+                                     "st.offscreenPoolAcquired",
+                                     statistics.n_acquired);
+  shell_perf_log_update_statistic_x (perf_log,
+                                     "st.offscreenPoolReused",
+                                     statistics.n_reused);
+  shell_perf_log_update_statistic_x (perf_log,
+                                     "st.offscreenPoolAllocatedBytes",
+                                     statistics.bytes_allocated);
+  shell_perf_log_update_statistic_x (perf_log,
+                                     "st.offscreenPoolResidentBytes",
+                                     statistics.bytes_resident);
+}
+
+static void
+texture_cache_statistics_callback (ShellPerfLog *perf_log,
+                                   gpointer      data)
+{
+  guint n_entries;
+  guint64 resident_bytes;
+
+  st_texture_cache_get_statistics (st_texture_cache_get_default (),
+                                   &n_entries, &resident_bytes);
+
+  shell_perf_log_update_statistic_x (perf_log,
+                                     "st.textureCacheEntries",
+                                     n_entries);
+  shell_perf_log_update_statistic_x (perf_log,
+                                     "st.textureCacheBytes",
+                                     resident_bytes);
+}
+
+static void
+instance_count_statistics_callback (ShellPerfLog *perf_log,
+                                    gpointer      data)
+{
+  shell_perf_log_update_statistic_i (perf_log,
+                                     "gobject.instances",
+                                     shell_instance_counter_get_count (G_TYPE_OBJECT));
+  shell_perf_log_update_statistic_i (perf_log,
+                                     "gobject.clutterActors",
+                                     shell_instance_counter_get_count (CLUTTER_TYPE_ACTOR));
+  shell_perf_log_update_statistic_i (perf_log,
+                                     "gobject.stWidgets",
+                                     shell_instance_counter_get_count (ST_TYPE_WIDGET));
+  shell_perf_log_update_statistic_i (perf_log,
+                                     "gobject.stThemeNodes",
+                                     shell_instance_counter_get_count (ST_TYPE_THEME_NODE));
+  shell_perf_log_update_statistic_i (perf_log,
+                                     "gobject.shellApps",
+                                     shell_instance_counter_get_count (SHELL_TYPE_APP));
+}
+
+static guint
+st_perf_define_event (const char *name,
+                      const char *description,
+                      const char *signature,
+                      gpointer    data)
+{
+  ShellPerfLog *perf_log = data;
+  guint event;
+
+  event = shell_perf_log_lookup_event (perf_log, name);
+  if (event == 0)
+    event = shell_perf_log_define_event (perf_log, name, description, signature);
+
+  return event;
+}
+
+static void
+st_perf_record (guint    event,
+                gpointer data)
+{
+  shell_perf_log_record (data, event);
+}
+
+static void
+st_perf_record_x (guint    event,
+                  gint64   arg,
+                  gpointer data)
+{
+  shell_perf_log_record_x (data, event, arg);
+}
+
+static guint
+st_perf_define_span (const char *name,
+                     const char *description,
+                     gpointer    data)
+{
+  ShellPerfLog *perf_log = data;
+  char *start_name;
+  guint span;
+
+  start_name = g_strconcat (name, "Start", NULL);
+  span = shell_perf_log_lookup_event (perf_log, start_name);
+  g_free (start_name);
+
+  if (span == 0)
+    span = shell_perf_log_define_span (perf_log, name, description);
+
+  return span;
+}
+
+static guint
+st_perf_begin_span (guint    span,
+                    gpointer data)
+{
+  return shell_perf_log_begin_span (data, span);
+}
+
+static void
+st_perf_end_span (guint    span,
+                  guint    id,
+                  gpointer data)
+{
+  shell_perf_log_end_span (data, span, id);
+}
+
+static const StPerfHooks st_perf_hooks = {
+  st_perf_define_event,
+  st_perf_record,
+  st_perf_record_x,
+  st_perf_define_span,
+  st_perf_begin_span,
+  st_perf_end_span
+};
+
 static void
 shell_perf_log_init (void)
 {
   ShellPerfLog *perf_log = shell_perf_log_get_default ();
+  const char *flight_recorder;
 
   /* For probably historical reasons, mallinfo() defines the returned values,
    * even those in bytes as int, not size_t. We're determined not to use
@@ -271,6 +427,100 @@ shell_perf_log_init (void)
   shell_perf_log_add_statistics_callback (perf_log,
                                           malloc_statistics_callback,
                                           NULL, NULL);
+
+  shell_perf_log_define_statistic (perf_log,
+                                   "st.paintDrawCalls",
+                                   "Number of draw calls submitted to paint theme nodes",
+                                   "x");
+  shell_perf_log_define_statistic (perf_log,
+                                   "st.paintRectangles",
+                                   "Number of rectangles drawn when painting theme nodes",
+                                   "x");
+
+  shell_perf_log_add_statistics_callback (perf_log,
+                                          st_paint_statistics_callback,
+                                          NULL, NULL);
+
+  shell_perf_log_define_statistic (perf_log,
+                                   "st.offscreenPoolAcquired",
+                                   "Number of offscreen textures requested from the pool",
+                                   "x");
+  shell_perf_log_define_statistic (perf_log,
+                                   "st.offscreenPoolReused",
+                                   "Number of offscreen textures recycled by the pool",
+                                   "x");
+  shell_perf_log_define_statistic (perf_log,
+                                   "st.offscreenPoolAllocatedBytes",
+                                   "Total size of the offscreen textures allocated by the pool, in bytes",
+                                   "x");
+  shell_perf_log_define_statistic (perf_log,
+                                   "st.offscreenPoolResidentBytes",
+                                   "Size of the offscreen textures currently held by the pool, in bytes",
+                                   "x");
+
+  shell_perf_log_add_statistics_callback (perf_log,
+                                          st_offscreen_pool_statistics_callback,
+                                          NULL, NULL);
+
+  shell_perf_log_define_statistic (perf_log,
+                                   "st.textureCacheEntries",
+                                   "Number of images held by the texture cache",
+                                   "x");
+  shell_perf_log_define_statistic (perf_log,
+                                   "st.textureCacheBytes",
+                                   "Estimated size of the images held by the texture cache, in bytes",
+                                   "x");
+
+  shell_perf_log_add_statistics_callback (perf_log,
+                                          texture_cache_statistics_callback,
+                                          NULL, NULL);
+
+  /* Instances are only counted with GOBJECT_DEBUG=instance-count */
+  if (shell_instance_counter_get_enabled ())
+    {
+      shell_perf_log_define_statistic (perf_log,
+                                       "gobject.instances",
+                                       "Number of live GObject instances",
+                                       "i");
+      shell_perf_log_define_statistic (perf_log,
+                                       "gobject.clutterActors",
+                                       "Number of live ClutterActor instances, including StWidgets",
+                                       "i");
+      shell_perf_log_define_statistic (perf_log,
+                                       "gobject.stWidgets",
+                                       "Number of live StWidget instances",
+                                       "i");
+      shell_perf_log_define_statistic (perf_log,
+                                       "gobject.stThemeNodes",
+                                       "Number of live StThemeNode instances",
+                                       "i");
+      shell_perf_log_define_statistic (perf_log,
+                                       "gobject.shellApps",
+                                       "Number of live ShellApp instances",
+                                       "i");
+
+      shell_perf_log_add_statistics_callback (perf_log,
+                                              instance_count_statistics_callback,
+                                              NULL, NULL);
+    }
+
+  st_perf_set_hooks (&st_perf_hooks, perf_log);
+
+  /* SHELL_PERF_FLIGHT_RECORDER=<size in KiB> keeps recording the most
+   * recent events at all times, so they can be retrieved over D-Bus
+   * after the fact; an empty value picks a default size.
+   */
+  flight_recorder = g_getenv ("SHELL_PERF_FLIGHT_RECORDER");
+  if (flight_recorder != NULL)
+    {
+      guint64 size_kib = g_ascii_strtoull (flight_recorder, NULL, 10);
+
+      if (size_kib == 0)
+        size_kib = FLIGHT_RECORDER_DEFAULT_SIZE_KIB;
+
+      shell_perf_log_set_max_size (perf_log, size_kib * 1024);
+      shell_perf_log_set_enabled (perf_log, TRUE);
+    }
 }
 
 static void
@@ -0,0 +1,407 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "shell-frame-stats.h"
+
+/* Times are recorded in log-linear buckets, as in HdrHistogram: values
+ * below 2^SUB_BUCKET_BITS microseconds are exact, larger ones are kept
+ * with SUB_BUCKET_BITS - 1 bits of precision (about 6%). Values of
+ * 2^(MAX_BITS + 1) microseconds (two minutes) or more end up in the
+ * last bucket.
+ */
+#define SUB_BUCKET_BITS 5
+#define SUB_BUCKET_COUNT (1 << SUB_BUCKET_BITS)
+#define SUB_BUCKET_HALF (SUB_BUCKET_COUNT / 2)
+#define MAX_BITS 26
+#define N_BUCKETS (SUB_BUCKET_HALF * (MAX_BITS - SUB_BUCKET_BITS + 3))
+
+/* The statistics cover the last N_SLOTS * SLOT_DURATION; they are
+ * kept per slot, so old frames can be dropped a slot at a time.
+ */
+#define N_SLOTS 6
+#define SLOT_DURATION (10 * G_USEC_PER_SEC)
+
+/* How many frames can be between painted and presented */
+#define N_PENDING 8
+
+#define DEFAULT_REFRESH_RATE 60.0
+
+typedef struct {
+  guint32 counts[N_BUCKETS];
+  guint32 total;
+} Histogram;
+
+typedef struct {
+  Histogram intervals;
+  Histogram paints;
+  guint32   missed_vblanks;
+} Slot;
+
+typedef struct {
+  gint64 frame_counter;
+  gint64 paint_start;
+} PendingFrame;
+
+struct _ShellFrameStats
+{
+  Slot   slots[N_SLOTS];
+  int    current_slot;
+  gint64 slot_start;
+
+  guint64 missed_vblanks_total;
+
+  /* Start of the paint in progress, or 0 */
+  gint64 paint_start;
+  PendingFrame pending[N_PENDING];
+
+  gint64 last_presentation_time;
+};
+
+static guint
+bucket_for_value (gint64 value)
+{
+  guint msb, shift;
+
+  if (value < SUB_BUCKET_COUNT)
+    return MAX (value, 0);
+
+  msb = MIN (g_bit_storage (value) - 1, MAX_BITS);
+  shift = msb - SUB_BUCKET_BITS + 1;
+
+  return SUB_BUCKET_HALF * shift + (MIN (value, (G_GINT64_CONSTANT (1) << (MAX_BITS + 1)) - 1) >> shift);
+}
+
+static gint64
+bucket_lower_bound (guint bucket)
+{
+  guint shift;
+
+  if (bucket < SUB_BUCKET_COUNT)
+    return bucket;
+
+  shift = bucket / SUB_BUCKET_HALF - 1;
+
+  return (gint64) (bucket - SUB_BUCKET_HALF * shift) << shift;
+}
+
+static gint64
+bucket_upper_bound (guint bucket)
+{
+  return bucket_lower_bound (bucket + 1);
+}
+
+static void
+histogram_add (Histogram *histogram,
+               gint64     value)
+{
+  histogram->counts[bucket_for_value (value)]++;
+  histogram->total++;
+}
+
+static void
+histogram_merge (Histogram       *histogram,
+                 const Histogram *other)
+{
+  guint i;
+
+  for (i = 0; i < N_BUCKETS; i++)
+    histogram->counts[i] += other->counts[i];
+  histogram->total += other->total;
+}
+
+static gint64
+histogram_get_percentile (const Histogram *histogram,
+                          double           percentile)
+{
+  guint64 rank, count = 0;
+  guint i;
+
+  if (histogram->total == 0)
+    return 0;
+
+  rank = MAX ((guint64) (histogram->total * percentile / 100. + 0.5), 1);
+
+  for (i = 0; i < N_BUCKETS; i++)
+    {
+      count += histogram->counts[i];
+      if (count >= rank)
+        return (bucket_lower_bound (i) + bucket_upper_bound (i) - 1) / 2;
+    }
+
+  return bucket_lower_bound (N_BUCKETS - 1);
+}
+
+static GVariant *
+histogram_to_variant (const Histogram *histogram)
+{
+  GVariantBuilder builder;
+  guint i;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(xu)"));
+
+  for (i = 0; i < N_BUCKETS; i++)
+    if (histogram->counts[i] > 0)
+      g_variant_builder_add (&builder, "(xu)",
+                             bucket_lower_bound (i), histogram->counts[i]);
+
+  return g_variant_builder_end (&builder);
+}
+
+/* Drops the slots which are too old */
+static void
+advance (ShellFrameStats *stats,
+         gint64           now)
+{
+  if (now - stats->slot_start >= N_SLOTS * SLOT_DURATION)
+    {
+      memset (stats->slots, 0, sizeof (stats->slots));
+      stats->slot_start = now;
+      return;
+    }
+
+  while (now - stats->slot_start >= SLOT_DURATION)
+    {
+      stats->current_slot = (stats->current_slot + 1) % N_SLOTS;
+      memset (&stats->slots[stats->current_slot], 0, sizeof (Slot));
+      stats->slot_start += SLOT_DURATION;
+    }
+}
+
+static void
+merge_slots (ShellFrameStats *stats,
+             Histogram       *intervals,
+             Histogram       *paints,
+             guint64         *missed_vblanks)
+{
+  int i;
+
+  advance (stats, g_get_monotonic_time ());
+
+  if (intervals)
+    memset (intervals, 0, sizeof (Histogram));
+  if (paints)
+    memset (paints, 0, sizeof (Histogram));
+  if (missed_vblanks)
+    *missed_vblanks = 0;
+
+  for (i = 0; i < N_SLOTS; i++)
+    {
+      if (intervals)
+        histogram_merge (intervals, &stats->slots[i].intervals);
+      if (paints)
+        histogram_merge (paints, &stats->slots[i].paints);
+      if (missed_vblanks)
+        *missed_vblanks += stats->slots[i].missed_vblanks;
+    }
+}
+
+ShellFrameStats *
+_shell_frame_stats_new (void)
+{
+  ShellFrameStats *stats = g_new0 (ShellFrameStats, 1);
+
+  stats->slot_start = g_get_monotonic_time ();
+
+  return stats;
+}
+
+void
+_shell_frame_stats_free (ShellFrameStats *stats)
+{
+  g_free (stats);
+}
+
+/*
+ * _shell_frame_stats_paint_start:
+ * @stats: a #ShellFrameStats
+ * @frame_counter: the counter of the frame, as reported again when
+ *   it is presented
+ * @time: the monotonic time at which painting started
+ */
+void
+_shell_frame_stats_paint_start (ShellFrameStats *stats,
+                                gint64           frame_counter,
+                                gint64           time)
+{
+  PendingFrame *pending = &stats->pending[frame_counter % N_PENDING];
+
+  advance (stats, time);
+
+  stats->paint_start = time;
+
+  pending->frame_counter = frame_counter;
+  pending->paint_start = time;
+}
+
+void
+_shell_frame_stats_paint_done (ShellFrameStats *stats,
+                               gint64           time)
+{
+  if (stats->paint_start == 0)
+    return;
+
+  histogram_add (&stats->slots[stats->current_slot].paints,
+                 time - stats->paint_start);
+  stats->paint_start = 0;
+}
+
+/*
+ * _shell_frame_stats_presented:
+ * @stats: a #ShellFrameStats
+ * @frame_counter: the counter passed to _shell_frame_stats_paint_start()
+ * @presentation_time: the monotonic time at which the frame was shown
+ * @refresh_rate: the refresh rate of the output, or 0 if unknown
+ */
+void
+_shell_frame_stats_presented (ShellFrameStats *stats,
+                              gint64           frame_counter,
+                              gint64           presentation_time,
+                              float            refresh_rate)
+{
+  PendingFrame *pending = &stats->pending[frame_counter % N_PENDING];
+  Slot *slot = &stats->slots[stats->current_slot];
+  gint64 refresh_interval;
+
+  if (refresh_rate <= 0)
+    refresh_rate = DEFAULT_REFRESH_RATE;
+  refresh_interval = G_USEC_PER_SEC / refresh_rate;
+
+  /* The interval to the previous frame only tells how smooth drawing
+   * was if the stage was drawing continuously, that is if painting
+   * this frame started early enough to show it on the vblank after the
+   * previous one. Otherwise the stage was simply idle.
+   */
+  if (stats->last_presentation_time != 0 &&
+      pending->frame_counter == frame_counter &&
+      pending->paint_start != 0 &&
+      pending->paint_start < stats->last_presentation_time + refresh_interval)
+    {
+      gint64 interval = presentation_time - stats->last_presentation_time;
+      gint64 n_vblanks = (interval + refresh_interval / 2) / refresh_interval;
+
+      histogram_add (&slot->intervals, interval);
+
+      if (n_vblanks > 1)
+        {
+          slot->missed_vblanks += n_vblanks - 1;
+          stats->missed_vblanks_total += n_vblanks - 1;
+        }
+    }
+
+  pending->paint_start = 0;
+  stats->last_presentation_time = presentation_time;
+}
+
+/*
+ * _shell_frame_stats_get_interval_percentile:
+ * @stats: a #ShellFrameStats
+ * @percentile: the percentile to get, between 0 and 100
+ *
+ * Return value: the given percentile of the intervals between frames
+ *   drawn continuously, in microseconds, or 0 if there were none
+ */
+gint64
+_shell_frame_stats_get_interval_percentile (ShellFrameStats *stats,
+                                            double           percentile)
+{
+  Histogram intervals;
+
+  merge_slots (stats, &intervals, NULL, NULL);
+
+  return histogram_get_percentile (&intervals, percentile);
+}
+
+/*
+ * _shell_frame_stats_get_paint_percentile:
+ * @stats: a #ShellFrameStats
+ * @percentile: the percentile to get, between 0 and 100
+ *
+ * Return value: the given percentile of the time spent painting
+ *   frames, in microseconds, or 0 if nothing was painted
+ */
+gint64
+_shell_frame_stats_get_paint_percentile (ShellFrameStats *stats,
+                                         double           percentile)
+{
+  Histogram paints;
+
+  merge_slots (stats, NULL, &paints, NULL);
+
+  return histogram_get_percentile (&paints, percentile);
+}
+
+/*
+ * _shell_frame_stats_get_missed_vblanks:
+ * @stats: a #ShellFrameStats
+ *
+ * Return value: the number of vblanks missed since @stats was created
+ */
+guint64
+_shell_frame_stats_get_missed_vblanks (ShellFrameStats *stats)
+{
+  return stats->missed_vblanks_total;
+}
+
+/*
+ * _shell_frame_stats_to_variant:
+ * @stats: a #ShellFrameStats
+ *
+ * Gets all statistics at once, as a dictionary with:
+ *
+ *  - 'window' (u): the number of seconds the statistics cover
+ *  - 'frames' (u): the number of frames painted
+ *  - 'missed-vblanks' (t): the number of missed vblanks
+ *  - 'missed-vblanks-total' (t): the same, since startup
+ *  - 'interval-p50', 'interval-p95', 'interval-p99' (x): percentiles
+ *    of the intervals between frames drawn continuously, in microseconds
+ *  - 'paint-p50', 'paint-p95', 'paint-p99' (x): percentiles of the
+ *    time spent painting frames, in microseconds
+ *  - 'interval-histogram', 'paint-histogram' (a(xu)): the non-empty
+ *    buckets of the histograms, as pairs of the lower bound of the
+ *    bucket in microseconds and the number of frames
+ *
+ * Return value: (transfer floating): a #GVariant of type a{sv}
+ */
+GVariant *
+_shell_frame_stats_to_variant (ShellFrameStats *stats)
+{
+  GVariantBuilder builder;
+  Histogram intervals, paints;
+  guint64 missed_vblanks;
+
+  merge_slots (stats, &intervals, &paints, &missed_vblanks);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+
+  g_variant_builder_add (&builder, "{sv}", "window",
+                         g_variant_new_uint32 (N_SLOTS * SLOT_DURATION / G_USEC_PER_SEC));
+  g_variant_builder_add (&builder, "{sv}", "frames",
+                         g_variant_new_uint32 (paints.total));
+  g_variant_builder_add (&builder, "{sv}", "missed-vblanks",
+                         g_variant_new_uint64 (missed_vblanks));
+  g_variant_builder_add (&builder, "{sv}", "missed-vblanks-total",
+                         g_variant_new_uint64 (stats->missed_vblanks_total));
+
+  g_variant_builder_add (&builder, "{sv}", "interval-p50",
+                         g_variant_new_int64 (histogram_get_percentile (&intervals, 50)));
+  g_variant_builder_add (&builder, "{sv}", "interval-p95",
+                         g_variant_new_int64 (histogram_get_percentile (&intervals, 95)));
+  g_variant_builder_add (&builder, "{sv}", "interval-p99",
+                         g_variant_new_int64 (histogram_get_percentile (&intervals, 99)));
+  g_variant_builder_add (&builder, "{sv}", "paint-p50",
+                         g_variant_new_int64 (histogram_get_percentile (&paints, 50)));
+  g_variant_builder_add (&builder, "{sv}", "paint-p95",
+                         g_variant_new_int64 (histogram_get_percentile (&paints, 95)));
+  g_variant_builder_add (&builder, "{sv}", "paint-p99",
+                         g_variant_new_int64 (histogram_get_percentile (&paints, 99)));
+
+  g_variant_builder_add (&builder, "{sv}", "interval-histogram",
+                         histogram_to_variant (&intervals));
+  g_variant_builder_add (&builder, "{sv}", "paint-histogram",
+                         histogram_to_variant (&paints));
+
+  return g_variant_builder_end (&builder);
+}
@@ -0,0 +1,43 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+#ifndef __SHELL_FRAME_STATS_H__
+#define __SHELL_FRAME_STATS_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * ShellFrameStats:
+ *
+ * Rolling statistics about the frames drawn by the stage: histograms
+ * of the intervals between presented frames and of the time spent
+ * painting them, and the number of vblanks missed while drawing
+ * continuously. They cover the last minute or so, and are cheap
+ * enough to be kept all the time.
+ */
+typedef struct _ShellFrameStats ShellFrameStats;
+
+ShellFrameStats *_shell_frame_stats_new           (void);
+void             _shell_frame_stats_free          (ShellFrameStats *stats);
+
+void             _shell_frame_stats_paint_start   (ShellFrameStats *stats,
+                                                   gint64           frame_counter,
+                                                   gint64           time);
+void             _shell_frame_stats_paint_done    (ShellFrameStats *stats,
+                                                   gint64           time);
+void             _shell_frame_stats_presented     (ShellFrameStats *stats,
+                                                   gint64           frame_counter,
+                                                   gint64           presentation_time,
+                                                   float            refresh_rate);
+
+gint64           _shell_frame_stats_get_interval_percentile (ShellFrameStats *stats,
+                                                             double           percentile);
+gint64           _shell_frame_stats_get_paint_percentile    (ShellFrameStats *stats,
+                                                             double           percentile);
+guint64          _shell_frame_stats_get_missed_vblanks      (ShellFrameStats *stats);
+
+GVariant        *_shell_frame_stats_to_variant    (ShellFrameStats *stats);
+
+G_END_DECLS
+
+#endif /* __SHELL_FRAME_STATS_H__ */
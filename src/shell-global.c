@@ -45,7 +45,9 @@
 #endif
 
 #include "shell-enum-types.h"
+#include "shell-frame-stats.h"
 #include "shell-global-private.h"
+#include "shell-gpu-timer.h"
 #include "shell-perf-log.h"
 #include "shell-window-tracker.h"
 #include "shell-wm.h"
@@ -92,6 +94,17 @@ struct _ShellGlobal {
   gboolean has_modal;
   gboolean frame_timestamps;
   gboolean frame_finish_timestamp;
+
+  guint stage_paint_start_event;
+  guint paint_completed_event;
+  guint paint_gpu_time_event;
+  guint stage_paint_done_event;
+
+  /* NULL if the driver can't measure GPU time */
+  ShellGpuTimer *gpu_timer;
+  gboolean gpu_timer_checked;
+
+  ShellFrameStats *frame_stats;
 };
 
 enum {
@@ -114,6 +127,7 @@ enum {
   PROP_FOCUS_MANAGER,
   PROP_FRAME_TIMESTAMPS,
   PROP_FRAME_FINISH_TIMESTAMP,
+  PROP_ACTOR_PROFILING,
 };
 
 /* Signals */
@@ -147,6 +161,9 @@ shell_global_set_property(GObject         *object,
     case PROP_FRAME_FINISH_TIMESTAMP:
       global->frame_finish_timestamp = g_value_get_boolean (value);
       break;
+    case PROP_ACTOR_PROFILING:
+      st_profiler_set_enabled (g_value_get_boolean (value));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -224,6 +241,9 @@ shell_global_get_property(GObject         *object,
     case PROP_FRAME_FINISH_TIMESTAMP:
       g_value_set_boolean (value, global->frame_finish_timestamp);
       break;
+    case PROP_ACTOR_PROFILING:
+      g_value_set_boolean (value, st_profiler_get_enabled ());
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -343,6 +363,9 @@ shell_global_finalize (GObject *object)
   g_clear_object (&global->userdatadir_path);
   g_clear_object (&global->runtime_state_path);
 
+  g_clear_pointer (&global->gpu_timer, _shell_gpu_timer_free);
+  g_clear_pointer (&global->frame_stats, _shell_frame_stats_free);
+
   G_OBJECT_CLASS(shell_global_parent_class)->finalize (object);
 }
 
@@ -487,7 +510,14 @@ shell_global_class_init (ShellGlobalClass *klass)
                                    PROP_FRAME_FINISH_TIMESTAMP,
                                    g_param_spec_boolean ("frame-finish-timestamp",
                                                          "Frame Finish Timestamps",
-                                                         "Whether at the end of a frame to call glFinish and log paintCompletedTimestamp",
+                                                         "Whether to log paintCompletedTimestamp at the end of a frame, calling glFinish if the GPU time can't be measured otherwise",
+                                                         FALSE,
+                                                         G_PARAM_READWRITE));
+  g_object_class_install_property (gobject_class,
+                                   PROP_ACTOR_PROFILING,
+                                   g_param_spec_boolean ("actor-profiling",
+                                                         "Actor Profiling",
+                                                         "Whether to collect the time spent painting and laying out each actor class, see St.profiler_get_top()",
                                                          FALSE,
                                                          G_PARAM_READWRITE));
 }
@@ -767,9 +797,13 @@ global_stage_before_paint (gpointer data)
 {
   ShellGlobal *global = SHELL_GLOBAL (data);
 
+  _shell_frame_stats_paint_start (global->frame_stats,
+                                  clutter_stage_get_frame_counter (global->stage),
+                                  g_get_monotonic_time ());
+
   if (global->frame_timestamps)
-    shell_perf_log_event (shell_perf_log_get_default (),
-                          "clutter.stagePaintStart");
+    shell_perf_log_record (shell_perf_log_get_default (),
+                           global->stage_paint_start_event);
 
   return TRUE;
 }
@@ -787,26 +821,74 @@ load_gl_symbol (const char  *name,
   return TRUE;
 }
 
+static ShellGpuTimer *
+get_gpu_timer (ShellGlobal *global)
+{
+  /* This needs the GL context, so is done on the first paint */
+  if (!global->gpu_timer_checked)
+    {
+      global->gpu_timer = _shell_gpu_timer_new ();
+      global->gpu_timer_checked = TRUE;
+    }
+
+  return global->gpu_timer;
+}
+
+static void
+global_stage_paint (ClutterActor *stage,
+                    ShellGlobal  *global)
+{
+  ShellGpuTimer *gpu_timer;
+
+  /* Connected before the default handler, so this runs before
+   * anything of the stage is painted */
+  if (!global->frame_timestamps)
+    return;
+
+  gpu_timer = get_gpu_timer (global);
+  if (gpu_timer)
+    _shell_gpu_timer_begin (gpu_timer);
+}
+
 static void
 global_stage_after_paint (ClutterStage *stage,
                           ShellGlobal  *global)
 {
+  ShellGpuTimer *gpu_timer;
+  gint64 gpu_time;
+
   /* At this point, we've finished all layout and painting, but haven't
    * actually flushed or swapped */
 
-  if (global->frame_timestamps && global->frame_finish_timestamp)
+  _shell_frame_stats_paint_done (global->frame_stats, g_get_monotonic_time ());
+  st_profiler_end_frame ();
+
+  if (!global->frame_timestamps)
+    return;
+
+  /* The GPU time of frames is measured with timestamp queries around
+   * the paint, and collected on later frames once the GPU is done with
+   * them. Since frames can overlap on the GPU, this measures how much
+   * GPU work a frame needed rather than the latency of drawing it.
+   */
+  gpu_timer = get_gpu_timer (global);
+  if (gpu_timer)
+    {
+      _shell_gpu_timer_end (gpu_timer);
+
+      while (_shell_gpu_timer_pop (gpu_timer, &gpu_time))
+        shell_perf_log_record_x (shell_perf_log_get_default (),
+                                 global->paint_gpu_time_event,
+                                 gpu_time);
+    }
+  else if (global->frame_finish_timestamp)
     {
-      /* It's interesting to find out when the paint actually finishes
-       * on the GPU. We could wait for this asynchronously with
-       * ARB_timer_query (see https://bugzilla.gnome.org/show_bug.cgi?id=732350
-       * for an implementation of this), but what we actually would
-       * find out then is the latency for drawing a frame, not how much
-       * GPU work was needed, since frames can overlap. Calling glFinish()
-       * is a fairly reliable way to separate out adjacent frames
-       * and measure the amount of GPU work. This is turned on with a
-       * separate property from ::frame-timestamps, since it should not
-       * be turned on if we're trying to actual measure latency or frame
-       * rate.
+      /* Without timestamp queries, calling glFinish() is a fairly
+       * reliable way to separate out adjacent frames and measure the
+       * amount of GPU work. It serializes the CPU and the GPU though,
+       * so it is turned on with a separate property from
+       * ::frame-timestamps, since it should not be turned on if we're
+       * trying to actual measure latency or frame rate.
        */
       static void (*finish) (void);
 
@@ -816,9 +898,110 @@ global_stage_after_paint (ClutterStage *stage,
       cogl_flush ();
       finish ();
 
-      shell_perf_log_event (shell_perf_log_get_default (),
-                            "clutter.paintCompletedTimestamp");
+      shell_perf_log_record (shell_perf_log_get_default (),
+                             global->paint_completed_event);
+    }
+}
+
+static void
+global_stage_presented (ClutterStage     *stage,
+                        CoglFrameEvent    frame_event,
+                        ClutterFrameInfo *frame_info,
+                        ShellGlobal      *global)
+{
+  gint64 presentation_time;
+
+  if (frame_event != COGL_FRAME_EVENT_COMPLETE)
+    return;
+
+  /* Presentation times are in the time base of cogl_get_clock_time(),
+   * in nanoseconds; without them, now is the best approximation.
+   */
+  if (frame_info->presentation_time != 0)
+    {
+      CoglContext *context =
+        clutter_backend_get_cogl_context (clutter_get_default_backend ());
+
+      presentation_time = g_get_monotonic_time () +
+        (frame_info->presentation_time - cogl_get_clock_time (context)) / 1000;
     }
+  else
+    {
+      presentation_time = g_get_monotonic_time ();
+    }
+
+  _shell_frame_stats_presented (global->frame_stats,
+                                frame_info->frame_counter,
+                                presentation_time,
+                                frame_info->refresh_rate);
+}
+
+static void
+frame_statistics_callback (ShellPerfLog *perf_log,
+                           gpointer      data)
+{
+  ShellGlobal *global = data;
+
+  shell_perf_log_update_statistic_x (perf_log,
+                                     "frames.missedVblanks",
+                                     _shell_frame_stats_get_missed_vblanks (global->frame_stats));
+  shell_perf_log_update_statistic_x (perf_log,
+                                     "frames.intervalP50",
+                                     _shell_frame_stats_get_interval_percentile (global->frame_stats, 50));
+  shell_perf_log_update_statistic_x (perf_log,
+                                     "frames.intervalP95",
+                                     _shell_frame_stats_get_interval_percentile (global->frame_stats, 95));
+  shell_perf_log_update_statistic_x (perf_log,
+                                     "frames.intervalP99",
+                                     _shell_frame_stats_get_interval_percentile (global->frame_stats, 99));
+  shell_perf_log_update_statistic_x (perf_log,
+                                     "frames.paintP50",
+                                     _shell_frame_stats_get_paint_percentile (global->frame_stats, 50));
+  shell_perf_log_update_statistic_x (perf_log,
+                                     "frames.paintP95",
+                                     _shell_frame_stats_get_paint_percentile (global->frame_stats, 95));
+  shell_perf_log_update_statistic_x (perf_log,
+                                     "frames.paintP99",
+                                     _shell_frame_stats_get_paint_percentile (global->frame_stats, 99));
+}
+
+static void
+define_frame_statistics (ShellGlobal *global)
+{
+  ShellPerfLog *perf_log = shell_perf_log_get_default ();
+
+  shell_perf_log_define_statistic (perf_log,
+                                   "frames.missedVblanks",
+                                   "Number of vblanks missed while drawing continuously",
+                                   "x");
+  shell_perf_log_define_statistic (perf_log,
+                                   "frames.intervalP50",
+                                   "Median interval between frames drawn continuously over the last minute, in microseconds",
+                                   "x");
+  shell_perf_log_define_statistic (perf_log,
+                                   "frames.intervalP95",
+                                   "95th percentile of the interval between frames drawn continuously over the last minute, in microseconds",
+                                   "x");
+  shell_perf_log_define_statistic (perf_log,
+                                   "frames.intervalP99",
+                                   "99th percentile of the interval between frames drawn continuously over the last minute, in microseconds",
+                                   "x");
+  shell_perf_log_define_statistic (perf_log,
+                                   "frames.paintP50",
+                                   "Median time spent laying out and painting a frame over the last minute, in microseconds",
+                                   "x");
+  shell_perf_log_define_statistic (perf_log,
+                                   "frames.paintP95",
+                                   "95th percentile of the time spent laying out and painting a frame over the last minute, in microseconds",
+                                   "x");
+  shell_perf_log_define_statistic (perf_log,
+                                   "frames.paintP99",
+                                   "99th percentile of the time spent laying out and painting a frame over the last minute, in microseconds",
+                                   "x");
+
+  shell_perf_log_add_statistics_callback (perf_log,
+                                          frame_statistics_callback,
+                                          global, NULL);
 }
 
 static gboolean
@@ -829,8 +1012,8 @@ global_stage_after_swap (gpointer data)
   ShellGlobal *global = SHELL_GLOBAL (data);
 
   if (global->frame_timestamps)
-    shell_perf_log_event (shell_perf_log_get_default (),
-                          "clutter.stagePaintDone");
+    shell_perf_log_record (shell_perf_log_get_default (),
+                           global->stage_paint_done_event);
 
   return TRUE;
 }
@@ -1015,6 +1198,13 @@ _shell_global_set_plugin (ShellGlobal *global,
                                          global_stage_before_paint,
                                          global, NULL);
 
+  global->frame_stats = _shell_frame_stats_new ();
+  define_frame_statistics (global);
+
+  g_signal_connect (global->stage, "paint",
+                    G_CALLBACK (global_stage_paint), global);
+  g_signal_connect (global->stage, "presented",
+                    G_CALLBACK (global_stage_presented), global);
   g_signal_connect (global->stage, "after-paint",
                     G_CALLBACK (global_stage_after_paint), global);
 
@@ -1022,18 +1212,26 @@ _shell_global_set_plugin (ShellGlobal *global,
                                          global_stage_after_swap,
                                          global, NULL);
 
-  shell_perf_log_define_event (shell_perf_log_get_default(),
-                               "clutter.stagePaintStart",
-                               "Start of stage page repaint",
-                               "");
-  shell_perf_log_define_event (shell_perf_log_get_default(),
-                               "clutter.paintCompletedTimestamp",
-                               "Paint completion on GPU",
-                               "");
-  shell_perf_log_define_event (shell_perf_log_get_default(),
-                               "clutter.stagePaintDone",
-                               "End of frame, possibly including swap time",
-                               "");
+  global->stage_paint_start_event =
+    shell_perf_log_define_event (shell_perf_log_get_default(),
+                                 "clutter.stagePaintStart",
+                                 "Start of stage page repaint",
+                                 "");
+  global->paint_completed_event =
+    shell_perf_log_define_event (shell_perf_log_get_default(),
+                                 "clutter.paintCompletedTimestamp",
+                                 "Paint completion on GPU",
+                                 "");
+  global->paint_gpu_time_event =
+    shell_perf_log_define_event (shell_perf_log_get_default(),
+                                 "clutter.paintGpuTime",
+                                 "GPU time spent painting a frame, in microseconds",
+                                 "x");
+  global->stage_paint_done_event =
+    shell_perf_log_define_event (shell_perf_log_get_default(),
+                                 "clutter.stagePaintDone",
+                                 "End of frame, possibly including swap time",
+                                 "");
 
   g_signal_connect (global->stage, "notify::key-focus",
                     G_CALLBACK (focus_actor_changed), global);
@@ -2015,3 +2213,28 @@ shell_global_get_persistent_state (ShellGlobal  *global,
 {
   return load_variant (global->userdatadir_path, property_type, property_name);
 }
+
+/**
+ * shell_global_get_frame_statistics:
+ * @global: A #ShellGlobal
+ *
+ * Gets statistics about the smoothness of the frames drawn over the
+ * last minute: percentiles and histograms of the intervals between
+ * frames and of the time spent painting them, and the number of
+ * missed vblanks. See the org.gnome.Shell GetFrameStatistics() D-Bus
+ * method for the keys of the dictionary. The dictionary is empty
+ * until the stage has been set up.
+ *
+ * Returns: (transfer floating): a #GVariant of type a{sv}
+ */
+GVariant *
+shell_global_get_frame_statistics (ShellGlobal *global)
+{
+  g_return_val_if_fail (SHELL_IS_GLOBAL (global), NULL);
+
+  /* Nothing has been drawn before the stage is set up */
+  if (global->frame_stats == NULL)
+    return g_variant_new ("a{sv}", NULL);
+
+  return _shell_frame_stats_to_variant (global->frame_stats);
+}
@@ -108,6 +108,8 @@ void     shell_global_notify_error              (ShellGlobal  *global,
 
 void     shell_global_init_xdnd                 (ShellGlobal  *global);
 
+GVariant *shell_global_get_frame_statistics     (ShellGlobal  *global);
+
 void     shell_global_reexec_self               (ShellGlobal  *global);
 
 void     shell_global_log_structured            (const char *message,
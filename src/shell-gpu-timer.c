@@ -0,0 +1,294 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <GL/gl.h>
+#include <cogl/cogl.h>
+
+#include "shell-gpu-timer.h"
+
+/* Not all GL headers define the timer query enums */
+#ifndef GL_QUERY_RESULT
+#define GL_QUERY_RESULT 0x8866
+#endif
+#ifndef GL_QUERY_RESULT_AVAILABLE
+#define GL_QUERY_RESULT_AVAILABLE 0x8867
+#endif
+#ifndef GL_TIMESTAMP
+#define GL_TIMESTAMP 0x8E28
+#endif
+#ifndef GL_GPU_DISJOINT_EXT
+#define GL_GPU_DISJOINT_EXT 0x8FBB
+#endif
+
+/* How many frames can be measured before the results of the first
+ * one are available. If the GPU is further behind than this, frames
+ * are skipped rather than waiting.
+ */
+#define N_FRAMES 4
+
+typedef const GLubyte *(*GetStringFunc)           (GLenum        name);
+typedef void           (*GetIntegervFunc)         (GLenum        pname,
+                                                   GLint        *params);
+typedef void           (*GenQueriesFunc)          (GLsizei       n,
+                                                   GLuint       *ids);
+typedef void           (*DeleteQueriesFunc)       (GLsizei       n,
+                                                   const GLuint *ids);
+typedef void           (*QueryCounterFunc)        (GLuint        id,
+                                                   GLenum        target);
+typedef void           (*GetQueryObjectivFunc)    (GLuint        id,
+                                                   GLenum        pname,
+                                                   GLint        *params);
+typedef void           (*GetQueryObjectui64vFunc) (GLuint        id,
+                                                   GLenum        pname,
+                                                   guint64      *params);
+
+typedef struct {
+  GLuint   queries[2];
+  gboolean pending;
+} ShellGpuTimerFrame;
+
+struct _ShellGpuTimer
+{
+  GetIntegervFunc get_integerv;
+  DeleteQueriesFunc delete_queries;
+  QueryCounterFunc query_counter;
+  GetQueryObjectivFunc get_query_objectiv;
+  GetQueryObjectui64vFunc get_query_objectui64v;
+
+  /* EXT_disjoint_timer_query results are void after a disjoint
+   * operation, like a frequency change, happened on the GPU */
+  gboolean check_disjoint;
+
+  ShellGpuTimerFrame frames[N_FRAMES];
+  /* Frame being measured, or -1 */
+  int current;
+  /* Next frame to measure, and oldest frame waiting for results */
+  int next;
+  int oldest;
+};
+
+static gboolean
+has_extension (const char *extensions,
+               const char *name)
+{
+  const char *p;
+  size_t len = strlen (name);
+
+  if (extensions == NULL)
+    return FALSE;
+
+  for (p = strstr (extensions, name); p; p = strstr (p + len, name))
+    {
+      if ((p == extensions || p[-1] == ' ') &&
+          (p[len] == ' ' || p[len] == '\0'))
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+static gboolean
+load_symbols (ShellGpuTimer *timer,
+              const char    *suffix)
+{
+  char *name;
+
+#define LOAD(field, symbol)                                   \
+  name = g_strconcat (symbol, suffix, NULL);                  \
+  timer->field = (void *) cogl_get_proc_address (name);       \
+  g_free (name);                                              \
+  if (timer->field == NULL)                                   \
+    return FALSE;
+
+  LOAD (delete_queries, "glDeleteQueries");
+  LOAD (query_counter, "glQueryCounter");
+  LOAD (get_query_objectiv, "glGetQueryObjectiv");
+  LOAD (get_query_objectui64v, "glGetQueryObjectui64v");
+
+#undef LOAD
+
+  return TRUE;
+}
+
+/*
+ * _shell_gpu_timer_new:
+ *
+ * Creates a timer for the current GL context.
+ *
+ * Return value: a new #ShellGpuTimer, or %NULL if the driver doesn't
+ *   support timestamp queries, like llvmpipe on older Mesa
+ */
+ShellGpuTimer *
+_shell_gpu_timer_new (void)
+{
+  ShellGpuTimer *timer;
+  GetStringFunc get_string;
+  GenQueriesFunc gen_queries;
+  const char *version, *extensions;
+  const char *suffix;
+  int major = 0, minor = 0;
+  int i;
+
+  get_string = (GetStringFunc) cogl_get_proc_address ("glGetString");
+  if (get_string == NULL)
+    return NULL;
+
+  version = (const char *) get_string (GL_VERSION);
+  extensions = (const char *) get_string (GL_EXTENSIONS);
+  if (version == NULL)
+    return NULL;
+
+  if (g_str_has_prefix (version, "OpenGL ES"))
+    {
+      if (!has_extension (extensions, "GL_EXT_disjoint_timer_query"))
+        return NULL;
+
+      suffix = "EXT";
+    }
+  else
+    {
+      /* Timer queries are core since OpenGL 3.3; core contexts
+       * don't report extensions through glGetString() */
+      if (sscanf (version, "%d.%d", &major, &minor) != 2)
+        return NULL;
+
+      if ((major < 3 || (major == 3 && minor < 3)) &&
+          !has_extension (extensions, "GL_ARB_timer_query"))
+        return NULL;
+
+      suffix = "";
+    }
+
+  timer = g_new0 (ShellGpuTimer, 1);
+  timer->check_disjoint = suffix[0] != '\0';
+
+  timer->get_integerv = (GetIntegervFunc) cogl_get_proc_address ("glGetIntegerv");
+  gen_queries = (GenQueriesFunc) cogl_get_proc_address (timer->check_disjoint ?
+                                                        "glGenQueriesEXT" :
+                                                        "glGenQueries");
+
+  if (timer->get_integerv == NULL || gen_queries == NULL ||
+      !load_symbols (timer, suffix))
+    {
+      g_free (timer);
+      return NULL;
+    }
+
+  for (i = 0; i < N_FRAMES; i++)
+    gen_queries (2, timer->frames[i].queries);
+
+  timer->current = -1;
+
+  return timer;
+}
+
+void
+_shell_gpu_timer_free (ShellGpuTimer *timer)
+{
+  int i;
+
+  for (i = 0; i < N_FRAMES; i++)
+    timer->delete_queries (2, timer->frames[i].queries);
+
+  g_free (timer);
+}
+
+/*
+ * _shell_gpu_timer_begin:
+ * @timer: a #ShellGpuTimer
+ *
+ * Starts measuring a frame. This does nothing if a frame is being
+ * measured already, so it can be called for each view of a frame.
+ */
+void
+_shell_gpu_timer_begin (ShellGpuTimer *timer)
+{
+  ShellGpuTimerFrame *frame;
+
+  if (timer->current != -1)
+    return;
+
+  frame = &timer->frames[timer->next];
+  if (frame->pending)
+    return;
+
+  /* Make sure the timestamp is taken after anything Cogl batched up */
+  cogl_flush ();
+  timer->query_counter (frame->queries[0], GL_TIMESTAMP);
+
+  timer->current = timer->next;
+}
+
+/*
+ * _shell_gpu_timer_end:
+ * @timer: a #ShellGpuTimer
+ *
+ * Stops measuring the current frame. Its result is available from
+ * _shell_gpu_timer_pop() once the GPU has finished the frame.
+ */
+void
+_shell_gpu_timer_end (ShellGpuTimer *timer)
+{
+  ShellGpuTimerFrame *frame;
+
+  if (timer->current == -1)
+    return;
+
+  frame = &timer->frames[timer->current];
+
+  cogl_flush ();
+  timer->query_counter (frame->queries[1], GL_TIMESTAMP);
+
+  frame->pending = TRUE;
+  timer->current = -1;
+  timer->next = (timer->next + 1) % N_FRAMES;
+}
+
+/*
+ * _shell_gpu_timer_pop:
+ * @timer: a #ShellGpuTimer
+ * @gpu_time: (out): return location for the GPU time of the frame, in
+ *   microseconds
+ *
+ * Gets the result for the oldest measured frame, if the GPU has
+ * finished it. Frames which couldn't be measured reliably are skipped.
+ *
+ * Return value: %TRUE if @gpu_time was set; %FALSE if no results are
+ *   available yet
+ */
+gboolean
+_shell_gpu_timer_pop (ShellGpuTimer *timer,
+                      gint64        *gpu_time)
+{
+  while (timer->frames[timer->oldest].pending)
+    {
+      ShellGpuTimerFrame *frame = &timer->frames[timer->oldest];
+      GLint available = 0, disjoint = 0;
+      guint64 start, end;
+
+      timer->get_query_objectiv (frame->queries[1],
+                                 GL_QUERY_RESULT_AVAILABLE, &available);
+      if (!available)
+        return FALSE;
+
+      timer->get_query_objectui64v (frame->queries[0], GL_QUERY_RESULT, &start);
+      timer->get_query_objectui64v (frame->queries[1], GL_QUERY_RESULT, &end);
+
+      frame->pending = FALSE;
+      timer->oldest = (timer->oldest + 1) % N_FRAMES;
+
+      if (timer->check_disjoint)
+        timer->get_integerv (GL_GPU_DISJOINT_EXT, &disjoint);
+
+      if (!disjoint && end >= start)
+        {
+          *gpu_time = (end - start) / 1000;
+          return TRUE;
+        }
+    }
+
+  return FALSE;
+}
@@ -0,0 +1,29 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+#ifndef __SHELL_GPU_TIMER_H__
+#define __SHELL_GPU_TIMER_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * ShellGpuTimer:
+ *
+ * Measures how long the GPU spends on a frame with asynchronous GL
+ * timestamp queries (ARB_timer_query or EXT_disjoint_timer_query).
+ * Results are collected on later frames, once the GPU is done with
+ * the measured one, so measuring never stalls the CPU.
+ */
+typedef struct _ShellGpuTimer ShellGpuTimer;
+
+ShellGpuTimer *_shell_gpu_timer_new   (void);
+void           _shell_gpu_timer_free  (ShellGpuTimer *timer);
+
+void           _shell_gpu_timer_begin (ShellGpuTimer *timer);
+void           _shell_gpu_timer_end   (ShellGpuTimer *timer);
+gboolean       _shell_gpu_timer_pop   (ShellGpuTimer *timer,
+                                       gint64        *gpu_time);
+
+G_END_DECLS
+
+#endif /* __SHELL_GPU_TIMER_H__ */
@@ -0,0 +1,166 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+
+/*
+ * Live instance counts of GObject types, to find out what leaks in a
+ * long-running session. The counting itself is done by GObject, and
+ * only if the shell was started with GOBJECT_DEBUG=instance-count;
+ * otherwise all counts are 0.
+ *
+ * Types are attributed to the subsystem they belong to by the prefix
+ * of their name, so ClutterActor goes to 'Clutter' and StWidget to
+ * 'St'. Classes defined in JavaScript, which GJS registers as Gjs_Name,
+ * go to 'Gjs'.
+ */
+
+#include "config.h"
+
+#include "shell-instance-counter.h"
+
+typedef void (*CountFunc) (GType    type,
+                           guint    count,
+                           gpointer data);
+
+/**
+ * shell_instance_counter_get_enabled:
+ *
+ * Returns: whether GObject counts instances, that is whether the
+ *   shell was started with GOBJECT_DEBUG=instance-count
+ */
+gboolean
+shell_instance_counter_get_enabled (void)
+{
+  static const GDebugKey keys[] = {
+    { "objects", 1 << 0 },
+    { "instance-count", 1 << 1 },
+    { "signals", 1 << 2 }
+  };
+  static int enabled = -1;
+
+  /* GObject reads the variable once, when it is initialized */
+  if (enabled == -1)
+    enabled = (g_parse_debug_string (g_getenv ("GOBJECT_DEBUG"),
+                                     keys, G_N_ELEMENTS (keys)) & (1 << 1)) != 0;
+
+  return enabled;
+}
+
+static guint
+foreach_type (GType     type,
+              CountFunc func,
+              gpointer  data)
+{
+  GType *children;
+  guint n_children, i;
+  guint count;
+
+  count = g_type_get_instance_count (type);
+  if (count > 0 && func != NULL)
+    func (type, count, data);
+
+  children = g_type_children (type, &n_children);
+  for (i = 0; i < n_children; i++)
+    count += foreach_type (children[i], func, data);
+  g_free (children);
+
+  return count;
+}
+
+/**
+ * shell_instance_counter_get_count:
+ * @type: a #GType
+ *
+ * Returns: the number of live instances of @type, including those of
+ *   its subclasses
+ */
+guint
+shell_instance_counter_get_count (GType type)
+{
+  return foreach_type (type, NULL, NULL);
+}
+
+static void
+add_type_count (GType    type,
+                guint    count,
+                gpointer data)
+{
+  g_variant_builder_add (data, "{su}", g_type_name (type), count);
+}
+
+/**
+ * shell_instance_counter_get_type_counts:
+ *
+ * Gets the number of live instances of each object type which has
+ * any, not including those of its subclasses.
+ *
+ * Returns: (transfer floating): a #GVariant of type a{su}
+ */
+GVariant *
+shell_instance_counter_get_type_counts (void)
+{
+  GVariantBuilder builder;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{su}"));
+  foreach_type (G_TYPE_OBJECT, add_type_count, &builder);
+
+  return g_variant_builder_end (&builder);
+}
+
+static char *
+get_subsystem (const char *type_name)
+{
+  const char *p;
+
+  if (g_str_has_prefix (type_name, "Gjs_"))
+    return g_strdup ("Gjs");
+
+  /* The prefix ends where the second word starts: StWidget, GtkWidget;
+   * this makes all of GLib 'G', from GDBusProxy to GSettings */
+  for (p = type_name + 1; *p && !g_ascii_isupper (*p); p++)
+    ;
+
+  return g_strndup (type_name, p - type_name);
+}
+
+static void
+add_subsystem_count (GType    type,
+                     guint    count,
+                     gpointer data)
+{
+  GHashTable *subsystems = data;
+  char *subsystem;
+  guint total;
+
+  subsystem = get_subsystem (g_type_name (type));
+  total = GPOINTER_TO_UINT (g_hash_table_lookup (subsystems, subsystem));
+  g_hash_table_insert (subsystems, subsystem, GUINT_TO_POINTER (total + count));
+}
+
+/**
+ * shell_instance_counter_get_subsystem_counts:
+ *
+ * Gets the number of live object instances per subsystem, like 'St',
+ * 'Clutter', 'Meta' or 'Gjs', for the subsystems which have any.
+ *
+ * Returns: (transfer floating): a #GVariant of type a{su}
+ */
+GVariant *
+shell_instance_counter_get_subsystem_counts (void)
+{
+  GVariantBuilder builder;
+  GHashTable *subsystems;
+  GHashTableIter iter;
+  gpointer key, value;
+
+  subsystems = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  foreach_type (G_TYPE_OBJECT, add_subsystem_count, subsystems);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{su}"));
+
+  g_hash_table_iter_init (&iter, subsystems);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    g_variant_builder_add (&builder, "{su}", key, GPOINTER_TO_UINT (value));
+
+  g_hash_table_destroy (subsystems);
+
+  return g_variant_builder_end (&builder);
+}
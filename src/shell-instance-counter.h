@@ -0,0 +1,18 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+#ifndef __SHELL_INSTANCE_COUNTER_H__
+#define __SHELL_INSTANCE_COUNTER_H__
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+gboolean  shell_instance_counter_get_enabled          (void);
+
+guint     shell_instance_counter_get_count            (GType type);
+
+GVariant *shell_instance_counter_get_type_counts      (void);
+GVariant *shell_instance_counter_get_subsystem_counts (void);
+
+G_END_DECLS
+
+#endif /* __SHELL_INSTANCE_COUNTER_H__ */
@@ -38,6 +38,7 @@
 #include "shell-invert-lightness-effect.h"
 
 #include <cogl/cogl.h>
+#include "st.h"
 
 struct _ShellInvertLightnessEffect
 {
@@ -47,6 +48,9 @@ struct _ShellInvertLightnessEffect
   gint tex_height;
 
   CoglPipeline *pipeline;
+
+  /* our reference to the pooled texture used by the offscreen effect */
+  CoglTexture *texture;
 };
 
 struct _ShellInvertLightnessEffectClass
@@ -116,6 +120,26 @@ shell_invert_lightness_effect_pre_paint (ClutterEffect *effect)
     return FALSE;
 }
 
+static CoglHandle
+shell_invert_lightness_effect_create_texture (ClutterOffscreenEffect *effect,
+                                              gfloat                  min_width,
+                                              gfloat                  min_height)
+{
+  ShellInvertLightnessEffect *self = SHELL_INVERT_LIGHTNESS_EFFECT (effect);
+
+  if (self->texture != NULL)
+    st_offscreen_pool_release (self->texture);
+
+  self->texture = st_offscreen_pool_acquire (min_width,
+                                             min_height,
+                                             COGL_PIXEL_FORMAT_RGBA_8888_PRE,
+                                             FALSE);
+  if (self->texture == NULL)
+    return NULL;
+
+  return cogl_object_ref (self->texture);
+}
+
 static void
 shell_invert_lightness_effect_paint_target (ClutterOffscreenEffect *effect)
 {
@@ -150,6 +174,20 @@ shell_invert_lightness_effect_dispose (GObject *gobject)
   G_OBJECT_CLASS (shell_invert_lightness_effect_parent_class)->dispose (gobject);
 }
 
+static void
+shell_invert_lightness_effect_finalize (GObject *gobject)
+{
+  ShellInvertLightnessEffect *self = SHELL_INVERT_LIGHTNESS_EFFECT (gobject);
+  CoglTexture *texture = self->texture;
+
+  /* ClutterOffscreenEffect only drops its reference to the texture
+   * when it is finalized; until then it may still be painted */
+  G_OBJECT_CLASS (shell_invert_lightness_effect_parent_class)->finalize (gobject);
+
+  if (texture != NULL)
+    st_offscreen_pool_release (texture);
+}
+
 static void
 shell_invert_lightness_effect_class_init (ShellInvertLightnessEffectClass *klass)
 {
@@ -158,11 +196,13 @@ shell_invert_lightness_effect_class_init (ShellInvertLightnessEffectClass *klass
   ClutterOffscreenEffectClass *offscreen_class;
 
   offscreen_class = CLUTTER_OFFSCREEN_EFFECT_CLASS (klass);
+  offscreen_class->create_texture = shell_invert_lightness_effect_create_texture;
   offscreen_class->paint_target = shell_invert_lightness_effect_paint_target;
 
   effect_class->pre_paint = shell_invert_lightness_effect_pre_paint;
 
   gobject_class->dispose = shell_invert_lightness_effect_dispose;
+  gobject_class->finalize = shell_invert_lightness_effect_finalize;
 }
 
 static void
@@ -3,6 +3,10 @@
 #include "config.h"
 
 #include <string.h>
+#include <unistd.h>
+#ifdef HAVE_SYS_PRCTL_H
+#include <sys/prctl.h>
+#endif
 
 #include "shell-perf-log.h"
 
@@ -11,6 +15,7 @@ typedef struct _ShellPerfStatistic ShellPerfStatistic;
 typedef struct _ShellPerfStatisticsClosure ShellPerfStatisticsClosure;
 typedef union  _ShellPerfStatisticValue ShellPerfStatisticValue;
 typedef struct _ShellPerfBlock ShellPerfBlock;
+typedef struct _ShellPerfThreadBuffer ShellPerfThreadBuffer;
 
 /**
  * SECTION:shell-perf-log
@@ -31,26 +36,69 @@ typedef struct _ShellPerfBlock ShellPerfBlock;
  * Arguments are identified by a D-Bus style signature; at the moment
  * only a limited number of event signatures are supported to
  * simplify the code.
+ *
+ * Events can be recorded by name, or, for events that are recorded
+ * frequently, through the handle returned by shell_perf_log_define_event()
+ * with shell_perf_log_record() and friends, which avoids looking the
+ * event up each time.
+ *
+ * Durations are recorded as spans, defined with shell_perf_log_define_span()
+ * and recorded with shell_perf_log_begin_span() and shell_perf_log_end_span()
+ * (or the SHELL_PERF_LOG_SPAN_BEGIN() and SHELL_PERF_LOG_SPAN_END() macros).
+ * A span named 'foo.bar' is stored as a pair of events 'foo.barStart' and
+ * 'foo.barDone', each carrying an id identifying the instance of the span,
+ * so existing consumers of the log see them as regular events.
+ *
+ * By default the log grows for as long as it is enabled. With
+ * shell_perf_log_set_max_size() it can instead be turned into a ring
+ * buffer that keeps only the most recent events, which is cheap enough
+ * to leave enabled all the time; shell_perf_log_dump_recent_log() then
+ * retrieves what happened just before a problem was noticed.
+ *
+ * Events can be recorded from any thread. Each thread records into
+ * its own buffer without locking, and the buffers are merged by
+ * timestamp when the log is replayed or dumped. Defining events can
+ * also be done from any thread, but statistics are only collected
+ * in the main thread.
  */
+
+/* Events are kept in a table of fixed size chunks, so that defining
+ * a new event never moves existing ones while other threads look
+ * them up by id.
+ */
+#define EVENT_CHUNK_SIZE 256
+#define N_EVENT_CHUNKS (65536 / EVENT_CHUNK_SIZE)
+
 struct _ShellPerfLog
 {
   GObject parent;
 
-  GPtrArray *events;
+  /* Protects events_by_name, defining events, the list of thread
+   * buffers and handing out blocks. Recursive, so that it can be held
+   * across calls to functions which take it themselves. Replaying
+   * doesn't hold it while calling back, see replay_snapshot_new().
+   */
+  GRecMutex lock;
+
+  ShellPerfEvent **event_chunks[N_EVENT_CHUNKS];
+  gint n_events;
+  gint next_span_id;
   GHashTable *events_by_name;
   GPtrArray *statistics;
   GHashTable *statistics_by_name;
 
   GPtrArray *statistics_closures;
 
-  GQueue *blocks;
-
-  gint64 start_time;
-  gint64 last_time;
+  GPtrArray *thread_buffers;
+  guint next_thread_id;
+  guint n_blocks;
+  guint max_blocks;
+  /* Number of replays in progress; blocks aren't recycled meanwhile */
+  guint n_replays;
 
   guint statistics_timeout_id;
 
-  guint enabled : 1;
+  gboolean enabled;
 };
 
 struct _ShellPerfEvent
@@ -95,15 +143,57 @@ struct _ShellPerfStatisticsClosure
  * it doesn't matter. If we switched to mmapping blocks manually
  * (perhaps to avoid polluting malloc statistics), we'd want to use a
  * different value of BLOCK_SIZE.
+ *
+ * Each block remembers the time its first event is relative to, so the
+ * log can still be replayed when older blocks have been discarded by
+ * the ring buffer mode.
  */
 #define BLOCK_SIZE 8192
 
 struct _ShellPerfBlock
 {
-  guint32 bytes;
+  GList link;
+  gint64 start_time;
+  /* Only written by the recording thread, after the event data; other
+   * threads read it with g_atomic_int_get() and then only look at the
+   * bytes before it.
+   */
+  gint bytes;
   guchar buffer[BLOCK_SIZE];
 };
 
+/* Per-thread event storage. Only the owning thread writes events to
+ * the current block; the queue of blocks is modified with the log's
+ * lock held.
+ *
+ * When the thread exits, the buffer is marked as dead and its blocks
+ * stay in the log like any other; once they have all been recycled,
+ * the buffer itself is freed when statistics are next collected.
+ */
+struct _ShellPerfThreadBuffer
+{
+  ShellPerfLog *perf_log;
+  GThread *thread;
+  guint thread_id;
+  char *name;
+
+  GQueue blocks;
+  ShellPerfBlock *current;
+
+  gint64 last_time;
+
+  guint dead : 1;
+};
+
+static void thread_buffer_thread_exited (gpointer data);
+
+static GPrivate current_thread_buffer = G_PRIVATE_INIT (thread_buffer_thread_exited);
+
+/* A ring buffer needs at least two blocks so that the block being
+ * filled is never the only history we have.
+ */
+#define MIN_RING_BLOCKS 2
+
 /* Number of milliseconds between periodic statistics collection when
  * events are enabled. Statistics collection can also be explicitly
  * triggered.
@@ -124,22 +214,155 @@ get_time (void)
   return g_get_monotonic_time ();
 }
 
+static inline ShellPerfEvent *
+get_event (ShellPerfLog *perf_log,
+           guint16       id)
+{
+  return perf_log->event_chunks[id / EVENT_CHUNK_SIZE][id % EVENT_CHUNK_SIZE];
+}
+
+static ShellPerfThreadBuffer *
+thread_buffer_new (ShellPerfLog *perf_log)
+{
+  ShellPerfThreadBuffer *buffer = g_slice_new0 (ShellPerfThreadBuffer);
+
+  buffer->perf_log = perf_log;
+  buffer->thread = g_thread_ref (g_thread_self ());
+  buffer->thread_id = perf_log->next_thread_id++;
+  g_queue_init (&buffer->blocks);
+
+#ifdef HAVE_SYS_PRCTL_H
+  {
+    char name[17] = { 0, };
+
+    if (prctl (PR_GET_NAME, name, 0, 0, 0) == 0 && name[0] != '\0')
+      buffer->name = g_strdup (name);
+  }
+#endif
+  if (buffer->name == NULL)
+    buffer->name = g_strdup_printf ("thread %u", buffer->thread_id);
+
+  buffer->last_time = get_time ();
+
+  g_ptr_array_add (perf_log->thread_buffers, buffer);
+
+  return buffer;
+}
+
+static void
+thread_buffer_free (ShellPerfThreadBuffer *buffer)
+{
+  g_assert (buffer->blocks.length == 0);
+
+  if (buffer->thread)
+    g_thread_unref (buffer->thread);
+  g_free (buffer->name);
+  g_slice_free (ShellPerfThreadBuffer, buffer);
+}
+
+static void
+thread_buffer_thread_exited (gpointer data)
+{
+  ShellPerfThreadBuffer *buffer = data;
+  ShellPerfLog *perf_log = buffer->perf_log;
+
+  g_rec_mutex_lock (&perf_log->lock);
+
+  /* Nothing records into the current block anymore, so it can be
+   * recycled like the others.
+   */
+  buffer->dead = TRUE;
+  buffer->current = NULL;
+
+  g_thread_unref (buffer->thread);
+  buffer->thread = NULL;
+
+  g_rec_mutex_unlock (&perf_log->lock);
+}
+
+/* Frees the buffers of exited threads whose events have all been
+ * recycled. Must be called with the lock held, and not while the log
+ * is being replayed.
+ */
+static void
+reclaim_thread_buffers (ShellPerfLog *perf_log)
+{
+  guint i = 0;
+
+  while (i < perf_log->thread_buffers->len)
+    {
+      ShellPerfThreadBuffer *buffer = g_ptr_array_index (perf_log->thread_buffers, i);
+
+      if (buffer->dead && buffer->blocks.length == 0)
+        {
+          g_ptr_array_remove_index (perf_log->thread_buffers, i);
+          thread_buffer_free (buffer);
+        }
+      else
+        i++;
+    }
+}
+
+static ShellPerfThreadBuffer *
+lookup_thread_buffer (ShellPerfLog *perf_log)
+{
+  ShellPerfThreadBuffer *buffer = NULL;
+  GThread *self = g_thread_self ();
+  guint i;
+
+  g_rec_mutex_lock (&perf_log->lock);
+
+  for (i = 0; i < perf_log->thread_buffers->len; i++)
+    {
+      ShellPerfThreadBuffer *candidate = g_ptr_array_index (perf_log->thread_buffers, i);
+
+      if (candidate->thread == self)
+        {
+          buffer = candidate;
+          break;
+        }
+    }
+
+  if (buffer == NULL)
+    buffer = thread_buffer_new (perf_log);
+
+  g_rec_mutex_unlock (&perf_log->lock);
+
+  g_private_set (&current_thread_buffer, buffer);
+
+  return buffer;
+}
+
+static inline ShellPerfThreadBuffer *
+get_thread_buffer (ShellPerfLog *perf_log)
+{
+  ShellPerfThreadBuffer *buffer = g_private_get (&current_thread_buffer);
+
+  if (G_LIKELY (buffer != NULL && buffer->perf_log == perf_log))
+    return buffer;
+
+  return lookup_thread_buffer (perf_log);
+}
+
 static void
 shell_perf_log_init (ShellPerfLog *perf_log)
 {
-  perf_log->events = g_ptr_array_new ();
+  g_rec_mutex_init (&perf_log->lock);
   perf_log->events_by_name = g_hash_table_new (g_str_hash, g_str_equal);
   perf_log->statistics = g_ptr_array_new ();
   perf_log->statistics_by_name = g_hash_table_new (g_str_hash, g_str_equal);
   perf_log->statistics_closures = g_ptr_array_new ();
-  perf_log->blocks = g_queue_new ();
+  perf_log->thread_buffers = g_ptr_array_new ();
+
+  /* The thread creating the log gets thread id 0 */
+  lookup_thread_buffer (perf_log);
 
   /* This event is used when timestamp deltas are greater than
    * fits in a gint32. 0xffffffff microseconds is about 70 minutes, so this
    * is not going to happen in normal usage. It might happen if performance
    * logging is enabled some time after starting the shell */
   shell_perf_log_define_event (perf_log, "perf.setTime", "", "x");
-  g_assert (perf_log->events->len == EVENT_SET_TIME + 1);
+  g_assert (perf_log->n_events == EVENT_SET_TIME + 1);
 
   /* The purpose of this event is to allow us to optimize out storing
    * statistics that haven't changed. We want to mark every time we
@@ -153,9 +376,7 @@ shell_perf_log_init (ShellPerfLog *perf_log)
   shell_perf_log_define_event (perf_log, "perf.statisticsCollected",
                                "Finished collecting statistics",
                                "x");
-  g_assert (perf_log->events->len == EVENT_STATISTICS_COLLECTED + 1);
-
-  perf_log->start_time = perf_log->last_time = get_time();
+  g_assert (perf_log->n_events == EVENT_STATISTICS_COLLECTED + 1);
 }
 
 static void
@@ -224,6 +445,116 @@ shell_perf_log_set_enabled (ShellPerfLog *perf_log,
     }
 }
 
+/**
+ * shell_perf_log_get_enabled:
+ * @perf_log: a #ShellPerfLog
+ *
+ * Return value: whether events are currently being recorded
+ */
+gboolean
+shell_perf_log_get_enabled (ShellPerfLog *perf_log)
+{
+  return perf_log->enabled;
+}
+
+/* Takes the oldest block that isn't being recorded into away from its
+ * thread buffer. @self is the buffer of the calling thread, or %NULL;
+ * its current block may be taken too, since nothing else writes to it.
+ * Nothing is taken while the log is being replayed. Must be called
+ * with the lock held.
+ */
+static ShellPerfBlock *
+steal_oldest_block (ShellPerfLog          *perf_log,
+                    ShellPerfThreadBuffer *self)
+{
+  ShellPerfThreadBuffer *oldest = NULL;
+  gint64 oldest_time = G_MAXINT64;
+  guint i;
+
+  if (perf_log->n_replays > 0)
+    return NULL;
+
+  for (i = 0; i < perf_log->thread_buffers->len; i++)
+    {
+      ShellPerfThreadBuffer *buffer = g_ptr_array_index (perf_log->thread_buffers, i);
+      ShellPerfBlock *head;
+
+      if (buffer->blocks.length == 0)
+        continue;
+
+      head = buffer->blocks.head->data;
+      if (head == buffer->current && buffer != self)
+        continue;
+
+      if (head->start_time < oldest_time)
+        {
+          oldest = buffer;
+          oldest_time = head->start_time;
+        }
+    }
+
+  if (oldest == NULL)
+    return NULL;
+
+  if (oldest->blocks.head->data == oldest->current)
+    oldest->current = NULL;
+
+  return g_queue_pop_head_link (&oldest->blocks)->data;
+}
+
+/* Frees blocks until the log fits in its size limit again, as far as
+ * blocks not being recorded into allow. Must be called with the lock held.
+ */
+static void
+trim_blocks (ShellPerfLog          *perf_log,
+             ShellPerfThreadBuffer *self)
+{
+  while (perf_log->n_blocks > perf_log->max_blocks)
+    {
+      ShellPerfBlock *block = steal_oldest_block (perf_log, self);
+
+      if (block == NULL)
+        break;
+
+      g_free (block);
+      perf_log->n_blocks--;
+    }
+}
+
+/**
+ * shell_perf_log_set_max_size:
+ * @perf_log: a #ShellPerfLog
+ * @max_bytes: maximum amount of memory used for recorded events,
+ *   or 0 for no limit
+ *
+ * Limits the amount of memory used to store events. Once the limit is
+ * reached, the oldest events are overwritten by new ones, so the log
+ * acts as a ring buffer holding the most recent history. This makes it
+ * possible to keep the log enabled permanently and inspect it with
+ * shell_perf_log_dump_recent_log() when something goes wrong.
+ */
+void
+shell_perf_log_set_max_size (ShellPerfLog *perf_log,
+                             gsize         max_bytes)
+{
+  if (max_bytes == 0)
+    {
+      perf_log->max_blocks = 0;
+      return;
+    }
+
+  g_rec_mutex_lock (&perf_log->lock);
+
+  perf_log->max_blocks = MAX (max_bytes / sizeof (ShellPerfBlock), MIN_RING_BLOCKS);
+
+  /* Blocks which threads are still recording into are freed once
+   * those threads need a new block.
+   */
+  trim_blocks (perf_log, NULL);
+
+  g_rec_mutex_unlock (&perf_log->lock);
+}
+
 static ShellPerfEvent *
 define_event (ShellPerfLog *perf_log,
               const char   *name,
@@ -231,6 +562,7 @@ define_event (ShellPerfLog *perf_log,
               const char   *signature)
 {
   ShellPerfEvent *event;
+  ShellPerfEvent ***chunk;
 
   if (strcmp (signature, "") != 0 &&
       strcmp (signature, "s") != 0 &&
@@ -241,12 +573,6 @@ define_event (ShellPerfLog *perf_log,
       return NULL;
     }
 
-  if (perf_log->events->len == 65536)
-    {
-      g_warning ("Maximum number of events defined\n");
-      return NULL;
-    }
-
   /* We could do stricter validation, but this will break our JSON dumps */
   if (strchr (name, '"') != NULL)
     {
@@ -254,22 +580,42 @@ define_event (ShellPerfLog *perf_log,
       return NULL;
     }
 
+  g_rec_mutex_lock (&perf_log->lock);
+
+  if (perf_log->n_events == 65536)
+    {
+      g_warning ("Maximum number of events defined\n");
+      event = NULL;
+      goto out;
+    }
+
   if (g_hash_table_lookup (perf_log->events_by_name, name) != NULL)
     {
       g_warning ("Duplicate event event for '%s'\n", name);
-      return NULL;
+      event = NULL;
+      goto out;
     }
 
   event = g_slice_new (ShellPerfEvent);
 
-  event->id = perf_log->events->len;
+  event->id = perf_log->n_events;
   event->name = g_strdup (name);
   event->signature = g_strdup (signature);
   event->description = g_strdup (description);
 
-  g_ptr_array_add (perf_log->events, event);
+  chunk = &perf_log->event_chunks[event->id / EVENT_CHUNK_SIZE];
+  if (*chunk == NULL)
+    *chunk = g_new0 (ShellPerfEvent *, EVENT_CHUNK_SIZE);
+  (*chunk)[event->id % EVENT_CHUNK_SIZE] = event;
+
   g_hash_table_insert (perf_log->events_by_name, event->name, event);
 
+  /* Publish the event to threads looking it up without the lock */
+  g_atomic_int_set (&perf_log->n_events, perf_log->n_events + 1);
+
+ out:
+  g_rec_mutex_unlock (&perf_log->lock);
+
   return event;
 }
 
@@ -288,14 +634,44 @@ define_event (ShellPerfLog *perf_log,
  *   integer.
  *
  * Defines a performance event for later recording.
+ *
+ * Return value: a handle for recording the event with shell_perf_log_record()
+ *   or one of its variants, or 0 if the event couldn't be defined
  */
-void
+guint
 shell_perf_log_define_event (ShellPerfLog *perf_log,
                              const char   *name,
                              const char   *description,
                              const char   *signature)
 {
-  define_event (perf_log, name, description, signature);
+  ShellPerfEvent *event = define_event (perf_log, name, description, signature);
+
+  /* Handles are offset by one so 0 can signal failure */
+  return event != NULL ? event->id + 1 : 0;
+}
+
+/**
+ * shell_perf_log_lookup_event:
+ * @perf_log: a #ShellPerfLog
+ * @name: name of the event
+ *
+ * Gets the handle of an event that was defined elsewhere, for recording
+ * it with shell_perf_log_record() or one of its variants.
+ *
+ * Return value: the handle of the event, or 0 if no event called @name
+ *   has been defined
+ */
+guint
+shell_perf_log_lookup_event (ShellPerfLog *perf_log,
+                             const char   *name)
+{
+  ShellPerfEvent *event;
+
+  g_rec_mutex_lock (&perf_log->lock);
+  event = g_hash_table_lookup (perf_log->events_by_name, name);
+  g_rec_mutex_unlock (&perf_log->lock);
+
+  return event != NULL ? event->id + 1 : 0;
 }
 
 static ShellPerfEvent *
@@ -303,7 +679,11 @@ lookup_event (ShellPerfLog *perf_log,
               const char   *name,
               const char   *signature)
 {
-  ShellPerfEvent *event = g_hash_table_lookup (perf_log->events_by_name, name);
+  ShellPerfEvent *event;
+
+  g_rec_mutex_lock (&perf_log->lock);
+  event = g_hash_table_lookup (perf_log->events_by_name, name);
+  g_rec_mutex_unlock (&perf_log->lock);
 
   if (G_UNLIKELY (event == NULL))
     {
@@ -321,6 +701,55 @@ lookup_event (ShellPerfLog *perf_log,
   return event;
 }
 
+/* Gets an empty block to continue recording into for @buffer, or
+ * %NULL if the log is full and no block can be recycled.
+ */
+static ShellPerfBlock *
+next_block (ShellPerfLog          *perf_log,
+            ShellPerfThreadBuffer *buffer)
+{
+  ShellPerfBlock *block = NULL;
+
+  g_rec_mutex_lock (&perf_log->lock);
+
+  /* Ring buffer mode; recycle the oldest block rather than allocating,
+   * so recording stays allocation-free once the log has filled up.
+   * If every other thread only has the block it is recording into,
+   * drop the event rather than going over the limit. While the log is
+   * being replayed, blocks can't be recycled, so go over the limit
+   * until the replay is done instead.
+   */
+  if (perf_log->max_blocks != 0 &&
+      perf_log->n_blocks >= perf_log->max_blocks &&
+      perf_log->n_replays == 0)
+    {
+      trim_blocks (perf_log, buffer);
+
+      block = steal_oldest_block (perf_log, buffer);
+      if (block == NULL)
+        {
+          g_rec_mutex_unlock (&perf_log->lock);
+          return NULL;
+        }
+    }
+  else
+    {
+      block = g_new (ShellPerfBlock, 1);
+      block->link.data = block;
+      perf_log->n_blocks++;
+    }
+
+  block->link.prev = block->link.next = NULL;
+  block->start_time = buffer->last_time;
+  block->bytes = 0;
+  g_queue_push_tail_link (&buffer->blocks, &block->link);
+  buffer->current = block;
+
+  g_rec_mutex_unlock (&perf_log->lock);
+
+  return block;
+}
+
 static void
 record_event (ShellPerfLog   *perf_log,
               gint64          event_time,
@@ -328,6 +757,7 @@ record_event (ShellPerfLog   *perf_log,
               const guchar   *bytes,
               size_t          bytes_len)
 {
+  ShellPerfThreadBuffer *buffer;
   ShellPerfBlock *block;
   size_t total_bytes;
   guint32 time_delta;
@@ -343,33 +773,31 @@ record_event (ShellPerfLog   *perf_log,
       return;
     }
 
-  if (event_time > perf_log->last_time + G_GINT64_CONSTANT(0xffffffff))
+  buffer = get_thread_buffer (perf_log);
+
+  if (event_time > buffer->last_time + G_GINT64_CONSTANT(0xffffffff))
     {
-      perf_log->last_time = event_time;
+      buffer->last_time = event_time;
       record_event (perf_log, event_time,
-                    lookup_event (perf_log, "perf.setTime", "x"),
+                    get_event (perf_log, EVENT_SET_TIME),
                     (const guchar *)&event_time, sizeof(gint64));
       time_delta = 0;
     }
-  else if (event_time < perf_log->last_time)
+  else if (event_time < buffer->last_time)
     time_delta = 0;
   else
-    time_delta = (guint32)(event_time - perf_log->last_time);
-
-  perf_log->last_time = event_time;
+    time_delta = (guint32)(event_time - buffer->last_time);
 
-  if (perf_log->blocks->tail == NULL ||
-      total_bytes + ((ShellPerfBlock *)perf_log->blocks->tail->data)->bytes > BLOCK_SIZE)
-    {
-      block = g_new (ShellPerfBlock, 1);
-      block->bytes = 0;
-      g_queue_push_tail (perf_log->blocks, block);
-    }
-  else
+  block = buffer->current;
+  if (block == NULL || total_bytes + block->bytes > BLOCK_SIZE)
     {
-      block = (ShellPerfBlock *)perf_log->blocks->tail->data;
+      block = next_block (perf_log, buffer);
+      if (G_UNLIKELY (block == NULL))
+        return;
     }
 
+  buffer->last_time = event_time;
+
   pos = block->bytes;
 
   memcpy (block->buffer + pos, &time_delta, sizeof (guint32));
@@ -379,87 +807,345 @@ record_event (ShellPerfLog   *perf_log,
   memcpy (block->buffer + pos, bytes, bytes_len);
   pos += bytes_len;
 
-  block->bytes = pos;
+  /* Publish the event to threads replaying the log */
+  g_atomic_int_set (&block->bytes, pos);
+}
+
+static inline ShellPerfEvent *
+event_from_handle (ShellPerfLog *perf_log,
+                   guint         handle,
+                   char          type)
+{
+  ShellPerfEvent *event;
+
+  if (G_UNLIKELY (handle == 0 || handle > (guint) g_atomic_int_get (&perf_log->n_events)))
+    {
+      g_warning ("Discarding event with invalid handle %u\n", handle);
+      return NULL;
+    }
+
+  event = get_event (perf_log, handle - 1);
+
+  if (G_UNLIKELY (event->signature[0] != type))
+    {
+      g_warning ("Event '%s'; defined with signature '%s', used with '%c'\n",
+                 event->name, event->signature, type);
+      return NULL;
+    }
+
+  return event;
 }
 
 /**
- * shell_perf_log_event:
+ * shell_perf_log_record:
  * @perf_log: a #ShellPerfLog
- * @name: name of the event
+ * @event: handle returned by shell_perf_log_define_event()
  *
- * Records a performance event with no arguments.
+ * Records a performance event with no arguments. This is equivalent
+ * to shell_perf_log_event(), but doesn't need to look up the event.
  */
 void
-shell_perf_log_event (ShellPerfLog *perf_log,
-                      const char   *name)
+shell_perf_log_record (ShellPerfLog *perf_log,
+                       guint         event)
 {
-  ShellPerfEvent *event = lookup_event (perf_log, name, "");
-  if (G_UNLIKELY (event == NULL))
+  ShellPerfEvent *perf_event;
+
+  if (!perf_log->enabled)
     return;
 
-  record_event (perf_log, get_time(), event, NULL, 0);
+  perf_event = event_from_handle (perf_log, event, '\0');
+  if (G_UNLIKELY (perf_event == NULL))
+    return;
+
+  record_event (perf_log, get_time(), perf_event, NULL, 0);
 }
 
 /**
- * shell_perf_log_event_i:
+ * shell_perf_log_record_i:
  * @perf_log: a #ShellPerfLog
- * @name: name of the event
+ * @event: handle returned by shell_perf_log_define_event()
  * @arg: the argument
  *
  * Records a performance event with one 32-bit integer argument.
  */
 void
-shell_perf_log_event_i (ShellPerfLog *perf_log,
-                        const char   *name,
-                        gint32        arg)
+shell_perf_log_record_i (ShellPerfLog *perf_log,
+                         guint         event,
+                         gint32        arg)
 {
-  ShellPerfEvent *event = lookup_event (perf_log, name, "i");
-  if (G_UNLIKELY (event == NULL))
+  ShellPerfEvent *perf_event;
+
+  if (!perf_log->enabled)
     return;
 
-  record_event (perf_log, get_time(), event,
+  perf_event = event_from_handle (perf_log, event, 'i');
+  if (G_UNLIKELY (perf_event == NULL))
+    return;
+
+  record_event (perf_log, get_time(), perf_event,
                 (const guchar *)&arg, sizeof (arg));
 }
 
 /**
- * shell_perf_log_event_x:
+ * shell_perf_log_record_x:
  * @perf_log: a #ShellPerfLog
- * @name: name of the event
+ * @event: handle returned by shell_perf_log_define_event()
  * @arg: the argument
  *
  * Records a performance event with one 64-bit integer argument.
  */
 void
-shell_perf_log_event_x (ShellPerfLog *perf_log,
-                        const char   *name,
-                        gint64        arg)
+shell_perf_log_record_x (ShellPerfLog *perf_log,
+                         guint         event,
+                         gint64        arg)
 {
-  ShellPerfEvent *event = lookup_event (perf_log, name, "x");
-  if (G_UNLIKELY (event == NULL))
+  ShellPerfEvent *perf_event;
+
+  if (!perf_log->enabled)
     return;
 
-  record_event (perf_log, get_time(), event,
+  perf_event = event_from_handle (perf_log, event, 'x');
+  if (G_UNLIKELY (perf_event == NULL))
+    return;
+
+  record_event (perf_log, get_time(), perf_event,
                 (const guchar *)&arg, sizeof (arg));
 }
 
 /**
- * shell_perf_log_event_s:
+ * shell_perf_log_record_s:
  * @perf_log: a #ShellPerfLog
- * @name: name of the event
+ * @event: handle returned by shell_perf_log_define_event()
  * @arg: the argument
  *
  * Records a performance event with one string argument.
  */
 void
-shell_perf_log_event_s (ShellPerfLog *perf_log,
-                         const char   *name,
+shell_perf_log_record_s (ShellPerfLog *perf_log,
+                         guint         event,
                          const char   *arg)
 {
-  ShellPerfEvent *event = lookup_event (perf_log, name, "s");
-  if (G_UNLIKELY (event == NULL))
+  ShellPerfEvent *perf_event;
+
+  if (!perf_log->enabled)
     return;
 
-  record_event (perf_log, get_time(), event,
+  perf_event = event_from_handle (perf_log, event, 's');
+  if (G_UNLIKELY (perf_event == NULL))
+    return;
+
+  record_event (perf_log, get_time(), perf_event,
+                (const guchar *)arg, strlen (arg) + 1);
+}
+
+/**
+ * shell_perf_log_define_span:
+ * @perf_log: a #ShellPerfLog
+ * @name: name of the span, following the same guidelines as for
+ *   shell_perf_log_define_event()
+ * @description: human readable description of the span
+ *
+ * Defines a span, which records the duration of an operation. This
+ * defines the events '<name>Start' and '<name>Done', with a 32-bit
+ * integer argument identifying the instance of the span.
+ *
+ * Return value: a handle for recording the span with
+ *   shell_perf_log_begin_span() and shell_perf_log_end_span(),
+ *   or 0 if the span couldn't be defined
+ */
+guint
+shell_perf_log_define_span (ShellPerfLog *perf_log,
+                            const char   *name,
+                            const char   *description)
+{
+  ShellPerfEvent *start, *done = NULL;
+  char *event_name;
+
+  /* The span handle is that of the start event, the done event
+   * needs to directly follow it.
+   */
+  g_rec_mutex_lock (&perf_log->lock);
+
+  event_name = g_strconcat (name, "Start", NULL);
+  start = define_event (perf_log, event_name, description, "i");
+  g_free (event_name);
+
+  if (start != NULL)
+    {
+      event_name = g_strconcat (name, "Done", NULL);
+      done = define_event (perf_log, event_name, description, "i");
+      g_free (event_name);
+    }
+
+  g_rec_mutex_unlock (&perf_log->lock);
+
+  if (done == NULL)
+    return 0;
+
+  return start->id + 1;
+}
+
+/**
+ * shell_perf_log_begin_span:
+ * @perf_log: a #ShellPerfLog
+ * @span: handle returned by shell_perf_log_define_span()
+ *
+ * Records the start of a span. Spans recorded in the same thread
+ * must be nested.
+ *
+ * Return value: an id to pass to shell_perf_log_end_span(); 0 if
+ *   nothing was recorded, in which case the end won't be either
+ */
+guint
+shell_perf_log_begin_span (ShellPerfLog *perf_log,
+                           guint         span)
+{
+  ShellPerfEvent *event;
+  gint32 id;
+
+  /* 0 is returned by shell_perf_log_define_span() on failure */
+  if (span == 0 || !perf_log->enabled)
+    return 0;
+
+  event = event_from_handle (perf_log, span, 'i');
+  if (G_UNLIKELY (event == NULL))
+    return 0;
+
+  do
+    id = g_atomic_int_add (&perf_log->next_span_id, 1) & G_MAXINT32;
+  while (G_UNLIKELY (id == 0));
+
+  record_event (perf_log, get_time(), event,
+                (const guchar *)&id, sizeof (id));
+
+  return id;
+}
+
+/**
+ * shell_perf_log_end_span:
+ * @perf_log: a #ShellPerfLog
+ * @span: handle returned by shell_perf_log_define_span()
+ * @id: id returned by shell_perf_log_begin_span()
+ *
+ * Records the end of a span.
+ */
+void
+shell_perf_log_end_span (ShellPerfLog *perf_log,
+                         guint         span,
+                         guint         id)
+{
+  ShellPerfEvent *event;
+  gint32 arg = id;
+
+  if (id == 0 || !perf_log->enabled)
+    return;
+
+  event = event_from_handle (perf_log, span + 1, 'i');
+  if (G_UNLIKELY (event == NULL))
+    return;
+
+  record_event (perf_log, get_time(), event,
+                (const guchar *)&arg, sizeof (arg));
+}
+
+/**
+ * shell_perf_log_event:
+ * @perf_log: a #ShellPerfLog
+ * @name: name of the event
+ *
+ * Records a performance event with no arguments.
+ */
+void
+shell_perf_log_event (ShellPerfLog *perf_log,
+                      const char   *name)
+{
+  ShellPerfEvent *event;
+
+  if (!perf_log->enabled)
+    return;
+
+  event = lookup_event (perf_log, name, "");
+  if (G_UNLIKELY (event == NULL))
+    return;
+
+  record_event (perf_log, get_time(), event, NULL, 0);
+}
+
+/**
+ * shell_perf_log_event_i:
+ * @perf_log: a #ShellPerfLog
+ * @name: name of the event
+ * @arg: the argument
+ *
+ * Records a performance event with one 32-bit integer argument.
+ */
+void
+shell_perf_log_event_i (ShellPerfLog *perf_log,
+                        const char   *name,
+                        gint32        arg)
+{
+  ShellPerfEvent *event;
+
+  if (!perf_log->enabled)
+    return;
+
+  event = lookup_event (perf_log, name, "i");
+  if (G_UNLIKELY (event == NULL))
+    return;
+
+  record_event (perf_log, get_time(), event,
+                (const guchar *)&arg, sizeof (arg));
+}
+
+/**
+ * shell_perf_log_event_x:
+ * @perf_log: a #ShellPerfLog
+ * @name: name of the event
+ * @arg: the argument
+ *
+ * Records a performance event with one 64-bit integer argument.
+ */
+void
+shell_perf_log_event_x (ShellPerfLog *perf_log,
+                        const char   *name,
+                        gint64        arg)
+{
+  ShellPerfEvent *event;
+
+  if (!perf_log->enabled)
+    return;
+
+  event = lookup_event (perf_log, name, "x");
+  if (G_UNLIKELY (event == NULL))
+    return;
+
+  record_event (perf_log, get_time(), event,
+                (const guchar *)&arg, sizeof (arg));
+}
+
+/**
+ * shell_perf_log_event_s:
+ * @perf_log: a #ShellPerfLog
+ * @name: name of the event
+ * @arg: the argument
+ *
+ * Records a performance event with one string argument.
+ */
+void
+shell_perf_log_event_s (ShellPerfLog *perf_log,
+                         const char   *name,
+                         const char   *arg)
+{
+  ShellPerfEvent *event;
+
+  if (!perf_log->enabled)
+    return;
+
+  event = lookup_event (perf_log, name, "s");
+  if (G_UNLIKELY (event == NULL))
+    return;
+
+  record_event (perf_log, get_time(), event,
                 (const guchar *)arg, strlen (arg) + 1);
 }
 
@@ -674,94 +1360,329 @@ shell_perf_log_collect_statistics (ShellPerfLog *perf_log)
     }
 
   record_event (perf_log, event_time,
-                g_ptr_array_index (perf_log->events, EVENT_STATISTICS_COLLECTED),
+                get_event (perf_log, EVENT_STATISTICS_COLLECTED),
                 (const guchar *)&collection_time, sizeof (gint64));
+
+  g_rec_mutex_lock (&perf_log->lock);
+  reclaim_thread_buffers (perf_log);
+  g_rec_mutex_unlock (&perf_log->lock);
 }
 
-/**
- * shell_perf_log_replay:
- * @perf_log: a #ShellPerfLog
- * @replay_function: (scope call): function to call for each event in the log
- * @user_data: data to pass to @replay_function
- *
- * Replays the log by calling the given function for each event
- * in the log.
+static guint32
+event_arg_size (ShellPerfEvent *event,
+                const guchar   *arg)
+{
+  switch (event->signature[0])
+    {
+    case 'i':
+      return sizeof (gint32);
+    case 'x':
+      return sizeof (gint64);
+    case 's':
+      return strlen ((const char *)arg) + 1;
+    default:
+      return 0;
+    }
+}
+
+/* The blocks of one thread buffer, as they were when a replay started */
+typedef struct {
+  guint thread_id;
+  char *name;
+  ShellPerfBlock **blocks;
+  guint n_blocks;
+} ReplayThread;
+
+/* The blocks of all threads at the start of a replay. The blocks are
+ * pinned until the snapshot is freed; they are not recycled, so they
+ * can be read without holding the lock. Events recorded into the last
+ * block of a thread after the snapshot was taken are replayed too.
  */
-void
-shell_perf_log_replay (ShellPerfLog            *perf_log,
-                       ShellPerfReplayFunction  replay_function,
-                       gpointer                 user_data)
+typedef struct {
+  ShellPerfLog *perf_log;
+  ReplayThread *threads;
+  guint n_threads;
+} ReplaySnapshot;
+
+static ReplaySnapshot *
+replay_snapshot_new (ShellPerfLog *perf_log)
+{
+  ReplaySnapshot *snapshot = g_new0 (ReplaySnapshot, 1);
+  guint i;
+
+  g_rec_mutex_lock (&perf_log->lock);
+
+  perf_log->n_replays++;
+
+  snapshot->perf_log = perf_log;
+  snapshot->n_threads = perf_log->thread_buffers->len;
+  snapshot->threads = g_new0 (ReplayThread, snapshot->n_threads);
+
+  for (i = 0; i < snapshot->n_threads; i++)
+    {
+      ShellPerfThreadBuffer *buffer = g_ptr_array_index (perf_log->thread_buffers, i);
+      ReplayThread *thread = &snapshot->threads[i];
+      GList *l;
+      guint j = 0;
+
+      thread->thread_id = buffer->thread_id;
+      thread->name = g_strdup (buffer->name);
+      thread->n_blocks = buffer->blocks.length;
+      thread->blocks = g_new (ShellPerfBlock *, thread->n_blocks);
+
+      for (l = buffer->blocks.head; l; l = l->next)
+        thread->blocks[j++] = l->data;
+    }
+
+  g_rec_mutex_unlock (&perf_log->lock);
+
+  return snapshot;
+}
+
+static void
+replay_snapshot_free (ReplaySnapshot *snapshot)
+{
+  ShellPerfLog *perf_log = snapshot->perf_log;
+  guint i;
+
+  g_rec_mutex_lock (&perf_log->lock);
+
+  /* Blocks allocated over the size limit while we were replaying
+   * can be freed now */
+  if (--perf_log->n_replays == 0 && perf_log->max_blocks != 0)
+    trim_blocks (perf_log, NULL);
+
+  g_rec_mutex_unlock (&perf_log->lock);
+
+  for (i = 0; i < snapshot->n_threads; i++)
+    {
+      g_free (snapshot->threads[i].name);
+      g_free (snapshot->threads[i].blocks);
+    }
+  g_free (snapshot->threads);
+  g_free (snapshot);
+}
+
+/* Position in the events of one thread buffer while replaying */
+typedef struct {
+  ReplayThread *thread;
+  guint block_index;
+  guint32 pos;
+  guint32 end;
+  gint64 event_time;
+  ShellPerfEvent *event;
+  const guchar *arg;
+} ReplayCursor;
+
+static void
+replay_cursor_seek (ReplayCursor *cursor,
+                    guint         block_index,
+                    gint64        since_time)
 {
-  gint64 event_time = perf_log->start_time;
-  GList *iter;
+  ReplayThread *thread = cursor->thread;
+  ShellPerfBlock *block;
+
+  /* Skip blocks which end before the requested time entirely */
+  while (block_index + 1 < thread->n_blocks &&
+         thread->blocks[block_index + 1]->start_time < since_time)
+    block_index++;
+
+  cursor->block_index = block_index;
+  if (block_index >= thread->n_blocks)
+    return;
+
+  block = thread->blocks[block_index];
+  cursor->pos = 0;
+  cursor->end = g_atomic_int_get (&block->bytes);
+  cursor->event_time = block->start_time;
+}
 
-  for (iter = perf_log->blocks->head; iter; iter = iter->next)
+/* Moves @cursor to the next event at or after @since_time. Returns
+ * %FALSE when there are no more events for the thread.
+ */
+static gboolean
+replay_cursor_next (ShellPerfLog *perf_log,
+                    ReplayCursor *cursor,
+                    gint64        since_time)
+{
+  while (cursor->block_index < cursor->thread->n_blocks)
     {
-      ShellPerfBlock *block = iter->data;
-      guint32 pos = 0;
+      ShellPerfBlock *block = cursor->thread->blocks[cursor->block_index];
+      guint16 id;
+      guint32 time_delta;
 
-      while (pos < block->bytes)
+      if (cursor->pos >= cursor->end)
         {
-          ShellPerfEvent *event;
-          guint16 id;
-          guint32 time_delta;
-          GValue arg = { 0, };
+          replay_cursor_seek (cursor, cursor->block_index + 1, since_time);
+          continue;
+        }
 
-          memcpy (&time_delta, block->buffer + pos, sizeof (guint32));
-          pos += sizeof (guint32);
-          memcpy (&id, block->buffer + pos, sizeof (guint16));
-          pos += sizeof (guint16);
+      memcpy (&time_delta, block->buffer + cursor->pos, sizeof (guint32));
+      cursor->pos += sizeof (guint32);
+      memcpy (&id, block->buffer + cursor->pos, sizeof (guint16));
+      cursor->pos += sizeof (guint16);
 
-          if (id == EVENT_SET_TIME)
-            {
-              /* Internal, we don't include in the replay */
-              memcpy (&event_time, block->buffer + pos, sizeof (gint64));
-              pos += sizeof (gint64);
-              continue;
-            }
-          else
-            {
-              event_time += time_delta;
-            }
+      if (id == EVENT_SET_TIME)
+        {
+          /* Internal, we don't include in the replay */
+          memcpy (&cursor->event_time, block->buffer + cursor->pos, sizeof (gint64));
+          cursor->pos += sizeof (gint64);
+          continue;
+        }
 
-          event = g_ptr_array_index (perf_log->events, id);
+      cursor->event_time += time_delta;
+      cursor->event = get_event (perf_log, id);
+      cursor->arg = block->buffer + cursor->pos;
+      cursor->pos += event_arg_size (cursor->event, cursor->arg);
 
-          if (strcmp (event->signature, "") == 0)
-            {
-              /* We need to pass something, so pass an empty string */
-              g_value_init (&arg, G_TYPE_STRING);
-            }
-          else if (strcmp (event->signature, "i") == 0)
-            {
-              gint32 l;
+      if (cursor->event_time >= since_time)
+        return TRUE;
+    }
 
-              memcpy (&l, block->buffer + pos, sizeof (gint32));
-              pos += sizeof (gint32);
+  return FALSE;
+}
 
-              g_value_init (&arg, G_TYPE_INT);
-              g_value_set_int (&arg, l);
-            }
-          else if (strcmp (event->signature, "x") == 0)
-            {
-              gint64 l;
+typedef void (*ReplayCursorFunction) (ReplayCursor *cursor,
+                                      gpointer      user_data);
 
-              memcpy (&l, block->buffer + pos, sizeof (gint64));
-              pos += sizeof (gint64);
+typedef struct {
+  ShellPerfReplayFunction replay_function;
+  gpointer user_data;
+} ReplayClosure;
 
-              g_value_init (&arg, G_TYPE_INT64);
-              g_value_set_int64 (&arg, l);
-            }
-          else if (strcmp (event->signature, "s") == 0)
+static void
+replay_event (ReplayCursor *cursor,
+              gpointer      data)
+{
+  ReplayClosure *closure = data;
+  ShellPerfEvent *event = cursor->event;
+  GValue arg = { 0, };
+
+  switch (event->signature[0])
+    {
+    case 'i':
+      {
+        gint32 l;
+
+        memcpy (&l, cursor->arg, sizeof (gint32));
+        g_value_init (&arg, G_TYPE_INT);
+        g_value_set_int (&arg, l);
+      }
+      break;
+    case 'x':
+      {
+        gint64 l;
+
+        memcpy (&l, cursor->arg, sizeof (gint64));
+        g_value_init (&arg, G_TYPE_INT64);
+        g_value_set_int64 (&arg, l);
+      }
+      break;
+    case 's':
+      g_value_init (&arg, G_TYPE_STRING);
+      g_value_set_string (&arg, (const char *)cursor->arg);
+      break;
+    default:
+      /* We need to pass something, so pass an empty string */
+      g_value_init (&arg, G_TYPE_STRING);
+      break;
+    }
+
+  closure->replay_function (cursor->event_time, event->name, event->signature, &arg,
+                            cursor->thread->thread_id, closure->user_data);
+  g_value_unset (&arg);
+}
+
+/* Replays the events in @snapshot recorded at or after @since_time,
+ * merged in timestamp order. The lock isn't held while calling
+ * @replay_function, so it may record events or write to a slow stream
+ * without blocking threads which are recording.
+ */
+static void
+replay_snapshot (ReplaySnapshot       *snapshot,
+                 gint64                since_time,
+                 ReplayCursorFunction  replay_function,
+                 gpointer              user_data)
+{
+  ShellPerfLog *perf_log = snapshot->perf_log;
+  ReplayCursor *cursors;
+  gboolean *have_event;
+  guint n_cursors;
+  guint i;
+
+  n_cursors = snapshot->n_threads;
+  cursors = g_new0 (ReplayCursor, n_cursors);
+  have_event = g_new0 (gboolean, n_cursors);
+
+  for (i = 0; i < n_cursors; i++)
+    {
+      cursors[i].thread = &snapshot->threads[i];
+      replay_cursor_seek (&cursors[i], 0, since_time);
+      have_event[i] = replay_cursor_next (perf_log, &cursors[i], since_time);
+    }
+
+  while (TRUE)
+    {
+      ReplayCursor *earliest = NULL;
+      guint earliest_index = 0;
+
+      /* There are only a handful of threads, so a linear scan is fine */
+      for (i = 0; i < n_cursors; i++)
+        {
+          if (have_event[i] &&
+              (earliest == NULL || cursors[i].event_time < earliest->event_time))
             {
-              g_value_init (&arg, G_TYPE_STRING);
-              g_value_set_string (&arg, (char *)block->buffer + pos);
-              pos += strlen ((char *)(block->buffer + pos)) + 1;
+              earliest = &cursors[i];
+              earliest_index = i;
             }
-
-          replay_function (event_time, event->name, event->signature, &arg, user_data);
-          g_value_unset (&arg);
         }
+
+      if (earliest == NULL)
+        break;
+
+      replay_function (earliest, user_data);
+      have_event[earliest_index] = replay_cursor_next (perf_log, earliest, since_time);
     }
+
+  g_free (have_event);
+  g_free (cursors);
+}
+
+static void
+replay_since (ShellPerfLog         *perf_log,
+              gint64                since_time,
+              ReplayCursorFunction  replay_function,
+              gpointer              user_data)
+{
+  ReplaySnapshot *snapshot = replay_snapshot_new (perf_log);
+
+  replay_snapshot (snapshot, since_time, replay_function, user_data);
+  replay_snapshot_free (snapshot);
+}
+
+/**
+ * shell_perf_log_replay:
+ * @perf_log: a #ShellPerfLog
+ * @replay_function: (scope call): function to call for each event in the log
+ * @user_data: data to pass to @replay_function
+ *
+ * Replays the log by calling the given function for each event
+ * in the log. Events recorded in different threads are merged in
+ * order of their timestamps, and passed along with the id of the
+ * thread that recorded them; the thread which created the log has
+ * id 0.
+ */
+void
+shell_perf_log_replay (ShellPerfLog            *perf_log,
+                       ShellPerfReplayFunction  replay_function,
+                       gpointer                 user_data)
+{
+  ReplayClosure closure;
+
+  closure.replay_function = replay_function;
+  closure.user_data = user_data;
+
+  replay_since (perf_log, G_MININT64, replay_event, &closure);
 }
 
 static char *
@@ -822,9 +1743,9 @@ shell_perf_log_dump_events (ShellPerfLog   *perf_log,
   output = g_string_new (NULL);
   g_string_append (output, "[ ");
 
-  for (i = 0; i < perf_log->events->len; i++)
+  for (i = 0; i < (guint) g_atomic_int_get (&perf_log->n_events); i++)
     {
-      ShellPerfEvent *event = g_ptr_array_index (perf_log->events, i);
+      ShellPerfEvent *event = get_event (perf_log, i);
       char *escaped_description = escape_quotes (event->description);
       gboolean is_statistic = g_hash_table_lookup (perf_log->statistics_by_name, event->name) != NULL;
 
@@ -860,6 +1781,7 @@ replay_to_json (gint64      time,
                 const char *name,
                 const char *signature,
                 GValue     *arg,
+                guint       thread_id,
                 gpointer    user_data)
 {
   ReplayToJsonClosure *closure = user_data;
@@ -958,3 +1880,350 @@ shell_perf_log_dump_log (ShellPerfLog   *perf_log,
 
   return TRUE;
 }
+
+/**
+ * shell_perf_log_dump_recent_log:
+ * @perf_log: a #ShellPerfLog
+ * @seconds: how far back to go, in seconds
+ * @out: output stream into which to write the event log
+ * @error: location to store #GError, or %NULL
+ *
+ * Like shell_perf_log_dump_log(), but only writes the events recorded
+ * during the last @seconds seconds. Events which have already been
+ * dropped from the log when it is limited with shell_perf_log_set_max_size()
+ * are not included, so the result may cover a shorter time span.
+ *
+ * Return value: %TRUE if the dump succeeded. %FALSE if an IO error occurred
+ */
+gboolean
+shell_perf_log_dump_recent_log (ShellPerfLog   *perf_log,
+                                guint           seconds,
+                                GOutputStream  *out,
+                                GError        **error)
+{
+  ReplayToJsonClosure closure;
+  ReplayClosure replay_closure;
+
+  closure.out = out;
+  closure.error = NULL;
+  closure.first = TRUE;
+
+  if (!write_string (out, "[ ", &closure.error))
+    return FALSE;
+
+  replay_closure.replay_function = replay_to_json;
+  replay_closure.user_data = &closure;
+
+  replay_since (perf_log, get_time () - (gint64) seconds * G_USEC_PER_SEC,
+                replay_event, &replay_closure);
+
+  if (closure.error != NULL)
+    {
+      g_propagate_error (error, closure.error);
+      return FALSE;
+    }
+
+  if (!write_string (out, " ]", &closure.error))
+    return FALSE;
+
+  return TRUE;
+}
+
+/* Chrome Trace Event Format export */
+
+typedef enum {
+  TRACE_INSTANT,
+  TRACE_COUNTER,
+  TRACE_BEGIN,
+  TRACE_END
+} TraceEventKind;
+
+typedef struct {
+  TraceEventKind kind;
+  /* For TRACE_BEGIN and TRACE_END, the name of the slice */
+  char *slice_name;
+} TraceEventInfo;
+
+typedef struct {
+  GOutputStream *out;
+  GString *pending;
+  GError *error;
+  TraceEventInfo *infos;
+  guint n_infos;
+  int pid;
+} ReplayToTraceClosure;
+
+/* Bytes of formatted output to collect before writing them out */
+#define TRACE_WRITE_CHUNK 4096
+
+static void
+append_json_string (GString    *str,
+                    const char *value)
+{
+  const char *p;
+
+  g_string_append_c (str, '"');
+
+  for (p = value; *p; p++)
+    {
+      switch (*p)
+        {
+        case '"':
+          g_string_append (str, "\\\"");
+          break;
+        case '\\':
+          g_string_append (str, "\\\\");
+          break;
+        case '\n':
+          g_string_append (str, "\\n");
+          break;
+        default:
+          if ((guchar)*p < 0x20)
+            g_string_append_printf (str, "\\u%04x", (guchar)*p);
+          else
+            g_string_append_c (str, *p);
+        }
+    }
+
+  g_string_append_c (str, '"');
+}
+
+static void
+trace_flush (ReplayToTraceClosure *closure,
+             gboolean              force)
+{
+  if (closure->error != NULL)
+    {
+      g_string_truncate (closure->pending, 0);
+      return;
+    }
+
+  if (closure->pending->len < TRACE_WRITE_CHUNK && !force)
+    return;
+
+  g_output_stream_write_all (closure->out,
+                             closure->pending->str, closure->pending->len,
+                             NULL, NULL, &closure->error);
+  g_string_truncate (closure->pending, 0);
+}
+
+/* Pairs of events named <prefix>Start and <prefix>Done are how durations
+ * have traditionally been recorded in the log; export those as slices
+ * named <prefix>.
+ */
+static TraceEventInfo *
+classify_trace_events (ShellPerfLog *perf_log,
+                       guint         n_events)
+{
+  TraceEventInfo *infos = g_new0 (TraceEventInfo, n_events);
+  guint i;
+
+  for (i = 0; i < n_events; i++)
+    {
+      ShellPerfEvent *event = get_event (perf_log, i);
+      char *prefix = NULL;
+      char *other;
+
+      if (g_hash_table_lookup (perf_log->statistics_by_name, event->name) != NULL)
+        {
+          infos[i].kind = TRACE_COUNTER;
+          continue;
+        }
+
+      if (g_str_has_suffix (event->name, "Start"))
+        {
+          prefix = g_strndup (event->name, strlen (event->name) - strlen ("Start"));
+          other = g_strconcat (prefix, "Done", NULL);
+          if (g_hash_table_lookup (perf_log->events_by_name, other) != NULL)
+            infos[i].kind = TRACE_BEGIN;
+          g_free (other);
+        }
+      else if (g_str_has_suffix (event->name, "Done"))
+        {
+          prefix = g_strndup (event->name, strlen (event->name) - strlen ("Done"));
+          other = g_strconcat (prefix, "Start", NULL);
+          if (g_hash_table_lookup (perf_log->events_by_name, other) != NULL)
+            infos[i].kind = TRACE_END;
+          g_free (other);
+        }
+
+      if (infos[i].kind != TRACE_INSTANT)
+        infos[i].slice_name = prefix;
+      else
+        g_free (prefix);
+    }
+
+  return infos;
+}
+
+static void
+append_trace_arg (GString      *str,
+                  ReplayCursor *cursor)
+{
+  switch (cursor->event->signature[0])
+    {
+    case 'i':
+      {
+        gint32 l;
+
+        memcpy (&l, cursor->arg, sizeof (gint32));
+        g_string_append_printf (str, "%d", l);
+      }
+      break;
+    case 'x':
+      {
+        gint64 l;
+
+        memcpy (&l, cursor->arg, sizeof (gint64));
+        g_string_append_printf (str, "%" G_GINT64_FORMAT, l);
+      }
+      break;
+    case 's':
+      append_json_string (str, (const char *)cursor->arg);
+      break;
+    default:
+      g_assert_not_reached ();
+    }
+}
+
+static void
+replay_to_trace (ReplayCursor *cursor,
+                 gpointer      user_data)
+{
+  ReplayToTraceClosure *closure = user_data;
+  TraceEventInfo instant = { TRACE_INSTANT, NULL };
+  TraceEventInfo *info;
+  GString *str = closure->pending;
+  const char *name;
+  const char *phase;
+
+  if (closure->error != NULL)
+    return;
+
+  /* Events defined while we were replaying weren't classified */
+  if (cursor->event->id < closure->n_infos)
+    info = &closure->infos[cursor->event->id];
+  else
+    info = &instant;
+
+  switch (info->kind)
+    {
+    case TRACE_COUNTER:
+      name = cursor->event->name;
+      phase = "C";
+      break;
+    case TRACE_BEGIN:
+      name = info->slice_name;
+      phase = "B";
+      break;
+    case TRACE_END:
+      name = info->slice_name;
+      phase = "E";
+      break;
+    case TRACE_INSTANT:
+    default:
+      name = cursor->event->name;
+      phase = "i";
+      break;
+    }
+
+  g_string_append (str, ",\n{\"name\":");
+  append_json_string (str, name);
+  g_string_append_printf (str,
+                          ",\"cat\":\"shell\",\"ph\":\"%s\",\"ts\":%" G_GINT64_FORMAT
+                          ",\"pid\":%d,\"tid\":%u",
+                          phase, cursor->event_time,
+                          closure->pid, cursor->thread->thread_id);
+
+  if (info->kind == TRACE_INSTANT)
+    g_string_append (str, ",\"s\":\"t\"");
+
+  if (cursor->event->signature[0] != '\0')
+    {
+      g_string_append (str, ",\"args\":{\"value\":");
+      append_trace_arg (str, cursor);
+      g_string_append_c (str, '}');
+    }
+
+  g_string_append_c (str, '}');
+
+  trace_flush (closure, FALSE);
+}
+
+/**
+ * shell_perf_log_dump_trace:
+ * @perf_log: a #ShellPerfLog
+ * @out: output stream into which to write the trace
+ * @error: location to store #GError, or %NULL
+ *
+ * Writes the performance event log in the Trace Event Format used by
+ * chrome://tracing and Perfetto, so it can be inspected with standard
+ * trace viewers. Statistics are written as counters, pairs of events
+ * named <prefix>Start and <prefix>Done as duration slices called
+ * <prefix>, and other events as instant events. Each thread that
+ * recorded events gets its own track.
+ *
+ * The trace is written in small pieces as the log is replayed, rather
+ * than being built in memory first. The log isn't locked while writing,
+ * so a slow stream doesn't hold up threads which are recording events.
+ *
+ * Return value: %TRUE if the dump succeeded. %FALSE if an IO error occurred
+ */
+gboolean
+shell_perf_log_dump_trace (ShellPerfLog   *perf_log,
+                           GOutputStream  *out,
+                           GError        **error)
+{
+  ReplayToTraceClosure closure;
+  ReplaySnapshot *snapshot;
+  guint i;
+
+  closure.out = out;
+  closure.pending = g_string_sized_new (TRACE_WRITE_CHUNK + 256);
+  closure.error = NULL;
+  closure.pid = getpid ();
+
+  snapshot = replay_snapshot_new (perf_log);
+
+  g_rec_mutex_lock (&perf_log->lock);
+  closure.n_infos = g_atomic_int_get (&perf_log->n_events);
+  closure.infos = classify_trace_events (perf_log, closure.n_infos);
+  g_rec_mutex_unlock (&perf_log->lock);
+
+  g_string_append_printf (closure.pending,
+                          "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+                          "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,"
+                          "\"args\":{\"name\":\"gnome-shell\"}}",
+                          closure.pid);
+
+  for (i = 0; i < snapshot->n_threads; i++)
+    {
+      ReplayThread *thread = &snapshot->threads[i];
+
+      g_string_append_printf (closure.pending,
+                              ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,"
+                              "\"args\":{\"name\":",
+                              closure.pid, thread->thread_id);
+      append_json_string (closure.pending, thread->name);
+      g_string_append (closure.pending, "}}");
+    }
+
+  replay_snapshot (snapshot, G_MININT64, replay_to_trace, &closure);
+  replay_snapshot_free (snapshot);
+
+  g_string_append (closure.pending, "\n]}\n");
+  trace_flush (&closure, TRUE);
+
+  for (i = 0; i < closure.n_infos; i++)
+    g_free (closure.infos[i].slice_name);
+  g_free (closure.infos);
+  g_string_free (closure.pending, TRUE);
+
+  if (closure.error != NULL)
+    {
+      g_propagate_error (error, closure.error);
+      return FALSE;
+    }
+
+  return TRUE;
+}
@@ -14,11 +14,18 @@ ShellPerfLog *shell_perf_log_get_default (void);
 
 void shell_perf_log_set_enabled (ShellPerfLog *perf_log,
 				 gboolean      enabled);
+gboolean shell_perf_log_get_enabled (ShellPerfLog *perf_log);
+
+void shell_perf_log_set_max_size (ShellPerfLog *perf_log,
+				  gsize         max_bytes);
+
+guint shell_perf_log_define_event (ShellPerfLog *perf_log,
+				   const char   *name,
+				   const char   *description,
+				   const char   *signature);
+guint shell_perf_log_lookup_event (ShellPerfLog *perf_log,
+				   const char   *name);
 
-void shell_perf_log_define_event (ShellPerfLog *perf_log,
-				  const char   *name,
-				  const char   *description,
-				  const char   *signature);
 void shell_perf_log_event        (ShellPerfLog *perf_log,
 				  const char   *name);
 void shell_perf_log_event_i      (ShellPerfLog *perf_log,
@@ -31,6 +38,46 @@ void shell_perf_log_event_s      (ShellPerfLog *perf_log,
 				  const char   *name,
 				  const char   *arg);
 
+void shell_perf_log_record       (ShellPerfLog *perf_log,
+				  guint         event);
+void shell_perf_log_record_i     (ShellPerfLog *perf_log,
+				  guint         event,
+				  gint32        arg);
+void shell_perf_log_record_x     (ShellPerfLog *perf_log,
+				  guint         event,
+				  gint64        arg);
+void shell_perf_log_record_s     (ShellPerfLog *perf_log,
+				  guint         event,
+				  const char   *arg);
+
+guint shell_perf_log_define_span (ShellPerfLog *perf_log,
+                                  const char   *name,
+                                  const char   *description);
+guint shell_perf_log_begin_span  (ShellPerfLog *perf_log,
+                                  guint         span);
+void  shell_perf_log_end_span    (ShellPerfLog *perf_log,
+                                  guint         span,
+                                  guint         id);
+
+/**
+ * SHELL_PERF_LOG_SPAN_BEGIN:
+ * @span: a variable holding a handle returned by shell_perf_log_define_span()
+ *
+ * Records the start of @span in the default performance log. Must be
+ * matched with SHELL_PERF_LOG_SPAN_END() in the same scope.
+ */
+#define SHELL_PERF_LOG_SPAN_BEGIN(span) \
+  guint span##_id = shell_perf_log_begin_span (shell_perf_log_get_default (), span)
+
+/**
+ * SHELL_PERF_LOG_SPAN_END:
+ * @span: the span passed to SHELL_PERF_LOG_SPAN_BEGIN()
+ *
+ * Records the end of @span in the default performance log.
+ */
+#define SHELL_PERF_LOG_SPAN_END(span) \
+  shell_perf_log_end_span (shell_perf_log_get_default (), span, span##_id)
+
 void shell_perf_log_define_statistic (ShellPerfLog *perf_log,
                                       const char   *name,
                                       const char   *description,
@@ -57,6 +104,7 @@ typedef void (*ShellPerfReplayFunction) (gint64      time,
 					 const char *name,
 					 const char *signature,
 					 GValue     *arg,
+                                         guint       thread_id,
                                          gpointer    user_data);
 
 void shell_perf_log_replay (ShellPerfLog            *perf_log,
@@ -69,6 +117,13 @@ gboolean shell_perf_log_dump_events (ShellPerfLog   *perf_log,
 gboolean shell_perf_log_dump_log    (ShellPerfLog   *perf_log,
                                      GOutputStream  *out,
                                      GError        **error);
+gboolean shell_perf_log_dump_recent_log (ShellPerfLog   *perf_log,
+                                         guint           seconds,
+                                         GOutputStream  *out,
+                                         GError        **error);
+gboolean shell_perf_log_dump_trace (ShellPerfLog   *perf_log,
+                                    GOutputStream  *out,
+                                    GError        **error);
 
 G_END_DECLS
 
@@ -0,0 +1,397 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+
+#include "config.h"
+
+#include <cogl/cogl.h>
+
+#include "shell-recorder-convert.h"
+
+/* Each pixel of the output packs four bytes of the planes, which are
+ * laid out like GStreamer expects them for a width multiple of 8:
+ *
+ *  - the luma plane takes the first video_height rows, one byte per
+ *    pixel of the video;
+ *  - for NV12, the interleaved chroma plane takes the next
+ *    video_height / 2 rows;
+ *  - for I420, each row of the next video_height / 4 rows holds two
+ *    rows of the U plane, and the rows after that hold the V plane.
+ *
+ * The colors are converted following BT.709, with limited range.
+ */
+static const char convert_declarations[] =
+  "uniform vec2 video_size;\n"
+  "uniform vec4 cursor_rect;\n"
+  "uniform float nv12;\n"
+  "\n"
+  "vec3\n"
+  "shell_sample (vec2 pos)\n"
+  "{\n"
+  "  vec4 color = texture2D (cogl_sampler0, pos);\n"
+  "  vec2 cursor_pos = (pos - cursor_rect.xy) / cursor_rect.zw;\n"
+  "\n"
+  "  if (all (greaterThanEqual (cursor_pos, vec2 (0.0))) &&\n"
+  "      all (lessThan (cursor_pos, vec2 (1.0))))\n"
+  "    {\n"
+  "      vec4 cursor = texture2D (cogl_sampler1, cursor_pos);\n"
+  "      color = cursor + color * (1.0 - cursor.a);\n"
+  "    }\n"
+  "\n"
+  "  return color.rgb;\n"
+  "}\n"
+  "\n"
+  "float\n"
+  "shell_luma (vec2 pos)\n"
+  "{\n"
+  "  return 0.0627 + dot (shell_sample (pos), vec3 (0.1826, 0.6142, 0.0620));\n"
+  "}\n"
+  "\n"
+  "vec2\n"
+  "shell_chroma (vec2 pos)\n"
+  "{\n"
+  "  vec3 color = shell_sample (pos);\n"
+  "\n"
+  "  return vec2 (0.5020 + dot (color, vec3 (-0.1006, -0.3386, 0.4392)),\n"
+  "               0.5020 + dot (color, vec3 (0.4392, -0.3989, -0.0403)));\n"
+  "}\n";
+
+static const char convert_source[] =
+  "vec2 out_pos = floor (cogl_tex_coord_in[0].st *\n"
+  "                      vec2 (video_size.x / 4.0, video_size.y * 1.5));\n"
+  "vec2 pixel = 1.0 / video_size;\n"
+  "vec2 dx = vec2 (pixel.x, 0.0);\n"
+  "\n"
+  "if (out_pos.y < video_size.y)\n"
+  "  {\n"
+  "    vec2 pos = (vec2 (out_pos.x * 4.0, out_pos.y) + 0.5) * pixel;\n"
+  "\n"
+  "    cogl_color_out = vec4 (shell_luma (pos),\n"
+  "                           shell_luma (pos + dx),\n"
+  "                           shell_luma (pos + 2.0 * dx),\n"
+  "                           shell_luma (pos + 3.0 * dx));\n"
+  "  }\n"
+  "else if (nv12 > 0.5)\n"
+  "  {\n"
+  "    float row = out_pos.y - video_size.y;\n"
+  "    vec2 pos = (vec2 (out_pos.x * 4.0, row * 2.0) + 1.0) * pixel;\n"
+  "\n"
+  "    cogl_color_out = vec4 (shell_chroma (pos),\n"
+  "                           shell_chroma (pos + 2.0 * dx));\n"
+  "  }\n"
+  "else\n"
+  "  {\n"
+  "    float plane_rows = video_size.y / 4.0;\n"
+  "    float half_width = video_size.x / 8.0;\n"
+  "    float row = out_pos.y - video_size.y;\n"
+  "    float plane = floor (row / plane_rows);\n"
+  "    float second = step (half_width, out_pos.x);\n"
+  "    vec2 chroma_pos = vec2 ((out_pos.x - second * half_width) * 4.0,\n"
+  "                            (row - plane * plane_rows) * 2.0 + second);\n"
+  "    vec2 pos = (chroma_pos * 2.0 + 1.0) * pixel;\n"
+  "    vec2 c0 = shell_chroma (pos);\n"
+  "    vec2 c1 = shell_chroma (pos + 2.0 * dx);\n"
+  "    vec2 c2 = shell_chroma (pos + 4.0 * dx);\n"
+  "    vec2 c3 = shell_chroma (pos + 6.0 * dx);\n"
+  "\n"
+  "    cogl_color_out = mix (vec4 (c0.x, c1.x, c2.x, c3.x),\n"
+  "                          vec4 (c0.y, c1.y, c2.y, c3.y),\n"
+  "                          plane);\n"
+  "  }\n";
+
+struct _ShellRecorderConverter
+{
+  ShellRecorderFormat format;
+  int frame_width;
+  int frame_height;
+  int video_width;
+  int video_height;
+
+  /* The recorded area, without the cursor */
+  CoglTexture *frame;
+
+  CoglTexture *output;
+  CoglFramebuffer *framebuffer;
+  CoglPipeline *pipeline;
+  int cursor_rect_location;
+
+  CoglTexture *cursor;
+  int cursor_x;
+  int cursor_y;
+
+  /* Whether the output is out of date */
+  gboolean dirty;
+};
+
+static CoglPipeline *
+create_pipeline (CoglContext *ctx)
+{
+  static CoglPipeline *template = NULL;
+
+  if (G_UNLIKELY (template == NULL))
+    {
+      CoglSnippet *snippet;
+
+      template = cogl_pipeline_new (ctx);
+
+      /* The output is written as is, it isn't a color */
+      cogl_pipeline_set_blend (template, "RGBA = ADD (SRC_COLOR, 0)", NULL);
+
+      cogl_pipeline_set_layer_null_texture (template, 0, COGL_TEXTURE_TYPE_2D);
+      cogl_pipeline_set_layer_filters (template, 0,
+                                       COGL_PIPELINE_FILTER_LINEAR,
+                                       COGL_PIPELINE_FILTER_LINEAR);
+      cogl_pipeline_set_layer_wrap_mode (template, 0,
+                                         COGL_PIPELINE_WRAP_MODE_CLAMP_TO_EDGE);
+      cogl_pipeline_set_layer_null_texture (template, 1, COGL_TEXTURE_TYPE_2D);
+      cogl_pipeline_set_layer_wrap_mode (template, 1,
+                                         COGL_PIPELINE_WRAP_MODE_CLAMP_TO_EDGE);
+
+      snippet = cogl_snippet_new (COGL_SNIPPET_HOOK_FRAGMENT,
+                                  convert_declarations,
+                                  NULL);
+      cogl_snippet_set_replace (snippet, convert_source);
+      cogl_pipeline_add_snippet (template, snippet);
+      cogl_object_unref (snippet);
+    }
+
+  return cogl_pipeline_copy (template);
+}
+
+/*
+ * _shell_recorder_converter_new:
+ * @format: %SHELL_RECORDER_FORMAT_I420 or %SHELL_RECORDER_FORMAT_NV12
+ * @frame_width: the width of the recorded area
+ * @frame_height: the height of the recorded area
+ * @video_width: the width of the video, a multiple of 8
+ * @video_height: the height of the video, a multiple of 4
+ *
+ * Return value: a new #ShellRecorderConverter, or %NULL if the
+ *   textures couldn't be allocated
+ */
+ShellRecorderConverter *
+_shell_recorder_converter_new (ShellRecorderFormat format,
+                               int                 frame_width,
+                               int                 frame_height,
+                               int                 video_width,
+                               int                 video_height)
+{
+  ShellRecorderConverter *converter;
+  CoglContext *ctx;
+  CoglOffscreen *offscreen;
+  CoglError *error = NULL;
+
+  g_return_val_if_fail (format != SHELL_RECORDER_FORMAT_RGB, NULL);
+  g_return_val_if_fail (video_width % 8 == 0 && video_height % 4 == 0, NULL);
+
+  ctx = clutter_backend_get_cogl_context (clutter_get_default_backend ());
+
+  converter = g_new0 (ShellRecorderConverter, 1);
+  converter->format = format;
+  converter->frame_width = frame_width;
+  converter->frame_height = frame_height;
+  converter->video_width = video_width;
+  converter->video_height = video_height;
+  converter->dirty = TRUE;
+
+  converter->frame =
+    COGL_TEXTURE (cogl_texture_2d_new_with_size (ctx, frame_width, frame_height));
+  converter->output =
+    COGL_TEXTURE (cogl_texture_2d_new_with_size (ctx, video_width / 4, video_height * 3 / 2));
+
+  if (!cogl_texture_allocate (converter->frame, &error) ||
+      !cogl_texture_allocate (converter->output, &error))
+    goto fail;
+
+  offscreen = cogl_offscreen_new_with_texture (converter->output);
+  converter->framebuffer = COGL_FRAMEBUFFER (offscreen);
+
+  if (!cogl_framebuffer_allocate (converter->framebuffer, &error))
+    goto fail;
+
+  cogl_framebuffer_orthographic (converter->framebuffer, 0, 0,
+                                 video_width / 4, video_height * 3 / 2,
+                                 -1.0, 1.0);
+
+  converter->pipeline = create_pipeline (ctx);
+  cogl_pipeline_set_layer_texture (converter->pipeline, 0, converter->frame);
+
+  cogl_pipeline_set_uniform_1f (converter->pipeline,
+                                cogl_pipeline_get_uniform_location (converter->pipeline, "nv12"),
+                                format == SHELL_RECORDER_FORMAT_NV12);
+  cogl_pipeline_set_uniform_float (converter->pipeline,
+                                   cogl_pipeline_get_uniform_location (converter->pipeline, "video_size"),
+                                   2, 1,
+                                   (float [2]) { video_width, video_height });
+
+  converter->cursor_rect_location =
+    cogl_pipeline_get_uniform_location (converter->pipeline, "cursor_rect");
+  _shell_recorder_converter_set_cursor (converter, NULL, 0, 0);
+
+  return converter;
+
+ fail:
+  g_warning ("Can't convert recorded frames on the GPU: %s", error->message);
+  cogl_error_free (error);
+  _shell_recorder_converter_free (converter);
+
+  return NULL;
+}
+
+void
+_shell_recorder_converter_free (ShellRecorderConverter *converter)
+{
+  g_clear_pointer (&converter->frame, cogl_object_unref);
+  g_clear_pointer (&converter->output, cogl_object_unref);
+  g_clear_pointer (&converter->framebuffer, cogl_object_unref);
+  g_clear_pointer (&converter->pipeline, cogl_object_unref);
+  g_clear_pointer (&converter->cursor, cogl_object_unref);
+
+  g_free (converter);
+}
+
+/*
+ * _shell_recorder_converter_get_size:
+ * @converter: a #ShellRecorderConverter
+ *
+ * Return value: the size of a converted frame in bytes
+ */
+gsize
+_shell_recorder_converter_get_size (ShellRecorderConverter *converter)
+{
+  return (gsize) converter->video_width * converter->video_height * 3 / 2;
+}
+
+/*
+ * _shell_recorder_converter_update:
+ * @converter: a #ShellRecorderConverter
+ * @bitmap: new contents for part of the recorded area
+ * @x: the position of @bitmap, relative to the recorded area
+ * @y: the position of @bitmap, relative to the recorded area
+ *
+ * Updates part of the recorded area. When @bitmap is backed by a pixel
+ * buffer, the data doesn't go through the CPU.
+ */
+void
+_shell_recorder_converter_update (ShellRecorderConverter *converter,
+                                  CoglBitmap             *bitmap,
+                                  int                     x,
+                                  int                     y)
+{
+  cogl_texture_set_region_from_bitmap (converter->frame,
+                                       0, 0,
+                                       x, y,
+                                       cogl_bitmap_get_width (bitmap),
+                                       cogl_bitmap_get_height (bitmap),
+                                       bitmap);
+  converter->dirty = TRUE;
+}
+
+/*
+ * _shell_recorder_converter_set_cursor:
+ * @converter: a #ShellRecorderConverter
+ * @sprite: (allow-none): the cursor image, or %NULL to draw no cursor
+ * @x: the position of @sprite, relative to the recorded area
+ * @y: the position of @sprite, relative to the recorded area
+ *
+ * Sets the cursor drawn on top of the recorded area.
+ */
+void
+_shell_recorder_converter_set_cursor (ShellRecorderConverter *converter,
+                                      CoglTexture            *sprite,
+                                      int                     x,
+                                      int                     y)
+{
+  float rect[4];
+
+  if (sprite == converter->cursor &&
+      x == converter->cursor_x && y == converter->cursor_y)
+    return;
+
+  if (sprite)
+    cogl_object_ref (sprite);
+  g_clear_pointer (&converter->cursor, cogl_object_unref);
+  converter->cursor = sprite;
+  converter->cursor_x = x;
+  converter->cursor_y = y;
+
+  if (sprite)
+    {
+      cogl_pipeline_set_layer_texture (converter->pipeline, 1, sprite);
+
+      rect[0] = (float) x / converter->frame_width;
+      rect[1] = (float) y / converter->frame_height;
+      rect[2] = (float) cogl_texture_get_width (sprite) / converter->frame_width;
+      rect[3] = (float) cogl_texture_get_height (sprite) / converter->frame_height;
+    }
+  else
+    {
+      cogl_pipeline_set_layer_null_texture (converter->pipeline, 1,
+                                            COGL_TEXTURE_TYPE_2D);
+
+      /* Out of the frame */
+      rect[0] = rect[1] = 2.0;
+      rect[2] = rect[3] = 1.0;
+    }
+
+  cogl_pipeline_set_uniform_float (converter->pipeline,
+                                   converter->cursor_rect_location,
+                                   4, 1, rect);
+  converter->dirty = TRUE;
+}
+
+/*
+ * _shell_recorder_converter_render:
+ * @converter: a #ShellRecorderConverter
+ *
+ * Converts the recorded area, if it or the cursor changed since the
+ * last time. The converted frame is read from the returned framebuffer
+ * as %COGL_PIXEL_FORMAT_RGBA_8888_PRE, video_width / 4 pixels wide and
+ * video_height * 3 / 2 pixels high.
+ *
+ * Return value: (transfer none): the framebuffer holding the converted
+ *   frame, or %NULL if nothing changed
+ */
+CoglFramebuffer *
+_shell_recorder_converter_render (ShellRecorderConverter *converter)
+{
+  if (!converter->dirty)
+    return NULL;
+
+  cogl_framebuffer_draw_textured_rectangle (converter->framebuffer,
+                                            converter->pipeline,
+                                            0, 0,
+                                            converter->video_width / 4,
+                                            converter->video_height * 3 / 2,
+                                            0, 0, 1, 1);
+  converter->dirty = FALSE;
+
+  return converter->framebuffer;
+}
+
+/*
+ * _shell_recorder_converter_read:
+ * @converter: a #ShellRecorderConverter
+ * @data: where to store the converted frame
+ *
+ * Converts the recorded area like _shell_recorder_converter_render(),
+ * and reads the result back synchronously.
+ *
+ * Return value: %FALSE if nothing changed, and @data was left untouched
+ */
+gboolean
+_shell_recorder_converter_read (ShellRecorderConverter *converter,
+                                guint8                 *data)
+{
+  CoglFramebuffer *framebuffer;
+
+  framebuffer = _shell_recorder_converter_render (converter);
+  if (framebuffer == NULL)
+    return FALSE;
+
+  cogl_framebuffer_read_pixels (framebuffer, 0, 0,
+                                converter->video_width / 4,
+                                converter->video_height * 3 / 2,
+                                COGL_PIXEL_FORMAT_RGBA_8888_PRE,
+                                data);
+
+  return TRUE;
+}
@@ -0,0 +1,46 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+#ifndef __SHELL_RECORDER_CONVERT_H__
+#define __SHELL_RECORDER_CONVERT_H__
+
+#include <clutter/clutter.h>
+
+#include "shell-recorder.h"
+
+G_BEGIN_DECLS
+
+/*
+ * ShellRecorderConverter:
+ *
+ * Keeps a copy of the recorded area in a texture, and converts it to
+ * YUV 4:2:0 on the GPU, scaling it to the size of the video and
+ * drawing the cursor on top. The converted frame is drawn into an
+ * offscreen framebuffer packing the planes as rows of RGBA pixels, so
+ * it can be read back as is.
+ */
+typedef struct _ShellRecorderConverter ShellRecorderConverter;
+
+ShellRecorderConverter *_shell_recorder_converter_new        (ShellRecorderFormat     format,
+                                                              int                     frame_width,
+                                                              int                     frame_height,
+                                                              int                     video_width,
+                                                              int                     video_height);
+void                    _shell_recorder_converter_free       (ShellRecorderConverter *converter);
+
+gsize                   _shell_recorder_converter_get_size   (ShellRecorderConverter *converter);
+
+void                    _shell_recorder_converter_update     (ShellRecorderConverter *converter,
+                                                              CoglBitmap             *bitmap,
+                                                              int                     x,
+                                                              int                     y);
+void                    _shell_recorder_converter_set_cursor (ShellRecorderConverter *converter,
+                                                              CoglTexture            *sprite,
+                                                              int                     x,
+                                                              int                     y);
+
+CoglFramebuffer        *_shell_recorder_converter_render     (ShellRecorderConverter *converter);
+gboolean                _shell_recorder_converter_read       (ShellRecorderConverter *converter,
+                                                              guint8                 *data);
+
+G_END_DECLS
+
+#endif /* __SHELL_RECORDER_CONVERT_H__ */
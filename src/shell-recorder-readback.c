@@ -0,0 +1,359 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <cogl/cogl.h>
+
+#include "shell-recorder-readback.h"
+
+/* How many frames can be in flight. A frame is only mapped when its
+ * slot is needed for a new one, once N_SLOTS - 1 more frames have been
+ * started after it, by which time the GPU is long done with it.
+ */
+#define N_SLOTS 3
+
+typedef struct {
+  CoglPixelBuffer *buffer;
+  cairo_rectangle_int_t area;
+  /* The parts of the area which were read, in stage coordinates */
+  cairo_region_t *damage;
+  GstClockTime pts;
+
+  /* When converting, the damage is read here on its way to the
+   * converter, and the buffer holds the whole converted frame */
+  CoglPixelBuffer *staging;
+  gboolean converted;
+} ReadbackSlot;
+
+typedef struct {
+  ClutterStageView *view;
+  cairo_rectangle_int_t rect;
+  cairo_rectangle_int_t layout;
+} ReadbackPart;
+
+struct _ShellRecorderReadback
+{
+  ClutterStage *stage;
+  CoglContext *context;
+  ShellRecorderConverter *converter;
+
+  ReadbackSlot slots[N_SLOTS];
+  /* Oldest frame waiting to be collected, and the number of them */
+  int oldest;
+  int n_pending;
+
+  /* Reused to split the damage between the stage views */
+  GArray *parts;
+};
+
+/*
+ * _shell_recorder_readback_new:
+ * @stage: the stage to read from
+ * @converter: (allow-none): a #ShellRecorderConverter to convert the
+ *   frames with, which must be kept alive as long as the readback
+ *
+ * Return value: a new #ShellRecorderReadback
+ */
+ShellRecorderReadback *
+_shell_recorder_readback_new (ClutterStage           *stage,
+                              ShellRecorderConverter *converter)
+{
+  ShellRecorderReadback *readback = g_new0 (ShellRecorderReadback, 1);
+
+  readback->stage = stage;
+  readback->converter = converter;
+  readback->context =
+    clutter_backend_get_cogl_context (clutter_get_default_backend ());
+  readback->parts = g_array_new (FALSE, FALSE, sizeof (ReadbackPart));
+
+  return readback;
+}
+
+void
+_shell_recorder_readback_free (ShellRecorderReadback *readback)
+{
+  int i;
+
+  for (i = 0; i < N_SLOTS; i++)
+    {
+      if (readback->slots[i].buffer)
+        cogl_object_unref (readback->slots[i].buffer);
+      if (readback->slots[i].staging)
+        cogl_object_unref (readback->slots[i].staging);
+      if (readback->slots[i].damage)
+        cairo_region_destroy (readback->slots[i].damage);
+    }
+
+  g_array_free (readback->parts, TRUE);
+  g_free (readback);
+}
+
+/* Splits @damage into the parts covered by each stage view. This fails
+ * if part of it isn't covered by any view, or if a view is scaled,
+ * since the pixels then have to be composited on the CPU.
+ */
+static gboolean
+get_parts (ShellRecorderReadback *readback,
+           cairo_region_t        *damage)
+{
+  cairo_region_t *remaining;
+  gboolean result = TRUE;
+
+  g_array_set_size (readback->parts, 0);
+  remaining = cairo_region_copy (damage);
+
+  while (!cairo_region_is_empty (remaining))
+    {
+      cairo_rectangle_int_t rect;
+      cairo_region_t *covered;
+      ReadbackPart part;
+      int i, n_rects;
+
+      cairo_region_get_rectangle (remaining, 0, &rect);
+
+      part.view = clutter_stage_get_view_at (readback->stage, rect.x, rect.y);
+      if (part.view == NULL ||
+          clutter_stage_view_get_scale (part.view) != 1)
+        {
+          result = FALSE;
+          break;
+        }
+
+      clutter_stage_view_get_layout (part.view, &part.layout);
+
+      covered = cairo_region_copy (remaining);
+      cairo_region_intersect_rectangle (covered, &part.layout);
+
+      n_rects = cairo_region_num_rectangles (covered);
+      for (i = 0; i < n_rects; i++)
+        {
+          cairo_region_get_rectangle (covered, i, &part.rect);
+          g_array_append_val (readback->parts, part);
+        }
+
+      cairo_region_subtract (remaining, covered);
+      cairo_region_destroy (covered);
+    }
+
+  cairo_region_destroy (remaining);
+
+  return result;
+}
+
+static void
+ensure_buffer (ShellRecorderReadback  *readback,
+               CoglPixelBuffer       **buffer,
+               gsize                   size)
+{
+  if (*buffer != NULL &&
+      cogl_buffer_get_size (COGL_BUFFER (*buffer)) == size)
+    return;
+
+  if (*buffer)
+    cogl_object_unref (*buffer);
+
+  *buffer = cogl_pixel_buffer_new (readback->context, size, NULL);
+  cogl_buffer_set_update_hint (COGL_BUFFER (*buffer),
+                               COGL_BUFFER_UPDATE_HINT_STREAM);
+}
+
+/*
+ * _shell_recorder_readback_start:
+ * @readback: a #ShellRecorderReadback
+ * @area: the area of the stage to read
+ * @damage: the parts of @area which changed since the previous frame
+ * @pts: the timestamp to give to the frame
+ *
+ * Starts reading back a frame. With a converter, the damage is passed
+ * on to it, and the whole converted frame is read if anything changed.
+ * Frames which are ready are returned by
+ * _shell_recorder_readback_collect(), which should be called first to
+ * make room for the new frame.
+ *
+ * Return value: %FALSE if the frame can't be read asynchronously, and
+ *   should be captured with clutter_stage_capture() instead
+ */
+gboolean
+_shell_recorder_readback_start (ShellRecorderReadback       *readback,
+                                const cairo_rectangle_int_t *area,
+                                cairo_region_t              *damage,
+                                GstClockTime                 pts)
+{
+  ReadbackSlot *slot;
+  CoglPixelBuffer *target;
+  CoglFramebuffer *converted = NULL;
+  gsize size;
+  int stride;
+  guint i;
+
+  if (readback->n_pending == N_SLOTS)
+    return FALSE;
+
+  if (!get_parts (readback, damage))
+    return FALSE;
+
+  slot = &readback->slots[(readback->oldest + readback->n_pending) % N_SLOTS];
+  stride = area->width * 4;
+
+  if (readback->converter)
+    {
+      ensure_buffer (readback, &slot->staging, stride * area->height);
+      target = slot->staging;
+    }
+  else
+    {
+      ensure_buffer (readback, &slot->buffer, stride * area->height);
+      target = slot->buffer;
+    }
+
+  for (i = 0; i < readback->parts->len; i++)
+    {
+      ReadbackPart *part = &g_array_index (readback->parts, ReadbackPart, i);
+      CoglBitmap *bitmap;
+      int offset;
+
+      /* Each part is read into its place in the frame; since the bitmap
+       * is backed by a pixel buffer, glReadPixels() returns right away */
+      offset = ((part->rect.y - area->y) * stride +
+                (part->rect.x - area->x) * 4);
+      bitmap = cogl_bitmap_new_from_buffer (COGL_BUFFER (target),
+                                            CLUTTER_CAIRO_FORMAT_ARGB32,
+                                            part->rect.width,
+                                            part->rect.height,
+                                            stride,
+                                            offset);
+
+      cogl_framebuffer_read_pixels_into_bitmap (clutter_stage_view_get_framebuffer (part->view),
+                                                part->rect.x - part->layout.x,
+                                                part->rect.y - part->layout.y,
+                                                COGL_READ_PIXELS_COLOR_BUFFER,
+                                                bitmap);
+
+      /* Uploading from the pixel buffer stays on the GPU too */
+      if (readback->converter)
+        _shell_recorder_converter_update (readback->converter, bitmap,
+                                          part->rect.x - area->x,
+                                          part->rect.y - area->y);
+
+      cogl_object_unref (bitmap);
+    }
+
+  if (readback->converter)
+    converted = _shell_recorder_converter_render (readback->converter);
+
+  if (converted)
+    {
+      CoglBitmap *bitmap;
+      int width = cogl_framebuffer_get_width (converted);
+      int height = cogl_framebuffer_get_height (converted);
+
+      size = _shell_recorder_converter_get_size (readback->converter);
+      ensure_buffer (readback, &slot->buffer, size);
+
+      bitmap = cogl_bitmap_new_from_buffer (COGL_BUFFER (slot->buffer),
+                                            COGL_PIXEL_FORMAT_RGBA_8888_PRE,
+                                            width, height,
+                                            width * 4,
+                                            0);
+      cogl_framebuffer_read_pixels_into_bitmap (converted, 0, 0,
+                                                COGL_READ_PIXELS_COLOR_BUFFER,
+                                                bitmap);
+      cogl_object_unref (bitmap);
+    }
+
+  if (slot->damage)
+    cairo_region_destroy (slot->damage);
+  slot->damage = cairo_region_copy (damage);
+  slot->converted = converted != NULL;
+  slot->area = *area;
+  slot->pts = pts;
+  readback->n_pending++;
+
+  return TRUE;
+}
+
+/*
+ * _shell_recorder_readback_collect:
+ * @readback: a #ShellRecorderReadback
+ * @flush: whether to return frames which may not be ready yet
+ * @frame: the previous frame, as many bytes per row as the width of the
+ *   area times 4, or the converted frame when converting
+ * @changed: (out): whether @frame was changed
+ * @pts: (out): the timestamp of the frame
+ * @lost_damage: region to add the damage of the frame to if it
+ *   couldn't be mapped, so that it can be read again
+ *
+ * Patches the parts of the oldest frame which was read back into
+ * @frame. Unless @flush is set, a frame is only collected once all the
+ * slots are in use, so that mapping it won't wait for the GPU.
+ *
+ * Return value: %TRUE if a frame was collected
+ */
+gboolean
+_shell_recorder_readback_collect (ShellRecorderReadback       *readback,
+                                  gboolean                     flush,
+                                  guint8                      *frame,
+                                  gboolean                    *changed,
+                                  GstClockTime                *pts,
+                                  cairo_region_t              *lost_damage)
+{
+  ReadbackSlot *slot;
+  int stride;
+  guint8 *data;
+  int i, n_rects;
+
+  if (readback->n_pending == 0 ||
+      (!flush && readback->n_pending < N_SLOTS))
+    return FALSE;
+
+  slot = &readback->slots[readback->oldest];
+  readback->oldest = (readback->oldest + 1) % N_SLOTS;
+  readback->n_pending--;
+
+  *pts = slot->pts;
+  *changed = FALSE;
+
+  n_rects = cairo_region_num_rectangles (slot->damage);
+  if (n_rects == 0 && !slot->converted)
+    return TRUE;
+
+  data = cogl_buffer_map (COGL_BUFFER (slot->buffer),
+                          COGL_BUFFER_ACCESS_READ, 0);
+  if (data == NULL)
+    {
+      cairo_region_union (lost_damage, slot->damage);
+      return TRUE;
+    }
+
+  if (slot->converted)
+    {
+      memcpy (frame, data, cogl_buffer_get_size (COGL_BUFFER (slot->buffer)));
+      cogl_buffer_unmap (COGL_BUFFER (slot->buffer));
+      *changed = TRUE;
+
+      return TRUE;
+    }
+
+  stride = slot->area.width * 4;
+
+  for (i = 0; i < n_rects; i++)
+    {
+      cairo_rectangle_int_t rect;
+      int offset, y;
+
+      cairo_region_get_rectangle (slot->damage, i, &rect);
+      offset = (rect.y - slot->area.y) * stride + (rect.x - slot->area.x) * 4;
+
+      for (y = 0; y < rect.height; y++)
+        memcpy (frame + offset + y * stride,
+                data + offset + y * stride,
+                rect.width * 4);
+    }
+
+  cogl_buffer_unmap (COGL_BUFFER (slot->buffer));
+  *changed = TRUE;
+
+  return TRUE;
+}
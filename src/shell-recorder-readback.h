@@ -0,0 +1,41 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+#ifndef __SHELL_RECORDER_READBACK_H__
+#define __SHELL_RECORDER_READBACK_H__
+
+#include <clutter/clutter.h>
+#include <gst/gst.h>
+
+#include "shell-recorder-convert.h"
+
+G_BEGIN_DECLS
+
+/*
+ * ShellRecorderReadback:
+ *
+ * Reads frames of the stage back into pixel buffer objects. The GPU
+ * copies the pixels of a frame while the next frames are rendered, and
+ * they are only mapped once the copy is done, so recording doesn't
+ * stall the compositor on each frame. Only the parts of the frame
+ * which changed are read, and patched into the previous frame, or
+ * passed to a #ShellRecorderConverter.
+ */
+typedef struct _ShellRecorderReadback ShellRecorderReadback;
+
+ShellRecorderReadback *_shell_recorder_readback_new     (ClutterStage                *stage,
+                                                         ShellRecorderConverter      *converter);
+void                   _shell_recorder_readback_free    (ShellRecorderReadback       *readback);
+
+gboolean               _shell_recorder_readback_start   (ShellRecorderReadback       *readback,
+                                                         const cairo_rectangle_int_t *area,
+                                                         cairo_region_t              *damage,
+                                                         GstClockTime                 pts);
+gboolean               _shell_recorder_readback_collect (ShellRecorderReadback       *readback,
+                                                         gboolean                     flush,
+                                                         guint8                      *frame,
+                                                         gboolean                    *changed,
+                                                         GstClockTime                *pts,
+                                                         cairo_region_t              *lost_damage);
+
+G_END_DECLS
+
+#endif /* __SHELL_RECORDER_READBACK_H__ */
@@ -5,6 +5,7 @@
 #define GST_USE_UNSTABLE_API
 #include <gst/base/gstpushsrc.h>
 
+#include "shell-perf-log.h"
 #include "shell-recorder-src.h"
 
 struct _ShellRecorderSrc
@@ -16,12 +17,16 @@ struct _ShellRecorderSrc
   GstCaps *caps;
   GMutex queue_lock;
   GCond queue_cond;
-  GQueue *queue;
+  GQueue *queue; /* QueuedBuffer */
 
   gboolean eos;
   gboolean flushing;
   guint memory_used;
   guint memory_used_update_idle;
+
+  /* Recycles the buffers frames are captured into */
+  GstBufferPool *pool;
+  gsize pool_size;
 };
 
 struct _ShellRecorderSrcClass
@@ -29,6 +34,11 @@ struct _ShellRecorderSrcClass
   GstPushSrcClass parent_class;
 };
 
+typedef struct {
+  GstBuffer *buffer;
+  gint64 queued_time; /* Monotonic time, in microseconds */
+} QueuedBuffer;
+
 enum {
   PROP_0,
   PROP_CAPS,
@@ -38,6 +48,33 @@ enum {
 #define shell_recorder_src_parent_class parent_class
 G_DEFINE_TYPE(ShellRecorderSrc, shell_recorder_src, GST_TYPE_PUSH_SRC);
 
+static guint buffer_queued_event;
+static guint buffer_dequeued_event;
+
+/* Frames are aligned for SIMD code working on them */
+#define FRAME_ALIGNMENT 64
+
+/* Set on the buffers allocated by the pool once they were handed out */
+static GQuark pooled_quark;
+
+static guint64 pool_acquired;
+static guint64 pool_reused;
+static guint64 pool_allocated_bytes;
+
+/* How long the last frame and the slowest frame since the pipeline
+ * started waited for it, in microseconds; written from the streaming
+ * thread */
+G_LOCK_DEFINE_STATIC (queue_latency);
+static gint64 queue_latency;
+static gint64 queue_latency_max;
+
+static void
+queued_buffer_free (QueuedBuffer *queued)
+{
+  gst_buffer_unref (queued->buffer);
+  g_slice_free (QueuedBuffer, queued);
+}
+
 static void
 shell_recorder_src_init (ShellRecorderSrc      *src)
 {
@@ -131,6 +168,12 @@ shell_recorder_src_start (GstBaseSrc * base_src)
   g_cond_signal (&src->queue_cond);
   g_mutex_unlock (&src->queue_lock);
 
+  /* Don't report the latency of a previous recording */
+  G_LOCK (queue_latency);
+  queue_latency = 0;
+  queue_latency_max = 0;
+  G_UNLOCK (queue_latency);
+
   return TRUE;
 }
 
@@ -142,7 +185,7 @@ shell_recorder_src_stop (GstBaseSrc * base_src)
   g_mutex_lock (&src->queue_lock);
   src->flushing = TRUE;
   src->eos = FALSE;
-  g_queue_foreach (src->queue, (GFunc) gst_buffer_unref, NULL);
+  g_queue_foreach (src->queue, (GFunc) queued_buffer_free, NULL);
   g_queue_clear (src->queue);
   g_cond_signal (&src->queue_cond);
   g_mutex_unlock (&src->queue_lock);
@@ -178,7 +221,9 @@ shell_recorder_src_create (GstPushSrc  *push_src,
 			   GstBuffer  **buffer_out)
 {
   ShellRecorderSrc *src = SHELL_RECORDER_SRC (push_src);
+  QueuedBuffer *queued;
   GstBuffer *buffer;
+  gint64 latency;
 
   g_mutex_lock (&src->queue_lock);
   while (TRUE) {
@@ -188,10 +233,10 @@ shell_recorder_src_create (GstPushSrc  *push_src,
       return GST_FLOW_FLUSHING;
     }
 
-    buffer = g_queue_pop_head (src->queue);
+    queued = g_queue_pop_head (src->queue);
 
     /* we have a buffer, exit the loop to handle it */
-    if (buffer != NULL)
+    if (queued != NULL)
       break;
 
     /* no buffer, check EOS */
@@ -204,6 +249,20 @@ shell_recorder_src_create (GstPushSrc  *push_src,
   }
   g_mutex_unlock (&src->queue_lock);
 
+  buffer = queued->buffer;
+  latency = g_get_monotonic_time () - queued->queued_time;
+  g_slice_free (QueuedBuffer, queued);
+
+  G_LOCK (queue_latency);
+  queue_latency = latency;
+  queue_latency_max = MAX (queue_latency_max, latency);
+  G_UNLOCK (queue_latency);
+
+  /* Called in the streaming thread */
+  shell_perf_log_record_x (shell_perf_log_get_default (),
+                           buffer_dequeued_event,
+                           gst_buffer_get_size (buffer));
+
   shell_recorder_src_update_memory_used (src,
 					 - (int)(gst_buffer_get_size(buffer) / 1024));
 
@@ -236,6 +295,19 @@ shell_recorder_src_set_caps (ShellRecorderSrc *src,
     src->caps = NULL;
 }
 
+static void
+shell_recorder_src_clear_pool (ShellRecorderSrc *src)
+{
+  if (src->pool == NULL)
+    return;
+
+  /* Buffers still in use are freed when they are released */
+  gst_buffer_pool_set_active (src->pool, FALSE);
+  gst_object_unref (src->pool);
+  src->pool = NULL;
+  src->pool_size = 0;
+}
+
 static void
 shell_recorder_src_finalize (GObject *object)
 {
@@ -244,8 +316,10 @@ shell_recorder_src_finalize (GObject *object)
   if (src->memory_used_update_idle)
     g_source_remove (src->memory_used_update_idle);
 
+  shell_recorder_src_clear_pool (src);
+
   shell_recorder_src_set_caps (src, NULL);
-  g_queue_free_full (src->queue, (GDestroyNotify) gst_buffer_unref);
+  g_queue_free_full (src->queue, (GDestroyNotify) queued_buffer_free);
 
   g_mutex_clear (&src->mutex);
   g_mutex_clear (&src->queue_lock);
@@ -297,9 +371,39 @@ shell_recorder_src_get_property (GObject         *object,
     }
 }
 
+static void
+statistics_callback (ShellPerfLog *perf_log,
+                     gpointer      data)
+{
+  gint64 latency, latency_max;
+
+  shell_perf_log_update_statistic_x (perf_log,
+                                     "recorder.framePoolAcquired",
+                                     pool_acquired);
+  shell_perf_log_update_statistic_x (perf_log,
+                                     "recorder.framePoolReused",
+                                     pool_reused);
+  shell_perf_log_update_statistic_x (perf_log,
+                                     "recorder.framePoolAllocatedBytes",
+                                     pool_allocated_bytes);
+
+  G_LOCK (queue_latency);
+  latency = queue_latency;
+  latency_max = queue_latency_max;
+  G_UNLOCK (queue_latency);
+
+  shell_perf_log_update_statistic_x (perf_log,
+                                     "recorder.queueLatency",
+                                     latency);
+  shell_perf_log_update_statistic_x (perf_log,
+                                     "recorder.queueLatencyMax",
+                                     latency_max);
+}
+
 static void
 shell_recorder_src_class_init (ShellRecorderSrcClass *klass)
 {
+  ShellPerfLog *perf_log = shell_perf_log_get_default ();
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
   GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
   GstBaseSrcClass *base_src_class = GST_BASE_SRC_CLASS (klass);
@@ -347,6 +451,119 @@ shell_recorder_src_class_init (ShellRecorderSrcClass *klass)
   base_src_class->stop = shell_recorder_src_stop;
 
   push_src_class->create = shell_recorder_src_create;
+
+  buffer_queued_event =
+    shell_perf_log_define_event (perf_log,
+                                 "recorder.bufferQueued",
+                                 "Captured frame queued for encoding, with its size in bytes",
+                                 "x");
+  buffer_dequeued_event =
+    shell_perf_log_define_event (perf_log,
+                                 "recorder.bufferDequeued",
+                                 "Captured frame taken by the encoding pipeline, with its size in bytes",
+                                 "x");
+
+  pooled_quark = g_quark_from_static_string ("shell-recorder-src-pooled");
+
+  shell_perf_log_define_statistic (perf_log,
+                                   "recorder.framePoolAcquired",
+                                   "Number of frame buffers requested from the recorder pool",
+                                   "x");
+  shell_perf_log_define_statistic (perf_log,
+                                   "recorder.framePoolReused",
+                                   "Number of frame buffers recycled by the recorder pool",
+                                   "x");
+  shell_perf_log_define_statistic (perf_log,
+                                   "recorder.framePoolAllocatedBytes",
+                                   "Total size of the frame buffers allocated by the recorder pool, in bytes",
+                                   "x");
+  shell_perf_log_define_statistic (perf_log,
+                                   "recorder.queueLatency",
+                                   "Time the last recorded frame waited for the encoding pipeline, in microseconds",
+                                   "x");
+  shell_perf_log_define_statistic (perf_log,
+                                   "recorder.queueLatencyMax",
+                                   "Longest time a recorded frame waited for the encoding pipeline, in microseconds",
+                                   "x");
+
+  shell_perf_log_add_statistics_callback (perf_log,
+                                          statistics_callback,
+                                          NULL, NULL);
+}
+
+static void
+shell_recorder_src_ensure_pool (ShellRecorderSrc *src,
+                                gsize             size)
+{
+  GstStructure *config;
+  GstAllocationParams params;
+
+  if (src->pool != NULL && src->pool_size == size)
+    return;
+
+  shell_recorder_src_clear_pool (src);
+
+  src->pool = gst_buffer_pool_new ();
+  src->pool_size = size;
+
+  gst_allocation_params_init (&params);
+  params.align = FRAME_ALIGNMENT - 1;
+
+  /* There is no maximum, since there is no flow control either; the
+   * recorder stops capturing when the queue uses too much memory */
+  config = gst_buffer_pool_get_config (src->pool);
+  gst_buffer_pool_config_set_params (config, src->caps, size, 0, 0);
+  gst_buffer_pool_config_set_allocator (config, NULL, &params);
+
+  if (!gst_buffer_pool_set_config (src->pool, config) ||
+      !gst_buffer_pool_set_active (src->pool, TRUE))
+    {
+      g_warning ("Failed to set up the recorder frame pool");
+      shell_recorder_src_clear_pool (src);
+    }
+}
+
+/**
+ * shell_recorder_src_acquire_buffer:
+ * @src: a #ShellRecorderSrc
+ * @size: the size of a frame, in bytes
+ *
+ * Gets a buffer to capture a frame into. The buffers come from a pool,
+ * and go back to it once the pipeline is done with them, rather than
+ * allocating and freeing the memory for every frame. Changing @size
+ * drops the buffers of the previous size.
+ *
+ * Return value: (transfer full): a buffer of @size bytes, with undefined
+ *   contents
+ */
+GstBuffer *
+shell_recorder_src_acquire_buffer (ShellRecorderSrc *src,
+                                   gsize             size)
+{
+  GstBuffer *buffer = NULL;
+
+  g_return_val_if_fail (SHELL_IS_RECORDER_SRC (src), NULL);
+
+  shell_recorder_src_ensure_pool (src, size);
+
+  if (src->pool == NULL ||
+      gst_buffer_pool_acquire_buffer (src->pool, &buffer, NULL) != GST_FLOW_OK)
+    return gst_buffer_new_allocate (NULL, size, NULL);
+
+  pool_acquired++;
+
+  if (gst_mini_object_get_qdata (GST_MINI_OBJECT (buffer), pooled_quark))
+    {
+      pool_reused++;
+    }
+  else
+    {
+      gst_mini_object_set_qdata (GST_MINI_OBJECT (buffer), pooled_quark,
+                                 GINT_TO_POINTER (TRUE), NULL);
+      pool_allocated_bytes += size;
+    }
+
+  return buffer;
 }
 
 /**
@@ -361,18 +578,61 @@ void
 shell_recorder_src_add_buffer (ShellRecorderSrc *src,
 			       GstBuffer        *buffer)
 {
+  QueuedBuffer *queued;
+
   g_return_if_fail (SHELL_IS_RECORDER_SRC (src));
   g_return_if_fail (src->caps != NULL);
 
+  shell_perf_log_record_x (shell_perf_log_get_default (),
+                           buffer_queued_event,
+                           gst_buffer_get_size (buffer));
+
   shell_recorder_src_update_memory_used (src,
 					 (int)(gst_buffer_get_size(buffer) / 1024));
 
+  queued = g_slice_new (QueuedBuffer);
+  queued->buffer = gst_buffer_ref (buffer);
+  queued->queued_time = g_get_monotonic_time ();
+
   g_mutex_lock (&src->queue_lock);
-  g_queue_push_tail (src->queue, gst_buffer_ref (buffer));
+  g_queue_push_tail (src->queue, queued);
   g_cond_signal (&src->queue_cond);
   g_mutex_unlock (&src->queue_lock);
 }
 
+/**
+ * shell_recorder_src_get_queue_latency:
+ * @src: a #ShellRecorderSrc
+ * @n_buffers: (out) (allow-none): location to store the number of
+ *   buffers in the queue
+ *
+ * Finds out how far the pipeline is behind the buffers added to the
+ * source; when it can't encode them as quickly as they are added, the
+ * queue grows and the oldest buffer waits longer and longer.
+ *
+ * Return value: the time the oldest buffer in the queue has been
+ *   waiting, in microseconds, or 0 if the queue is empty
+ */
+gint64
+shell_recorder_src_get_queue_latency (ShellRecorderSrc *src,
+                                      guint            *n_buffers)
+{
+  QueuedBuffer *oldest;
+  gint64 latency = 0;
+
+  g_return_val_if_fail (SHELL_IS_RECORDER_SRC (src), 0);
+
+  g_mutex_lock (&src->queue_lock);
+  oldest = g_queue_peek_head (src->queue);
+  if (oldest != NULL)
+    latency = g_get_monotonic_time () - oldest->queued_time;
+  if (n_buffers)
+    *n_buffers = g_queue_get_length (src->queue);
+  g_mutex_unlock (&src->queue_lock);
+
+  return latency;
+}
+
 /**
  * shell_recorder_src_close:
  *
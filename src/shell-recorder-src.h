@@ -31,8 +31,13 @@ GType              shell_recorder_src_get_type     (void) G_GNUC_CONST;
 
 void shell_recorder_src_register (void);
 
+GstBuffer *shell_recorder_src_acquire_buffer (ShellRecorderSrc *src,
+                                              gsize             size);
+
 void shell_recorder_src_add_buffer (ShellRecorderSrc *src,
 				    GstBuffer        *buffer);
+gint64 shell_recorder_src_get_queue_latency (ShellRecorderSrc *src,
+                                             guint            *n_buffers);
 void shell_recorder_src_close      (ShellRecorderSrc *src);
 
 G_END_DECLS
@@ -19,7 +19,11 @@
 #include <meta/meta-cursor-tracker.h>
 #include <meta/compositor-mutter.h>
 
+#include "shell-enum-types.h"
 #include "shell-global.h"
+#include "shell-perf-log.h"
+#include "shell-recorder-convert.h"
+#include "shell-recorder-readback.h"
 #include "shell-recorder-src.h"
 #include "shell-recorder.h"
 #include "shell-util.h"
@@ -60,12 +64,16 @@ struct _ShellRecorder {
   GSettings *a11y_settings;
   gboolean draw_cursor;
   MetaCursorTracker *cursor_tracker;
-  cairo_surface_t *cursor_image;
-  guint8 *cursor_memory;
+  guint32 *cursor_memory; /* Premultiplied ARGB, native-endian */
+  int cursor_width;
+  int cursor_height;
   int cursor_hot_x;
   int cursor_hot_y;
 
   int framerate;
+  ShellRecorderFormat video_format;
+  int video_width;
+  int video_height;
   char *pipeline_description;
   char *file_template;
 
@@ -76,13 +84,32 @@ struct _ShellRecorder {
   GSList *pipelines; /* all pipelines */
 
   GstClockTime last_frame_time; /* Timestamp for the last frame */
+  GstClockTime last_drop_time; /* Timestamp for the last frame dropped to catch up */
+  GstClockTime frame_interval; /* Adapted to how quickly the pipeline encodes */
+
+  /* Frames being read back from the GPU while recording, and
+   * converted to YUV first if the video format asks for it */
+  ShellRecorderReadback *readback;
+  ShellRecorderConverter *converter;
+
+  /* The last frame read from the stage, without the cursor unless it
+   * was converted, and the parts of the stage redrawn since */
+  guint8 *frame;
+  gsize frame_size;
+  int output_width;
+  int output_height;
+  cairo_region_t *damage;
+
+  GstBuffer *last_buffer; /* The last frame pushed, repeated if nothing changes */
+  gboolean cursor_drawn; /* Whether the cursor was drawn on it */
+  gboolean cursor_dirty; /* Whether the cursor changed or moved since */
 
   /* GSource IDs for different timeouts and idles */
   guint redraw_timeout;
   guint redraw_idle;
+  guint frame_timeout; /* Records the damage once the next frame is due */
   guint update_memory_used_timeout;
   guint update_pointer_timeout;
-  guint repaint_hook_id;
 };
 
 struct _RecorderPipeline
@@ -92,6 +119,12 @@ struct _RecorderPipeline
   GstElement *src;
   int outfile;
   char *filename;
+
+  /* Made faster when dropping frames isn't enough to keep up */
+  GstElement *encoder;
+  int encoder_base_speed;
+  int encoder_speed;
+  gint64 encoder_speed_time;
 };
 
 static void recorder_set_stage    (ShellRecorder *recorder,
@@ -109,6 +142,10 @@ static void recorder_pipeline_set_caps (RecorderPipeline *pipeline);
 static void recorder_pipeline_closed   (RecorderPipeline *pipeline);
 
 static void recorder_remove_redraw_timeout (ShellRecorder *recorder);
+static void recorder_remove_frame_timeout (ShellRecorder *recorder);
+static void recorder_queue_redraw (ShellRecorder *recorder);
+static void recorder_refresh (ShellRecorder *recorder);
+static void recorder_clear_frame (ShellRecorder *recorder);
 
 enum {
   PROP_0,
@@ -117,7 +154,10 @@ enum {
   PROP_FRAMERATE,
   PROP_PIPELINE,
   PROP_FILE_TEMPLATE,
-  PROP_DRAW_CURSOR
+  PROP_DRAW_CURSOR,
+  PROP_VIDEO_FORMAT,
+  PROP_VIDEO_WIDTH,
+  PROP_VIDEO_HEIGHT
 };
 
 G_DEFINE_TYPE(ShellRecorder, shell_recorder, G_TYPE_OBJECT);
@@ -146,6 +186,27 @@ G_DEFINE_TYPE(ShellRecorder, shell_recorder, G_TYPE_OBJECT);
  */
 #define MAXIMUM_PAUSE_TIME 1000
 
+/* Above this many damaged rectangles, the whole extents of the damage
+ * are read at once */
+#define MAX_DAMAGE_RECTANGLES 16
+
+/* When frames wait longer than this for the pipeline (in microseconds),
+ * it can't keep up, and we capture less often, down to
+ * MIN_FRAMES_PER_SECOND; once the queue drains, we go back to the
+ * target frame rate.
+ */
+#define TARGET_QUEUE_LATENCY 500000
+#define MIN_FRAMES_PER_SECOND 5
+
+/* Minimum time between changes to the speed of the encoder, in
+ * milliseconds, so that it has time to catch up with the last one.
+ */
+#define ENCODER_SPEED_DELAY 2000
+
+static guint64 frames_recorded;
+static guint64 frames_dropped;
+static gint64 current_frame_interval;
+
 /* The default pipeline.
  */
 #define DEFAULT_PIPELINE "vp9enc min_quantizer=13 max_quantizer=13 cpu-used=5 deadline=1000000 threads=%T ! queue ! webmmux"
@@ -186,22 +247,6 @@ get_memory_target (void)
   return DEFAULT_MEMORY_TARGET;
 }
 
-/*
- * Used to force full stage redraws during recording to avoid artifacts
- *
- * Note: That this will cause the stage to be repainted on
- * every animation frame even if the frame wouldn't normally cause any new
- * drawing
- */
-static gboolean
-recorder_repaint_hook (gpointer data)
-{
-  ClutterActor *stage = data;
-  clutter_actor_queue_redraw (stage);
-
-  return TRUE;
-}
-
 static void
 shell_recorder_init (ShellRecorder *recorder)
 {
@@ -219,6 +264,7 @@ shell_recorder_init (ShellRecorder *recorder)
   recorder->state = RECORDER_STATE_CLOSED;
   recorder->framerate = DEFAULT_FRAMES_PER_SECOND;
   recorder->draw_cursor = TRUE;
+  recorder->damage = cairo_region_create ();
 }
 
 static void
@@ -229,16 +275,17 @@ shell_recorder_finalize (GObject  *object)
   if (recorder->update_memory_used_timeout)
     g_source_remove (recorder->update_memory_used_timeout);
 
-  if (recorder->cursor_image)
-    cairo_surface_destroy (recorder->cursor_image);
-  if (recorder->cursor_memory)
-    g_free (recorder->cursor_memory);
+  g_free (recorder->cursor_memory);
 
   recorder_set_stage (recorder, NULL);
   recorder_set_pipeline (recorder, NULL);
   recorder_set_file_template (recorder, NULL);
 
   recorder_remove_redraw_timeout (recorder);
+  recorder_remove_frame_timeout (recorder);
+
+  recorder_clear_frame (recorder);
+  g_clear_pointer (&recorder->damage, cairo_region_destroy);
 
   g_clear_object (&recorder->a11y_settings);
 
@@ -286,7 +333,7 @@ recorder_redraw_timeout (gpointer data)
   ShellRecorder *recorder = data;
 
   recorder->redraw_timeout = 0;
-  clutter_actor_queue_redraw (CLUTTER_ACTOR (recorder->stage));
+  recorder_refresh (recorder);
 
   return FALSE;
 }
@@ -313,13 +360,48 @@ recorder_remove_redraw_timeout (ShellRecorder *recorder)
     }
 }
 
+/* Timeout used to record the changes made while frames were being
+ * dropped, once the next frame is due
+ */
+static gboolean
+recorder_frame_timeout (gpointer data)
+{
+  ShellRecorder *recorder = data;
+
+  recorder->frame_timeout = 0;
+  recorder_refresh (recorder);
+
+  return FALSE;
+}
+
+static void
+recorder_add_frame_timeout (ShellRecorder *recorder,
+                            GstClockTime   delay)
+{
+  if (recorder->frame_timeout == 0)
+    {
+      recorder->frame_timeout = g_timeout_add ((delay + GST_MSECOND - 1) / GST_MSECOND,
+                                               recorder_frame_timeout,
+                                               recorder);
+      g_source_set_name_by_id (recorder->frame_timeout, "[gnome-shell] recorder_frame_timeout");
+    }
+}
+
+static void
+recorder_remove_frame_timeout (ShellRecorder *recorder)
+{
+  if (recorder->frame_timeout != 0)
+    {
+      g_source_remove (recorder->frame_timeout);
+      recorder->frame_timeout = 0;
+    }
+}
+
 static void
 recorder_fetch_cursor_image (ShellRecorder *recorder)
 {
   CoglTexture *texture;
   int width, height;
-  int stride;
-  guint8 *data;
 
   texture = meta_cursor_tracker_get_sprite (recorder->cursor_tracker);
   if (!texture)
@@ -327,16 +409,36 @@ recorder_fetch_cursor_image (ShellRecorder *recorder)
 
   width = cogl_texture_get_width (texture);
   height = cogl_texture_get_height (texture);
-  stride = 4 * width;
-  data = g_new (guint8, stride * height);
-  cogl_texture_get_data (texture, CLUTTER_CAIRO_FORMAT_ARGB32, stride, data);
 
-  /* FIXME: cairo-gl? */
-  recorder->cursor_image = cairo_image_surface_create_for_data (data,
-                                                                CAIRO_FORMAT_ARGB32,
-                                                                width, height,
-                                                                stride);
-  recorder->cursor_memory = data;
+  recorder->cursor_memory = g_new (guint32, width * height);
+  recorder->cursor_width = width;
+  recorder->cursor_height = height;
+  cogl_texture_get_data (texture, CLUTTER_CAIRO_FORMAT_ARGB32, width * 4,
+                         (guint8 *) recorder->cursor_memory);
+
+  meta_cursor_tracker_get_hot (recorder->cursor_tracker,
+                               &recorder->cursor_hot_x,
+                               &recorder->cursor_hot_y);
+}
+
+/* Composites a premultiplied pixel over another. The red and blue
+ * channels, and the alpha and green channels, are scaled two at a
+ * time, each in 16 bits of a 32-bit word.
+ */
+static inline guint32
+blend_over (guint32 src,
+            guint32 dest)
+{
+  guint32 ia = 255 - (src >> 24);
+  guint32 rb, ag;
+
+  rb = (dest & 0x00ff00ff) * ia + 0x00800080;
+  rb = ((rb + ((rb >> 8) & 0x00ff00ff)) >> 8) & 0x00ff00ff;
+
+  ag = ((dest >> 8) & 0x00ff00ff) * ia + 0x00800080;
+  ag = (ag + ((ag >> 8) & 0x00ff00ff)) & 0xff00ff00;
+
+  return src + rb + ag;
 }
 
 /* Overlay the cursor image on the frame. We draw the cursor image
@@ -344,14 +446,15 @@ recorder_fetch_cursor_image (ShellRecorder *recorder)
  * alternate approach would be to turn off the cursor while recording
  * and draw the cursor ourselves with GL, but then we'd need to figure
  * out what the cursor looks like, or hard-code a non-system cursor.
+ * (The GPU conversion does draw it with GL.)
  */
 static void
 recorder_draw_cursor (ShellRecorder *recorder,
-                      GstBuffer     *buffer)
+                      guint8        *data)
 {
-  GstMapInfo info;
-  cairo_surface_t *surface;
-  cairo_t *cr;
+  int cursor_x, cursor_y;
+  int x0, y0, x1, y1;
+  int x, y;
 
   /* We don't show a cursor unless the hot spot is in the frame; this
    * means that sometimes we aren't going to draw a cursor even when
@@ -362,29 +465,389 @@ recorder_draw_cursor (ShellRecorder *recorder,
       recorder->pointer_y >= recorder->area.y + recorder->area.height)
     return;
 
-  if (!recorder->cursor_image)
+  if (!recorder->cursor_memory)
     recorder_fetch_cursor_image (recorder);
 
-  if (!recorder->cursor_image)
+  if (!recorder->cursor_memory)
+    return;
+
+  cursor_x = recorder->pointer_x - recorder->cursor_hot_x - recorder->area.x;
+  cursor_y = recorder->pointer_y - recorder->cursor_hot_y - recorder->area.y;
+
+  /* The part of the cursor within the frame, in cursor coordinates */
+  x0 = MAX (0, - cursor_x);
+  y0 = MAX (0, - cursor_y);
+  x1 = MIN (recorder->cursor_width, recorder->area.width - cursor_x);
+  y1 = MIN (recorder->cursor_height, recorder->area.height - cursor_y);
+
+  for (y = y0; y < y1; y++)
+    {
+      const guint32 *src = recorder->cursor_memory + y * recorder->cursor_width;
+      guint32 *dest = (guint32 *) (data + (cursor_y + y) * recorder->area.width * 4) + cursor_x;
+
+      for (x = x0; x < x1; x++)
+        {
+          guint32 pixel = src[x];
+
+          /* Most of a cursor image is either transparent or opaque */
+          if (pixel >= 0xff000000)
+            dest[x] = pixel;
+          else if (pixel != 0)
+            dest[x] = blend_over (pixel, dest[x]);
+        }
+    }
+}
+
+/* Feed the current frame into the pipeline, with the cursor drawn on
+ * top; if nothing changed since the previous frame, it is sent again,
+ * sharing its memory.
+ */
+static void
+recorder_push_frame (ShellRecorder *recorder,
+                     gboolean       changed,
+                     GstClockTime   pts)
+{
+  GstBuffer *buffer;
+  gboolean draw_cursor;
+
+  /* The converter draws the cursor itself */
+  draw_cursor = (recorder->converter == NULL &&
+                 recorder->draw_cursor &&
+                 !g_settings_get_boolean (recorder->a11y_settings, MAGNIFIER_ACTIVE_KEY));
+
+  if (!changed && recorder->last_buffer &&
+      draw_cursor == recorder->cursor_drawn &&
+      !(draw_cursor && recorder->cursor_dirty))
+    {
+      buffer = gst_buffer_copy (recorder->last_buffer);
+    }
+  else
+    {
+      GstMapInfo info;
+
+      buffer = shell_recorder_src_acquire_buffer (SHELL_RECORDER_SRC (recorder->current_pipeline->src),
+                                                  recorder->frame_size);
+
+      gst_buffer_map (buffer, &info, GST_MAP_WRITE);
+      memcpy (info.data, recorder->frame, recorder->frame_size);
+
+      if (draw_cursor)
+        recorder_draw_cursor (recorder, info.data);
+
+      gst_buffer_unmap (buffer, &info);
+
+      recorder->cursor_drawn = draw_cursor;
+      recorder->cursor_dirty = FALSE;
+    }
+
+  GST_BUFFER_PTS(buffer) = pts;
+  gst_buffer_replace (&recorder->last_buffer, buffer);
+
+  shell_recorder_src_add_buffer (SHELL_RECORDER_SRC (recorder->current_pipeline->src), buffer);
+  gst_buffer_unref (buffer);
+}
+
+/* Push the frames which were read back asynchronously; unless @flush
+ * is set, only those the GPU is done with.
+ */
+static void
+recorder_collect_frames (ShellRecorder *recorder,
+                         gboolean       flush)
+{
+  gboolean changed;
+  GstClockTime pts;
+
+  if (recorder->readback == NULL || recorder->frame == NULL)
+    return;
+
+  while (_shell_recorder_readback_collect (recorder->readback, flush,
+                                           recorder->frame, &changed, &pts,
+                                           recorder->damage))
+    recorder_push_frame (recorder, changed, pts);
+}
+
+static void
+recorder_clear_frame (ShellRecorder *recorder)
+{
+  g_clear_pointer (&recorder->frame, g_free);
+  gst_buffer_replace (&recorder->last_buffer, NULL);
+
+  /* The readback uses the converter */
+  g_clear_pointer (&recorder->readback, _shell_recorder_readback_free);
+  g_clear_pointer (&recorder->converter, _shell_recorder_converter_free);
+}
+
+/* Computes the size of the converted video; the width has to be a
+ * multiple of 8 and the height a multiple of 4, see
+ * shell-recorder-convert.c.
+ */
+static void
+recorder_get_video_size (ShellRecorder *recorder,
+                         int           *width,
+                         int           *height)
+{
+  int area_width = MAX (recorder->area.width, 1);
+  int area_height = MAX (recorder->area.height, 1);
+  int video_width = recorder->video_width;
+  int video_height = recorder->video_height;
+
+  if (video_width <= 0 && video_height <= 0)
+    {
+      video_width = area_width;
+      video_height = area_height;
+    }
+  else if (video_width <= 0)
+    {
+      video_width = area_width * video_height / area_height;
+    }
+  else if (video_height <= 0)
+    {
+      video_height = area_height * video_width / area_width;
+    }
+
+  *width = MAX (video_width & ~7, 8);
+  *height = MAX (video_height & ~3, 4);
+}
+
+/* Forget the previous frame, when starting to record or after the
+ * recorded area changed; the next frame is then read entirely. This
+ * also sets up the conversion for the current video format.
+ */
+static void
+recorder_reset_frame (ShellRecorder *recorder)
+{
+  recorder_clear_frame (recorder);
+
+  cairo_region_destroy (recorder->damage);
+  recorder->damage = cairo_region_create_rectangle (&recorder->area);
+
+  if (recorder->video_format != SHELL_RECORDER_FORMAT_RGB)
+    {
+      recorder_get_video_size (recorder,
+                               &recorder->output_width,
+                               &recorder->output_height);
+      recorder->converter = _shell_recorder_converter_new (recorder->video_format,
+                                                           recorder->area.width,
+                                                           recorder->area.height,
+                                                           recorder->output_width,
+                                                           recorder->output_height);
+    }
+
+  if (recorder->converter)
+    {
+      recorder->frame_size = _shell_recorder_converter_get_size (recorder->converter);
+    }
+  else
+    {
+      recorder->output_width = recorder->area.width;
+      recorder->output_height = recorder->area.height;
+      recorder->frame_size = recorder->area.width * 4 * recorder->area.height;
+    }
+
+  recorder->readback = _shell_recorder_readback_new (recorder->stage,
+                                                     recorder->converter);
+}
+
+/* Capture the damaged parts of the stage synchronously, and patch them
+ * into the current frame, or convert it again.
+ */
+static gboolean
+recorder_capture_damage (ShellRecorder *recorder,
+                         gboolean       paint)
+{
+  int stride = recorder->area.width * 4;
+  gboolean changed = FALSE;
+  int i, n_rects;
+
+  n_rects = cairo_region_num_rectangles (recorder->damage);
+  for (i = 0; i < n_rects; i++)
+    {
+      cairo_rectangle_int_t rect;
+      ClutterCapture *captures;
+      int n_captures;
+      cairo_surface_t *image;
+      int j;
+
+      cairo_region_get_rectangle (recorder->damage, i, &rect);
+
+      clutter_stage_capture (recorder->stage, paint, &rect,
+                             &captures, &n_captures);
+
+      if (n_captures == 0)
+        continue;
+
+      if (recorder->converter)
+        {
+          CoglContext *ctx =
+            clutter_backend_get_cogl_context (clutter_get_default_backend ());
+          CoglBitmap *bitmap;
+
+          if (n_captures == 1 &&
+              cairo_image_surface_get_width (captures[0].image) == rect.width)
+            image = cairo_surface_reference (captures[0].image);
+          else
+            image = shell_util_composite_capture_images (captures,
+                                                         n_captures,
+                                                         rect.x,
+                                                         rect.y,
+                                                         rect.width,
+                                                         rect.height);
+
+          bitmap = cogl_bitmap_new_for_data (ctx, rect.width, rect.height,
+                                             CLUTTER_CAIRO_FORMAT_ARGB32,
+                                             cairo_image_surface_get_stride (image),
+                                             cairo_image_surface_get_data (image));
+          _shell_recorder_converter_update (recorder->converter, bitmap,
+                                            rect.x - recorder->area.x,
+                                            rect.y - recorder->area.y);
+          cogl_object_unref (bitmap);
+          cairo_surface_destroy (image);
+        }
+      else
+        {
+          /* Composite straight into the frame */
+          image = cairo_image_surface_create_for_data (recorder->frame +
+                                                       (rect.y - recorder->area.y) * stride +
+                                                       (rect.x - recorder->area.x) * 4,
+                                                       CAIRO_FORMAT_ARGB32,
+                                                       rect.width, rect.height,
+                                                       stride);
+          shell_util_composite_capture_images_into (captures,
+                                                    n_captures,
+                                                    rect.x,
+                                                    rect.y,
+                                                    image);
+          cairo_surface_destroy (image);
+
+          changed = TRUE;
+        }
+
+      for (j = 0; j < n_captures; j++)
+        cairo_surface_destroy (captures[j].image);
+      g_free (captures);
+    }
+
+  if (recorder->converter)
+    changed = _shell_recorder_converter_read (recorder->converter, recorder->frame);
+
+  return changed;
+}
+
+/* Pass the cursor to the converter, which draws it on the GPU
+ */
+static void
+recorder_update_converter_cursor (ShellRecorder *recorder)
+{
+  CoglTexture *sprite = NULL;
+  int hot_x, hot_y;
+
+  if (recorder->draw_cursor &&
+      !g_settings_get_boolean (recorder->a11y_settings, MAGNIFIER_ACTIVE_KEY))
+    sprite = meta_cursor_tracker_get_sprite (recorder->cursor_tracker);
+
+  if (sprite == NULL)
+    {
+      _shell_recorder_converter_set_cursor (recorder->converter, NULL, 0, 0);
+      return;
+    }
+
+  meta_cursor_tracker_get_hot (recorder->cursor_tracker, &hot_x, &hot_y);
+  _shell_recorder_converter_set_cursor (recorder->converter, sprite,
+                                        recorder->pointer_x - hot_x - recorder->area.x,
+                                        recorder->pointer_y - hot_y - recorder->area.y);
+}
+
+static gboolean
+frame_due (GstClockTime last_time,
+           GstClockTime now,
+           GstClockTime interval)
+{
+  return !GST_CLOCK_TIME_IS_VALID (last_time) || now - last_time >= (interval * 3) / 4;
+}
+
+/* Counts a frame which the target frame rate had room for, but which
+ * isn't recorded since the pipeline is behind
+ */
+static void
+recorder_drop_frame (ShellRecorder *recorder,
+                     GstClockTime   now)
+{
+  GstClockTime target_interval;
+
+  target_interval = gst_util_uint64_scale_int (GST_SECOND, 1, recorder->framerate);
+  if (!frame_due (recorder->last_drop_time, now, target_interval))
+    return;
+
+  recorder->last_drop_time = now;
+  frames_dropped++;
+}
+
+/* Changes the speed of encoders with a "cpu-used" property, like vp8enc
+ * and vp9enc, by @delta; faster encoding costs quality, so it never
+ * gets slower than in the pipeline description, and goes back there
+ * once the pipeline keeps up again.
+ */
+static void
+recorder_pipeline_adjust_encoder_speed (RecorderPipeline *pipeline,
+                                        int               delta)
+{
+  GParamSpec *pspec;
+  gint64 now;
+  int speed;
+
+  /* A negative speed doesn't mean a slower encoder for all of them */
+  if (pipeline->encoder == NULL || pipeline->encoder_base_speed < 0)
     return;
 
-  gst_buffer_map (buffer, &info, GST_MAP_WRITE);
-  surface = cairo_image_surface_create_for_data (info.data,
-                                                 CAIRO_FORMAT_ARGB32,
-                                                 recorder->area.width,
-                                                 recorder->area.height,
-                                                 recorder->area.width * 4);
+  now = g_get_monotonic_time ();
+  if (now - pipeline->encoder_speed_time < ENCODER_SPEED_DELAY * 1000)
+    return;
 
-  cr = cairo_create (surface);
-  cairo_set_source_surface (cr,
-                            recorder->cursor_image,
-                            recorder->pointer_x - recorder->cursor_hot_x - recorder->area.x,
-                            recorder->pointer_y - recorder->cursor_hot_y - recorder->area.y);
-  cairo_paint (cr);
+  pspec = g_object_class_find_property (G_OBJECT_GET_CLASS (pipeline->encoder), "cpu-used");
+  speed = CLAMP (pipeline->encoder_speed + delta,
+                 pipeline->encoder_base_speed,
+                 G_PARAM_SPEC_INT (pspec)->maximum);
+  if (speed == pipeline->encoder_speed)
+    return;
 
-  cairo_destroy (cr);
-  cairo_surface_destroy (surface);
-  gst_buffer_unmap (buffer, &info);
+  g_object_set (pipeline->encoder, "cpu-used", speed, NULL);
+  pipeline->encoder_speed = speed;
+  pipeline->encoder_speed_time = now;
+}
+
+/* Adapts the interval between frames to how quickly the pipeline
+ * encodes them, judging by how long the frames wait for it. This is
+ * done before the queue takes up so much memory that we have to stop
+ * recording altogether, so long recordings on slow machines just get
+ * choppier. If the pipeline is still behind at the lowest frame rate,
+ * the encoder is made faster.
+ */
+static void
+recorder_update_pacing (ShellRecorder *recorder)
+{
+  RecorderPipeline *pipeline = recorder->current_pipeline;
+  GstClockTime target_interval, max_interval;
+  gint64 latency;
+
+  target_interval = gst_util_uint64_scale_int (GST_SECOND, 1, recorder->framerate);
+  max_interval = MAX (target_interval, GST_SECOND / MIN_FRAMES_PER_SECOND);
+
+  latency = shell_recorder_src_get_queue_latency (SHELL_RECORDER_SRC (pipeline->src), NULL);
+
+  /* Back off quickly, recover slowly */
+  if (latency > TARGET_QUEUE_LATENCY)
+    recorder->frame_interval = MIN (recorder->frame_interval + recorder->frame_interval / 4,
+                                    max_interval);
+  else if (latency < TARGET_QUEUE_LATENCY / 4)
+    recorder->frame_interval = MAX (recorder->frame_interval - target_interval / 8,
+                                    target_interval);
+
+  if (recorder->frame_interval >= max_interval && latency > 2 * TARGET_QUEUE_LATENCY)
+    recorder_pipeline_adjust_encoder_speed (pipeline, 1);
+  else if (recorder->frame_interval <= target_interval && latency < TARGET_QUEUE_LATENCY / 4)
+    recorder_pipeline_adjust_encoder_speed (pipeline, -1);
+
+  current_frame_interval = recorder->frame_interval / GST_USECOND;
 }
 
 /* Retrieve a frame and feed it into the pipeline
@@ -393,29 +856,19 @@ static void
 recorder_record_frame (ShellRecorder *recorder,
                        gboolean       paint)
 {
-  GstBuffer *buffer;
-  ClutterCapture *captures;
-  int n_captures;
-  cairo_surface_t *image;
-  guint size;
-  uint8_t *data;
-  GstMemory *memory;
-  int i;
   GstClock *clock;
-  GstClockTime now, base_time;
+  GstClockTime now, base_time, target_interval;
+  gboolean changed;
 
   g_return_if_fail (recorder->current_pipeline != NULL);
 
-  /* If we get into the red zone, stop buffering new frames; 13/16 is
-  * a bit more than the 3/4 threshold for a red indicator to keep the
-  * indicator from flashing between red and yellow. */
-  if (recorder->memory_used > (recorder->memory_target * 13) / 16)
-    return;
+  recorder_collect_frames (recorder, FALSE);
 
   /* Drop frames to get down to something like the target frame rate; since frames
    * are generated with VBlank sync, we don't have full control anyways, so we just
    * drop frames if the interval since the last frame is less than 75% of the
-   * desired inter-frame interval.
+   * desired inter-frame interval. That interval grows when the pipeline falls
+   * behind, see recorder_update_pacing().
    */
   clock = gst_element_get_clock (recorder->current_pipeline->src);
 
@@ -427,64 +880,122 @@ recorder_record_frame (ShellRecorder *recorder,
   now = gst_clock_get_time (clock) - base_time;
   gst_object_unref (clock);
 
-  if (GST_CLOCK_TIME_IS_VALID (recorder->last_frame_time) &&
-      now - recorder->last_frame_time < gst_util_uint64_scale_int (GST_SECOND, 3, 4 * recorder->framerate))
-    return;
+  target_interval = gst_util_uint64_scale_int (GST_SECOND, 1, recorder->framerate);
+
+  if (!frame_due (recorder->last_frame_time, now, recorder->frame_interval))
+    {
+      if (frame_due (recorder->last_frame_time, now, target_interval))
+        recorder_drop_frame (recorder, now);
+
+      /* Make sure the changes end up in a later frame; the damage keeps
+       * accumulating until then. Queuing a redraw from here would
+       * repaint the stage on every vblank until the frame is due. */
+      if (!cairo_region_is_empty (recorder->damage))
+        recorder_add_frame_timeout (recorder,
+                                    recorder->last_frame_time + recorder->frame_interval - now);
+      return;
+    }
+
+  /* If we get into the red zone, stop buffering new frames; 13/16 is
+  * a bit more than the 3/4 threshold for a red indicator to keep the
+  * indicator from flashing between red and yellow. */
+  if (recorder->memory_used > (recorder->memory_target * 13) / 16)
+    {
+      recorder_drop_frame (recorder, now);
+      return;
+    }
+
   recorder->last_frame_time = now;
+  frames_recorded++;
 
-  clutter_stage_capture (recorder->stage, paint, &recorder->area,
-                         &captures, &n_captures);
+  recorder_remove_frame_timeout (recorder);
 
-  if (n_captures == 0)
-    return;
+  recorder_update_pacing (recorder);
 
-  if (n_captures == 1)
-    image = cairo_surface_reference (captures[0].image);
-  else
-    image = shell_util_composite_capture_images (captures,
-                                                 n_captures,
-                                                 recorder->area.x,
-                                                 recorder->area.y,
-                                                 recorder->area.width,
-                                                 recorder->area.height);
+  if (recorder->frame == NULL)
+    recorder->frame = g_malloc0 (recorder->frame_size);
 
-  data = cairo_image_surface_get_data (image);
-  size = (cairo_image_surface_get_height (image) *
-          cairo_image_surface_get_stride (image));
+  if (recorder->converter)
+    recorder_update_converter_cursor (recorder);
 
-  for (i = 0; i < n_captures; i++)
-    cairo_surface_destroy (captures[i].image);
-  g_free (captures);
+  /* The damage of dropped frames is carried over to this one; since
+   * Clutter keeps the whole back buffer up to date, it can still be
+   * read from there. Many small rectangles aren't worth reading one
+   * by one. */
+  cairo_region_intersect_rectangle (recorder->damage, &recorder->area);
+  if (cairo_region_num_rectangles (recorder->damage) > MAX_DAMAGE_RECTANGLES)
+    {
+      cairo_rectangle_int_t extents;
 
-  buffer = gst_buffer_new();
-  memory = gst_memory_new_wrapped (0, data, size, 0, size,
-                                   image,
-                                   (GDestroyNotify) cairo_surface_destroy);
-  gst_buffer_insert_memory (buffer, -1, memory);
+      cairo_region_get_extents (recorder->damage, &extents);
+      cairo_region_destroy (recorder->damage);
+      recorder->damage = cairo_region_create_rectangle (&extents);
+    }
 
-  GST_BUFFER_PTS(buffer) = now;
+  /* Right after the stage was painted, the frame can be read into a
+   * pixel buffer without waiting for the GPU; it gets pushed a couple
+   * of frames later, once the copy is done. */
+  if (!paint && recorder->readback &&
+      _shell_recorder_readback_start (recorder->readback, &recorder->area,
+                                      recorder->damage, now))
+    goto out;
 
-  if (recorder->draw_cursor &&
-      !g_settings_get_boolean (recorder->a11y_settings, MAGNIFIER_ACTIVE_KEY))
-    recorder_draw_cursor (recorder, buffer);
+  /* Keep the frames in order */
+  recorder_collect_frames (recorder, TRUE);
 
-  shell_recorder_src_add_buffer (SHELL_RECORDER_SRC (recorder->current_pipeline->src), buffer);
-  gst_buffer_unref (buffer);
+  changed = recorder_capture_damage (recorder, paint);
+  recorder_push_frame (recorder, changed, now);
+
+ out:
+  cairo_region_destroy (recorder->damage);
+  recorder->damage = cairo_region_create ();
 
   /* Reset the timeout that we used to avoid an overlong pause in the stream */
   recorder_remove_redraw_timeout (recorder);
   recorder_add_redraw_timeout (recorder);
 }
 
+/* Record a frame when only the cursor moved, or to avoid a long pause
+ * in the stream. Since the stage can only be read right after it was
+ * painted, a redraw of the parts which changed is queued instead if
+ * there are any.
+ */
+static void
+recorder_refresh (ShellRecorder *recorder)
+{
+  cairo_rectangle_int_t extents;
+
+  if (recorder->state != RECORDER_STATE_RECORDING)
+    return;
+
+  cairo_region_intersect_rectangle (recorder->damage, &recorder->area);
+  if (cairo_region_is_empty (recorder->damage))
+    {
+      recorder_record_frame (recorder, FALSE);
+      return;
+    }
+
+  cairo_region_get_extents (recorder->damage, &extents);
+  clutter_actor_queue_redraw_with_clip (CLUTTER_ACTOR (recorder->stage), &extents);
+}
+
 /* We hook in by recording each frame right after the stage is painted
- * by clutter before glSwapBuffers() makes it visible to the user.
+ * by clutter before glSwapBuffers() makes it visible to the user. Only
+ * the parts of the stage which were redrawn are read.
  */
 static void
 recorder_on_stage_paint (ClutterActor  *actor,
                          ShellRecorder *recorder)
 {
-  if (recorder->state == RECORDER_STATE_RECORDING)
-    recorder_record_frame (recorder, FALSE);
+  cairo_rectangle_int_t clip;
+
+  if (recorder->state != RECORDER_STATE_RECORDING)
+    return;
+
+  clutter_stage_get_redraw_clip_bounds (recorder->stage, &clip);
+  cairo_region_union_rectangle (recorder->damage, &clip);
+
+  recorder_record_frame (recorder, FALSE);
 }
 
 static void
@@ -517,7 +1028,10 @@ recorder_on_stage_notify_size (GObject          *object,
    * the frame size changes in the middle.
    */
   if (recorder->current_pipeline)
-    recorder_pipeline_set_caps (recorder->current_pipeline);
+    {
+      recorder_reset_frame (recorder);
+      recorder_pipeline_set_caps (recorder->current_pipeline);
+    }
 }
 
 static gboolean
@@ -526,7 +1040,7 @@ recorder_idle_redraw (gpointer data)
   ShellRecorder *recorder = data;
 
   recorder->redraw_idle = 0;
-  clutter_actor_queue_redraw (CLUTTER_ACTOR (recorder->stage));
+  recorder_refresh (recorder);
 
   return FALSE;
 }
@@ -550,17 +1064,9 @@ static void
 on_cursor_changed (MetaCursorTracker *tracker,
                    ShellRecorder     *recorder)
 {
-  if (recorder->cursor_image)
-    {
-      cairo_surface_destroy (recorder->cursor_image);
-      recorder->cursor_image = NULL;
-    }
-  if (recorder->cursor_memory)
-    {
-      g_free (recorder->cursor_memory);
-      recorder->cursor_memory = NULL;
-    }
+  g_clear_pointer (&recorder->cursor_memory, g_free);
 
+  recorder->cursor_dirty = TRUE;
   recorder_queue_redraw (recorder);
 }
 
@@ -575,6 +1081,7 @@ recorder_update_pointer (ShellRecorder *recorder)
     {
       recorder->pointer_x = pointer_x;
       recorder->pointer_y = pointer_y;
+      recorder->cursor_dirty = TRUE;
       recorder_queue_redraw (recorder);
     }
 }
@@ -775,6 +1282,15 @@ shell_recorder_set_property (GObject      *object,
     case PROP_DRAW_CURSOR:
       recorder_set_draw_cursor (recorder, g_value_get_boolean (value));
       break;
+    case PROP_VIDEO_FORMAT:
+      recorder->video_format = g_value_get_enum (value);
+      break;
+    case PROP_VIDEO_WIDTH:
+      recorder->video_width = g_value_get_int (value);
+      break;
+    case PROP_VIDEO_HEIGHT:
+      recorder->video_height = g_value_get_int (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -806,15 +1322,40 @@ shell_recorder_get_property (GObject         *object,
     case PROP_DRAW_CURSOR:
       g_value_set_boolean (value, recorder->draw_cursor);
       break;
+    case PROP_VIDEO_FORMAT:
+      g_value_set_enum (value, recorder->video_format);
+      break;
+    case PROP_VIDEO_WIDTH:
+      g_value_set_int (value, recorder->video_width);
+      break;
+    case PROP_VIDEO_HEIGHT:
+      g_value_set_int (value, recorder->video_height);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
     }
 }
 
+static void
+statistics_callback (ShellPerfLog *perf_log,
+                     gpointer      data)
+{
+  shell_perf_log_update_statistic_x (perf_log,
+                                     "recorder.framesRecorded",
+                                     frames_recorded);
+  shell_perf_log_update_statistic_x (perf_log,
+                                     "recorder.framesDropped",
+                                     frames_dropped);
+  shell_perf_log_update_statistic_x (perf_log,
+                                     "recorder.frameInterval",
+                                     current_frame_interval);
+}
+
 static void
 shell_recorder_class_init (ShellRecorderClass *klass)
 {
+  ShellPerfLog *perf_log = shell_perf_log_get_default ();
   GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
 
   gobject_class->finalize = shell_recorder_finalize;
@@ -870,6 +1411,52 @@ shell_recorder_class_init (ShellRecorderClass *klass)
                                                          "Whether to record the cursor",
                                                          TRUE,
                                                          G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class,
+                                   PROP_VIDEO_FORMAT,
+                                   g_param_spec_enum ("video-format",
+                                                      "Video Format",
+                                                      "Format of the frames passed to the pipeline",
+                                                      SHELL_TYPE_RECORDER_FORMAT,
+                                                      SHELL_RECORDER_FORMAT_RGB,
+                                                      G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class,
+                                   PROP_VIDEO_WIDTH,
+                                   g_param_spec_int ("video-width",
+                                                     "Video Width",
+                                                     "Width frames converted on the GPU are scaled to, or 0 to follow the height",
+                                                     0,
+                                                     G_MAXINT,
+                                                     0,
+                                                     G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class,
+                                   PROP_VIDEO_HEIGHT,
+                                   g_param_spec_int ("video-height",
+                                                     "Video Height",
+                                                     "Height frames converted on the GPU are scaled to, or 0 to follow the width",
+                                                     0,
+                                                     G_MAXINT,
+                                                     0,
+                                                     G_PARAM_READWRITE));
+
+  shell_perf_log_define_statistic (perf_log,
+                                   "recorder.framesRecorded",
+                                   "Number of frames recorded",
+                                   "x");
+  shell_perf_log_define_statistic (perf_log,
+                                   "recorder.framesDropped",
+                                   "Number of frames not recorded since the encoding pipeline was behind",
+                                   "x");
+  shell_perf_log_define_statistic (perf_log,
+                                   "recorder.frameInterval",
+                                   "Current minimum interval between recorded frames, in microseconds",
+                                   "x");
+
+  shell_perf_log_add_statistics_callback (perf_log,
+                                          statistics_callback,
+                                          NULL, NULL);
 }
 
 /* Sets the GstCaps (video format, in this case) on the stream
@@ -877,8 +1464,26 @@ shell_recorder_class_init (ShellRecorderClass *klass)
 static void
 recorder_pipeline_set_caps (RecorderPipeline *pipeline)
 {
+  ShellRecorder *recorder = pipeline->recorder;
   GstCaps *caps;
 
+  if (recorder->converter)
+    {
+      /* See shell-recorder-convert.c for the color space */
+      caps = gst_caps_new_simple ("video/x-raw",
+                                  "format", G_TYPE_STRING,
+                                  recorder->video_format == SHELL_RECORDER_FORMAT_NV12 ? "NV12" : "I420",
+                                  "colorimetry", G_TYPE_STRING, "bt709",
+                                  "framerate", GST_TYPE_FRACTION, recorder->framerate, 1,
+                                  "width", G_TYPE_INT, recorder->output_width,
+                                  "height", G_TYPE_INT, recorder->output_height,
+                                  NULL);
+      g_object_set (pipeline->src, "caps", caps, NULL);
+      gst_caps_unref (caps);
+
+      return;
+    }
+
   /* The data is always native-endian xRGB; videoconvert
    * doesn't support little-endian xRGB, but does support
    * big-endian BGRx.
@@ -889,9 +1494,9 @@ recorder_pipeline_set_caps (RecorderPipeline *pipeline)
 #else
                               "format", G_TYPE_STRING, "xRGB",
 #endif
-                              "framerate", GST_TYPE_FRACTION, pipeline->recorder->framerate, 1,
-                              "width", G_TYPE_INT, pipeline->recorder->area.width,
-                              "height", G_TYPE_INT, pipeline->recorder->area.height,
+                              "framerate", GST_TYPE_FRACTION, recorder->framerate, 1,
+                              "width", G_TYPE_INT, recorder->area.width,
+                              "height", G_TYPE_INT, recorder->area.height,
                               NULL);
   g_object_set (pipeline->src, "caps", caps, NULL);
   gst_caps_unref (caps);
@@ -1150,6 +1755,56 @@ recorder_pipeline_add_sink (RecorderPipeline *pipeline)
   return result;
 }
 
+/* Finds the element whose speed can be adjusted by
+ * recorder_pipeline_adjust_encoder_speed(), if any
+ */
+static void
+recorder_pipeline_find_encoder (RecorderPipeline *pipeline)
+{
+  GstIterator *iter;
+  GValue item = G_VALUE_INIT;
+  gboolean done = FALSE;
+
+  iter = gst_bin_iterate_recurse (GST_BIN (pipeline->pipeline));
+  while (!done)
+    {
+      switch (gst_iterator_next (iter, &item))
+        {
+        case GST_ITERATOR_OK:
+          {
+            GstElement *element = g_value_get_object (&item);
+            GParamSpec *pspec;
+
+            pspec = g_object_class_find_property (G_OBJECT_GET_CLASS (element), "cpu-used");
+            if (pspec != NULL &&
+                G_PARAM_SPEC_VALUE_TYPE (pspec) == G_TYPE_INT &&
+                (pspec->flags & G_PARAM_WRITABLE) != 0)
+              {
+                pipeline->encoder = gst_object_ref (element);
+                done = TRUE;
+              }
+            g_value_reset (&item);
+          }
+          break;
+        case GST_ITERATOR_RESYNC:
+          gst_iterator_resync (iter);
+          break;
+        default:
+          done = TRUE;
+          break;
+        }
+    }
+
+  g_value_unset (&item);
+  gst_iterator_free (iter);
+
+  if (pipeline->encoder != NULL)
+    {
+      g_object_get (pipeline->encoder, "cpu-used", &pipeline->encoder_base_speed, NULL);
+      pipeline->encoder_speed = pipeline->encoder_base_speed;
+    }
+}
+
 static gboolean
 recorder_update_memory_used_timeout (gpointer data)
 {
@@ -1185,6 +1840,9 @@ recorder_pipeline_on_memory_used_changed (ShellRecorderSrc *src,
 static void
 recorder_pipeline_free (RecorderPipeline *pipeline)
 {
+  if (pipeline->encoder != NULL)
+    gst_object_unref (pipeline->encoder);
+
   if (pipeline->pipeline != NULL)
     gst_object_unref (pipeline->pipeline);
 
@@ -1342,6 +2000,8 @@ recorder_open_pipeline (ShellRecorder *recorder)
   if (!recorder_pipeline_add_sink (pipeline))
     goto error;
 
+  recorder_pipeline_find_encoder (pipeline);
+
   gst_element_set_state (pipeline->pipeline, GST_STATE_PLAYING);
 
   bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline->pipeline));
@@ -1454,6 +2114,69 @@ shell_recorder_set_draw_cursor (ShellRecorder *recorder,
   recorder_set_draw_cursor (recorder, draw_cursor);
 }
 
+/**
+ * shell_recorder_set_video_format:
+ * @recorder: the #ShellRecorder
+ * @format: the format of the frames passed to the pipeline
+ *
+ * Sets the format of the frames passed to the encoding pipeline. With
+ * %SHELL_RECORDER_FORMAT_I420 or %SHELL_RECORDER_FORMAT_NV12, the frames
+ * are converted on the GPU, which reads back less data and spares
+ * the pipeline the conversion. If the conversion can't be set up, the
+ * recorder falls back to %SHELL_RECORDER_FORMAT_RGB. This takes effect
+ * the next time recording starts.
+ */
+void
+shell_recorder_set_video_format (ShellRecorder       *recorder,
+                                 ShellRecorderFormat  format)
+{
+  g_return_if_fail (SHELL_IS_RECORDER (recorder));
+
+  if (format == recorder->video_format)
+    return;
+
+  recorder->video_format = format;
+
+  g_object_notify (G_OBJECT (recorder), "video-format");
+}
+
+/**
+ * shell_recorder_set_video_size:
+ * @recorder: the #ShellRecorder
+ * @width: the width of the video, or 0
+ * @height: the height of the video, or 0
+ *
+ * Sets the size frames are scaled to when they are converted on the
+ * GPU, see shell_recorder_set_video_format(). If only one of @width
+ * and @height is given, the other follows the aspect ratio of the
+ * recorded area; if neither is, frames aren't scaled. The width is
+ * rounded down to a multiple of 8, and the height to a multiple of 4.
+ * This takes effect the next time recording starts.
+ */
+void
+shell_recorder_set_video_size (ShellRecorder *recorder,
+                               int            width,
+                               int            height)
+{
+  g_return_if_fail (SHELL_IS_RECORDER (recorder));
+
+  g_object_freeze_notify (G_OBJECT (recorder));
+
+  if (width != recorder->video_width)
+    {
+      recorder->video_width = width;
+      g_object_notify (G_OBJECT (recorder), "video-width");
+    }
+
+  if (height != recorder->video_height)
+    {
+      recorder->video_height = height;
+      g_object_notify (G_OBJECT (recorder), "video-height");
+    }
+
+  g_object_thaw_notify (G_OBJECT (recorder));
+}
+
 /**
  * shell_recorder_set_pipeline:
  * @recorder: the #ShellRecorder
@@ -1503,7 +2226,10 @@ shell_recorder_set_area (ShellRecorder *recorder,
    * the frame size changes in the middle.
    */
   if (recorder->current_pipeline)
-    recorder_pipeline_set_caps (recorder->current_pipeline);
+    {
+      recorder_reset_frame (recorder);
+      recorder_pipeline_set_caps (recorder->current_pipeline);
+    }
 }
 
 /**
@@ -1533,8 +2259,14 @@ shell_recorder_record (ShellRecorder  *recorder,
   g_return_val_if_fail (recorder->stage != NULL, FALSE);
   g_return_val_if_fail (recorder->state != RECORDER_STATE_RECORDING, FALSE);
 
+  /* The caps depend on whether frames can be converted */
+  recorder_reset_frame (recorder);
+
   if (!recorder_open_pipeline (recorder))
-    return FALSE;
+    {
+      recorder_clear_frame (recorder);
+      return FALSE;
+    }
 
   if (filename_used)
     *filename_used = g_strdup (recorder->current_pipeline->filename);
@@ -1542,6 +2274,8 @@ shell_recorder_record (ShellRecorder  *recorder,
   recorder_connect_stage_callbacks (recorder);
 
   recorder->last_frame_time = GST_CLOCK_TIME_NONE;
+  recorder->last_drop_time = GST_CLOCK_TIME_NONE;
+  recorder->frame_interval = gst_util_uint64_scale_int (GST_SECOND, 1, recorder->framerate);
 
   recorder->state = RECORDER_STATE_RECORDING;
   recorder_update_pointer (recorder);
@@ -1550,9 +2284,6 @@ shell_recorder_record (ShellRecorder  *recorder,
   /* Disable unredirection while we are recoring */
   meta_disable_unredirect_for_screen (shell_global_get_screen (shell_global_get ()));
 
-  /* Set up repaint hook */
-  recorder->repaint_hook_id = clutter_threads_add_repaint_func(recorder_repaint_hook, recorder->stage, NULL);
-
   /* Record an initial frame and also redraw with the indicator */
   clutter_actor_queue_redraw (CLUTTER_ACTOR (recorder->stage));
 
@@ -1580,22 +2311,20 @@ shell_recorder_close (ShellRecorder *recorder)
   g_return_if_fail (recorder->state != RECORDER_STATE_CLOSED);
 
   /* We want to record one more frame since some time may have
-   * elapsed since the last frame
+   * elapsed since the last frame; the frames still being read back
+   * come before it
    */
+  recorder_collect_frames (recorder, TRUE);
   recorder_record_frame (recorder, TRUE);
+  recorder_clear_frame (recorder);
 
   recorder_remove_update_pointer_timeout (recorder);
+  recorder_remove_frame_timeout (recorder);
   recorder_close_pipeline (recorder);
 
   /* Queue a redraw to remove the recording indicator */
   clutter_actor_queue_redraw (CLUTTER_ACTOR (recorder->stage));
 
-  if (recorder->repaint_hook_id != 0)
-    {
-      clutter_threads_remove_repaint_func (recorder->repaint_hook_id);
-      recorder->repaint_hook_id = 0;
-    }
-
   recorder->state = RECORDER_STATE_CLOSED;
 
   /* Reenable after the recording */
@@ -19,6 +19,23 @@ G_BEGIN_DECLS
 #define SHELL_TYPE_RECORDER (shell_recorder_get_type ())
 G_DECLARE_FINAL_TYPE (ShellRecorder, shell_recorder, SHELL, RECORDER, GObject)
 
+/**
+ * ShellRecorderFormat:
+ * @SHELL_RECORDER_FORMAT_RGB: frames are passed to the pipeline as
+ *   drawn, in 32-bit RGB, and converted by it
+ * @SHELL_RECORDER_FORMAT_I420: frames are converted to planar YUV 4:2:0
+ *   on the GPU
+ * @SHELL_RECORDER_FORMAT_NV12: frames are converted to semi-planar
+ *   YUV 4:2:0 on the GPU
+ *
+ * The format of the frames passed to the encoding pipeline.
+ */
+typedef enum {
+  SHELL_RECORDER_FORMAT_RGB,
+  SHELL_RECORDER_FORMAT_I420,
+  SHELL_RECORDER_FORMAT_NV12
+} ShellRecorderFormat;
+
 ShellRecorder     *shell_recorder_new (ClutterStage  *stage);
 
 void               shell_recorder_set_framerate (ShellRecorder *recorder,
@@ -29,6 +46,11 @@ void               shell_recorder_set_pipeline (ShellRecorder *recorder,
 						const char    *pipeline);
 void               shell_recorder_set_draw_cursor (ShellRecorder *recorder,
                                                    gboolean       draw_cursor);
+void               shell_recorder_set_video_format (ShellRecorder       *recorder,
+                                                    ShellRecorderFormat  format);
+void               shell_recorder_set_video_size (ShellRecorder *recorder,
+                                                  int            width,
+                                                  int            height);
 void               shell_recorder_set_area     (ShellRecorder *recorder,
                                                 int            x,
                                                 int            y,
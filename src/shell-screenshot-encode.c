@@ -0,0 +1,437 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+#include "shell-screenshot-encode.h"
+
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF  0x40
+#define QOI_OP_LUMA  0x80
+#define QOI_OP_RUN   0xc0
+#define QOI_OP_RGB   0xfe
+#define QOI_OP_RGBA  0xff
+
+#define QOI_MAX_RUN 62
+
+/* The worst case of QOI_OP_RGBA for every pixel, plus a pending run */
+#define QOI_MAX_ROW_SIZE(width) ((width) * 5 + 1)
+
+static const guint8 qoi_end_marker[] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+
+/* (255 << 16) / alpha, so unpremultiplying is a multiply and a shift */
+static guint32 unpremultiply_table[256];
+
+static void
+init_unpremultiply_table (void)
+{
+  static gsize initialized = 0;
+
+  if (g_once_init_enter (&initialized))
+    {
+      int alpha;
+
+      for (alpha = 1; alpha < 256; alpha++)
+        unpremultiply_table[alpha] = ((255 << 16) + alpha / 2) / alpha;
+
+      g_once_init_leave (&initialized, 1);
+    }
+}
+
+/* Swaps a native-endian ARGB pixel to the bytes R, G, B, A in memory */
+static inline guint32
+argb_to_rgba (guint32 pixel)
+{
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+  return ((pixel & 0xff00ff00) |
+          ((pixel >> 16) & 0xff) |
+          ((pixel & 0xff) << 16));
+#else
+  return (pixel << 8) | (pixel >> 24);
+#endif
+}
+
+static inline guint8
+unpremultiply (guint32 component,
+               guint32 reciprocal)
+{
+  return MIN ((component * reciprocal + 0x8000) >> 16, 255);
+}
+
+/* Converts a row of a cairo image to non-premultiplied RGBA bytes, as
+ * expected by all the formats. Most pixels of a screenshot are opaque,
+ * and only need their bytes swapped.
+ */
+static void
+unpremultiply_row (const guint32 *src,
+                   guint8        *dest,
+                   int            width,
+                   gboolean       has_alpha)
+{
+  guint32 *dest_pixels = (guint32 *) dest;
+  int i;
+
+  if (!has_alpha)
+    {
+      for (i = 0; i < width; i++)
+        dest_pixels[i] = argb_to_rgba (src[i] | 0xff000000);
+      return;
+    }
+
+  for (i = 0; i < width; i++)
+    {
+      guint32 pixel = src[i];
+      guint32 alpha = pixel >> 24;
+
+      if (alpha == 0xff)
+        {
+          dest_pixels[i] = argb_to_rgba (pixel);
+        }
+      else if (alpha == 0)
+        {
+          dest_pixels[i] = 0;
+        }
+      else
+        {
+          guint32 reciprocal = unpremultiply_table[alpha];
+          guint8 *p = dest + i * 4;
+
+          p[0] = unpremultiply ((pixel >> 16) & 0xff, reciprocal);
+          p[1] = unpremultiply ((pixel >> 8) & 0xff, reciprocal);
+          p[2] = unpremultiply (pixel & 0xff, reciprocal);
+          p[3] = alpha;
+        }
+    }
+}
+
+static const guint32 *
+image_get_row (cairo_surface_t *image,
+               int              y)
+{
+  return (const guint32 *) (cairo_image_surface_get_data (image) +
+                            y * cairo_image_surface_get_stride (image));
+}
+
+static gboolean
+image_has_alpha (cairo_surface_t *image)
+{
+  return cairo_image_surface_get_format (image) == CAIRO_FORMAT_ARGB32;
+}
+
+static gboolean
+encode_png (cairo_surface_t *image,
+            int              compression_level,
+            GOutputStream   *stream,
+            GCancellable    *cancellable,
+            GError         **error)
+{
+  int width = cairo_image_surface_get_width (image);
+  int height = cairo_image_surface_get_height (image);
+  gboolean has_alpha = image_has_alpha (image);
+  char *keys[3] = { "tEXt::Software", NULL, NULL };
+  char *values[3] = { "gnome-screenshot", NULL, NULL };
+  char compression[4];
+  GdkPixbuf *pixbuf;
+  guint8 *pixels;
+  int rowstride, y;
+  gboolean result;
+
+  pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, TRUE, 8, width, height);
+  if (pixbuf == NULL)
+    {
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NO_SPACE,
+                           "Not enough memory for the screenshot");
+      return FALSE;
+    }
+
+  pixels = gdk_pixbuf_get_pixels (pixbuf);
+  rowstride = gdk_pixbuf_get_rowstride (pixbuf);
+
+  for (y = 0; y < height; y++)
+    unpremultiply_row (image_get_row (image, y), pixels + y * rowstride,
+                       width, has_alpha);
+
+  if (compression_level >= 0)
+    {
+      g_snprintf (compression, sizeof (compression), "%d",
+                  MIN (compression_level, 9));
+      keys[1] = "compression";
+      values[1] = compression;
+    }
+
+  result = gdk_pixbuf_save_to_streamv (pixbuf, stream, "png", keys, values,
+                                       cancellable, error);
+  g_object_unref (pixbuf);
+
+  return result;
+}
+
+static inline guint
+qoi_hash (const guint8 *pixel)
+{
+  return (pixel[0] * 3 + pixel[1] * 5 + pixel[2] * 7 + pixel[3] * 11) % 64;
+}
+
+static void
+qoi_put_u32 (guint8  *dest,
+             guint32  value)
+{
+  dest[0] = value >> 24;
+  dest[1] = value >> 16;
+  dest[2] = value >> 8;
+  dest[3] = value;
+}
+
+/* See https://qoiformat.org/qoi-specification.pdf; runs carry over
+ * from one row to the next, so only the encoder state lives across
+ * rows and the image is never held in memory twice.
+ */
+static gboolean
+encode_qoi (cairo_surface_t *image,
+            GOutputStream   *stream,
+            GCancellable    *cancellable,
+            GError         **error)
+{
+  int width = cairo_image_surface_get_width (image);
+  int height = cairo_image_surface_get_height (image);
+  gboolean has_alpha = image_has_alpha (image);
+  guint8 header[14];
+  guint8 index[64][4];
+  guint8 previous[4] = { 0, 0, 0, 255 };
+  guint8 *row, *out;
+  int run = 0;
+  int x, y;
+  gboolean result = FALSE;
+
+  memcpy (header, "qoif", 4);
+  qoi_put_u32 (header + 4, width);
+  qoi_put_u32 (header + 8, height);
+  header[12] = has_alpha ? 4 : 3;
+  header[13] = 0; /* sRGB with linear alpha */
+
+  if (!g_output_stream_write_all (stream, header, sizeof (header), NULL,
+                                  cancellable, error))
+    return FALSE;
+
+  memset (index, 0, sizeof (index));
+
+  row = g_malloc (width * 4);
+  out = g_malloc (QOI_MAX_ROW_SIZE (width));
+
+  for (y = 0; y < height; y++)
+    {
+      gsize len = 0;
+
+      unpremultiply_row (image_get_row (image, y), row, width, has_alpha);
+
+      for (x = 0; x < width; x++)
+        {
+          guint8 *pixel = row + x * 4;
+          guint hash;
+
+          if (memcmp (pixel, previous, 4) == 0)
+            {
+              if (++run == QOI_MAX_RUN)
+                {
+                  out[len++] = QOI_OP_RUN | (run - 1);
+                  run = 0;
+                }
+              continue;
+            }
+
+          if (run > 0)
+            {
+              out[len++] = QOI_OP_RUN | (run - 1);
+              run = 0;
+            }
+
+          hash = qoi_hash (pixel);
+          if (memcmp (index[hash], pixel, 4) == 0)
+            {
+              out[len++] = QOI_OP_INDEX | hash;
+            }
+          else
+            {
+              memcpy (index[hash], pixel, 4);
+
+              if (pixel[3] == previous[3])
+                {
+                  signed char dr = pixel[0] - previous[0];
+                  signed char dg = pixel[1] - previous[1];
+                  signed char db = pixel[2] - previous[2];
+                  signed char dr_dg = dr - dg;
+                  signed char db_dg = db - dg;
+
+                  if (dr > -3 && dr < 2 &&
+                      dg > -3 && dg < 2 &&
+                      db > -3 && db < 2)
+                    {
+                      out[len++] = QOI_OP_DIFF | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2);
+                    }
+                  else if (dr_dg > -9 && dr_dg < 8 &&
+                           dg > -33 && dg < 32 &&
+                           db_dg > -9 && db_dg < 8)
+                    {
+                      out[len++] = QOI_OP_LUMA | (dg + 32);
+                      out[len++] = (dr_dg + 8) << 4 | (db_dg + 8);
+                    }
+                  else
+                    {
+                      out[len++] = QOI_OP_RGB;
+                      memcpy (out + len, pixel, 3);
+                      len += 3;
+                    }
+                }
+              else
+                {
+                  out[len++] = QOI_OP_RGBA;
+                  memcpy (out + len, pixel, 4);
+                  len += 4;
+                }
+            }
+
+          memcpy (previous, pixel, 4);
+        }
+
+      if (y == height - 1 && run > 0)
+        out[len++] = QOI_OP_RUN | (run - 1);
+
+      if (!g_output_stream_write_all (stream, out, len, NULL,
+                                      cancellable, error))
+        goto out;
+    }
+
+  result = g_output_stream_write_all (stream, qoi_end_marker,
+                                      sizeof (qoi_end_marker), NULL,
+                                      cancellable, error);
+
+ out:
+  g_free (row);
+  g_free (out);
+
+  return result;
+}
+
+/* A netpbm PAM file; the raw pixels, with the size and layout in a
+ * short text header that test tools can read without a decoder.
+ */
+static gboolean
+encode_pam (cairo_surface_t *image,
+            GOutputStream   *stream,
+            GCancellable    *cancellable,
+            GError         **error)
+{
+  int width = cairo_image_surface_get_width (image);
+  int height = cairo_image_surface_get_height (image);
+  gboolean has_alpha = image_has_alpha (image);
+  char *header;
+  guint8 *row;
+  int y;
+  gboolean result;
+
+  header = g_strdup_printf ("P7\n"
+                            "WIDTH %d\n"
+                            "HEIGHT %d\n"
+                            "DEPTH 4\n"
+                            "MAXVAL 255\n"
+                            "TUPLTYPE RGB_ALPHA\n"
+                            "ENDHDR\n",
+                            width, height);
+  result = g_output_stream_write_all (stream, header, strlen (header), NULL,
+                                      cancellable, error);
+  g_free (header);
+
+  row = g_malloc (width * 4);
+
+  for (y = 0; result && y < height; y++)
+    {
+      unpremultiply_row (image_get_row (image, y), row, width, has_alpha);
+      result = g_output_stream_write_all (stream, row, width * 4, NULL,
+                                          cancellable, error);
+    }
+
+  g_free (row);
+
+  return result;
+}
+
+const char *
+_shell_screenshot_format_get_extension (ShellScreenshotFormat format)
+{
+  switch (format)
+    {
+    case SHELL_SCREENSHOT_FORMAT_QOI:
+      return ".qoi";
+    case SHELL_SCREENSHOT_FORMAT_PAM:
+      return ".pam";
+    case SHELL_SCREENSHOT_FORMAT_PNG:
+    default:
+      return ".png";
+    }
+}
+
+/* Picks the format matching the extension of @filename, or @fallback
+ * if it doesn't have the extension of one of the formats.
+ */
+ShellScreenshotFormat
+_shell_screenshot_format_for_filename (const char            *filename,
+                                       ShellScreenshotFormat  fallback)
+{
+  static const ShellScreenshotFormat formats[] = {
+    SHELL_SCREENSHOT_FORMAT_PNG,
+    SHELL_SCREENSHOT_FORMAT_QOI,
+    SHELL_SCREENSHOT_FORMAT_PAM
+  };
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (formats); i++)
+    if (g_str_has_suffix (filename, _shell_screenshot_format_get_extension (formats[i])))
+      return formats[i];
+
+  return fallback;
+}
+
+/*
+ * _shell_screenshot_encode:
+ * @image: an ARGB32 or RGB24 image surface
+ * @format: the format to write
+ * @compression_level: the zlib compression level for PNG, from 0 for
+ *   none to 9, or -1 for the default
+ * @stream: the stream to write to
+ *
+ * Called from the thread writing the screenshot.
+ */
+gboolean
+_shell_screenshot_encode (cairo_surface_t        *image,
+                          ShellScreenshotFormat   format,
+                          int                     compression_level,
+                          GOutputStream          *stream,
+                          GCancellable           *cancellable,
+                          GError                **error)
+{
+  cairo_format_t image_format = cairo_image_surface_get_format (image);
+
+  if (image_format != CAIRO_FORMAT_ARGB32 && image_format != CAIRO_FORMAT_RGB24)
+    {
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                           "Unsupported screenshot image format");
+      return FALSE;
+    }
+
+  init_unpremultiply_table ();
+  cairo_surface_flush (image);
+
+  switch (format)
+    {
+    case SHELL_SCREENSHOT_FORMAT_QOI:
+      return encode_qoi (image, stream, cancellable, error);
+    case SHELL_SCREENSHOT_FORMAT_PAM:
+      return encode_pam (image, stream, cancellable, error);
+    case SHELL_SCREENSHOT_FORMAT_PNG:
+    default:
+      return encode_png (image, compression_level, stream, cancellable, error);
+    }
+}
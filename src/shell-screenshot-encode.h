@@ -0,0 +1,32 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+#ifndef __SHELL_SCREENSHOT_ENCODE_H__
+#define __SHELL_SCREENSHOT_ENCODE_H__
+
+#include <cairo.h>
+#include <gio/gio.h>
+
+#include "shell-screenshot.h"
+
+G_BEGIN_DECLS
+
+/*
+ * Writes screenshots out in one of the #ShellScreenshotFormat formats.
+ * The pixels are unpremultiplied straight from the rows of the cairo
+ * image; QOI and PAM images are streamed a row at a time, while PNG
+ * images are passed to gdk-pixbuf with the requested compression level.
+ */
+const char *_shell_screenshot_format_get_extension (ShellScreenshotFormat   format);
+ShellScreenshotFormat
+            _shell_screenshot_format_for_filename  (const char             *filename,
+                                                    ShellScreenshotFormat   fallback);
+
+gboolean    _shell_screenshot_encode               (cairo_surface_t        *image,
+                                                    ShellScreenshotFormat   format,
+                                                    int                     compression_level,
+                                                    GOutputStream          *stream,
+                                                    GCancellable           *cancellable,
+                                                    GError                **error);
+
+G_END_DECLS
+
+#endif /* __SHELL_SCREENSHOT_ENCODE_H__ */
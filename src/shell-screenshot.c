@@ -1,5 +1,15 @@
 /* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
 
+#define _GNU_SOURCE /* for memfd_create() and F_ADD_SEALS */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <gio/gunixoutputstream.h>
 #include <clutter/clutter.h>
 #include <cogl/cogl.h>
 #include <meta/display.h>
@@ -9,12 +19,17 @@
 #include <meta/meta-cursor-tracker.h>
 
 #include "shell-global.h"
+#include "shell-perf-log.h"
 #include "shell-screenshot.h"
+#include "shell-screenshot-encode.h"
 #include "shell-util.h"
 
 #define A11Y_APPS_SCHEMA "org.gnome.desktop.a11y.applications"
 #define MAGNIFIER_ACTIVE_KEY "screen-magnifier-enabled"
 
+/* The most screenshots of a batch written at the same time */
+#define MAX_BATCH_THREADS 4
+
 typedef struct _ShellScreenshotPrivate  ShellScreenshotPrivate;
 
 struct _ShellScreenshot
@@ -37,15 +52,68 @@ struct _ShellScreenshotPrivate
   gboolean include_cursor;
   gboolean include_frame;
 
+  ShellScreenshotFormat format;
+  int compression_level;
+
   ShellScreenshotCallback callback;
+
+  /* Set when the screenshot is passed back in memory, rather than in
+   * a file */
+  ShellScreenshotFdCallback fd_callback;
+  int fd;
+
+  /* Areas of shell_screenshot_screenshot_areas(), cut out of a single
+   * capture in priv->image */
+  GPtrArray *batch;
+  volatile gint batch_pending;
+  ShellScreenshotBatchCallback batch_callback;
 };
 
+typedef struct {
+  ShellScreenshot *screenshot;
+  GTask *task;
+  cairo_rectangle_int_t area;
+  char *filename;
+  char *filename_used;
+  ShellScreenshotFormat format;
+  cairo_surface_t *image; /* Points into the pixels of the whole capture */
+  gboolean success;
+} BatchItem;
+
 G_DEFINE_TYPE_WITH_PRIVATE (ShellScreenshot, shell_screenshot, G_TYPE_OBJECT);
 
+static guint write_start_event;
+static guint write_done_event;
+static guint encode_span;
+
+static GThreadPool *batch_pool;
+
+static void write_batch_item (gpointer data,
+                              gpointer user_data);
+
 static void
 shell_screenshot_class_init (ShellScreenshotClass *screenshot_class)
 {
-  (void) screenshot_class;
+  ShellPerfLog *perf_log = shell_perf_log_get_default ();
+
+  write_start_event =
+    shell_perf_log_define_event (perf_log,
+                                 "screenshot.writeStart",
+                                 "Start of encoding and writing a screenshot",
+                                 "");
+  write_done_event =
+    shell_perf_log_define_event (perf_log,
+                                 "screenshot.writeDone",
+                                 "Finished writing a screenshot",
+                                 "");
+  encode_span =
+    shell_perf_log_define_span (perf_log,
+                                "screenshot.encode",
+                                "Encoding and writing a screenshot");
+
+  batch_pool = g_thread_pool_new (write_batch_item, NULL,
+                                  MIN (g_get_num_processors (), MAX_BATCH_THREADS),
+                                  FALSE, NULL);
 }
 
 static void
@@ -53,6 +121,17 @@ shell_screenshot_init (ShellScreenshot *screenshot)
 {
   screenshot->priv = shell_screenshot_get_instance_private (screenshot);
   screenshot->priv->global = shell_global_get ();
+  screenshot->priv->format = SHELL_SCREENSHOT_FORMAT_PNG;
+  screenshot->priv->compression_level = -1;
+  screenshot->priv->fd = -1;
+}
+
+static gboolean
+screenshot_in_progress (ShellScreenshotPrivate *priv)
+{
+  return (priv->filename != NULL ||
+          priv->fd_callback != NULL ||
+          priv->batch != NULL);
 }
 
 static void
@@ -62,16 +141,29 @@ on_screenshot_written (GObject      *source,
 {
   ShellScreenshot *screenshot = SHELL_SCREENSHOT (source);
   ShellScreenshotPrivate *priv = screenshot->priv;
-
-  if (priv->callback)
+  gboolean success = g_task_propagate_boolean (G_TASK (result), NULL);
+
+  if (priv->fd_callback)
+    priv->fd_callback (screenshot,
+                       success,
+                       &priv->screenshot_area,
+                       success ? priv->fd : -1);
+  else if (priv->callback)
     priv->callback (screenshot,
-                    g_task_propagate_boolean (G_TASK (result), NULL),
+                    success,
                     &priv->screenshot_area,
                     priv->filename_used);
 
+  if (priv->fd != -1)
+    {
+      close (priv->fd);
+      priv->fd = -1;
+    }
+
   g_clear_pointer (&priv->image, cairo_surface_destroy);
   g_clear_pointer (&priv->filename, g_free);
   g_clear_pointer (&priv->filename_used, g_free);
+  priv->fd_callback = NULL;
 
   meta_enable_unredirect_for_screen (shell_global_get_screen (priv->global));
 }
@@ -80,6 +172,7 @@ on_screenshot_written (GObject      *source,
 static GOutputStream *
 get_stream_for_unique_path (const gchar *path,
                             const gchar *filename,
+                            const gchar *extension,
                             gchar **filename_used)
 {
   GOutputStream *stream;
@@ -87,7 +180,7 @@ get_stream_for_unique_path (const gchar *path,
   gchar *real_path, *real_filename, *name, *ptr;
   gint idx;
 
-  ptr = g_strrstr (filename, ".png");
+  ptr = g_strrstr (filename, extension);
 
   if (ptr != NULL)
     real_filename = g_strndup (filename, ptr - filename);
@@ -100,9 +193,9 @@ get_stream_for_unique_path (const gchar *path,
   do
     {
       if (idx == 0)
-        name = g_strdup_printf ("%s.png", real_filename);
+        name = g_strdup_printf ("%s%s", real_filename, extension);
       else
-        name = g_strdup_printf ("%s - %d.png", real_filename, idx);
+        name = g_strdup_printf ("%s - %d%s", real_filename, idx, extension);
 
       real_path = g_build_filename (path, name, NULL);
       g_free (name);
@@ -128,6 +221,7 @@ get_stream_for_unique_path (const gchar *path,
 /* called in an I/O thread */
 static GOutputStream *
 get_stream_for_filename (const gchar *filename,
+                         const gchar *extension,
                          gchar **filename_used)
 {
   const gchar *path;
@@ -140,11 +234,12 @@ get_stream_for_filename (const gchar *filename,
         return NULL;
     }
 
-  return get_stream_for_unique_path (path, filename, filename_used);
+  return get_stream_for_unique_path (path, filename, extension, filename_used);
 }
 
 static GOutputStream *
 prepare_write_stream (const gchar *filename,
+                      const gchar *extension,
                       gchar **filename_used)
 {
   GOutputStream *stream;
@@ -159,12 +254,65 @@ prepare_write_stream (const gchar *filename,
     }
   else
     {
-      stream = get_stream_for_filename (filename, filename_used);
+      stream = get_stream_for_filename (filename, extension, filename_used);
     }
 
   return stream;
 }
 
+/* called in an I/O thread */
+static int
+create_memory_file (void)
+{
+  char *path;
+  int fd;
+
+#ifdef HAVE_MEMFD_CREATE
+  fd = memfd_create ("gnome-shell-screenshot", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (fd != -1 || errno != ENOSYS)
+    return fd;
+#endif
+
+  /* Without memfd, a deleted file in the runtime directory is the
+   * next best thing; it usually lives in memory too */
+  path = g_build_filename (g_get_user_runtime_dir (),
+                           "gnome-shell-screenshot-XXXXXX", NULL);
+  fd = g_mkstemp_full (path, O_RDWR | O_CLOEXEC, 0600);
+  if (fd != -1)
+    unlink (path);
+  g_free (path);
+
+  return fd;
+}
+
+/* called in an I/O thread */
+static GOutputStream *
+prepare_memory_stream (int *fd)
+{
+  *fd = create_memory_file ();
+  if (*fd == -1)
+    return NULL;
+
+  return g_unix_output_stream_new (*fd, FALSE);
+}
+
+/* Makes the screenshot read-only for whoever receives it, and rewinds
+ * it so it can be read straight away. Files which can't be sealed are
+ * passed on as they are.
+ */
+static gboolean
+finish_memory_file (int fd)
+{
+#ifdef F_ADD_SEALS
+  if (fcntl (fd, F_ADD_SEALS,
+             F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) == -1 &&
+      errno != EINVAL)
+    return FALSE;
+#endif
+
+  return lseek (fd, 0, SEEK_SET) == 0;
+}
+
 static void
 write_screenshot_thread (GTask        *result,
                          gpointer      object,
@@ -175,38 +323,120 @@ write_screenshot_thread (GTask        *result,
   GOutputStream *stream;
   ShellScreenshot *screenshot = SHELL_SCREENSHOT (object);
   ShellScreenshotPrivate *priv;
+  ShellScreenshotFormat format;
 
   g_assert (screenshot != NULL);
 
   priv = screenshot->priv;
+  /* Screenshots passed back in memory have no filename */
+  if (priv->filename != NULL)
+    format = _shell_screenshot_format_for_filename (priv->filename, priv->format);
+  else
+    format = priv->format;
+
+  shell_perf_log_record (shell_perf_log_get_default (), write_start_event);
+  SHELL_PERF_LOG_SPAN_BEGIN (encode_span);
 
-  stream = prepare_write_stream (priv->filename,
-                                 &priv->filename_used);
+  if (priv->fd_callback != NULL)
+    stream = prepare_memory_stream (&priv->fd);
+  else
+    stream = prepare_write_stream (priv->filename,
+                                   _shell_screenshot_format_get_extension (format),
+                                   &priv->filename_used);
 
   if (stream == NULL)
     status = CAIRO_STATUS_FILE_NOT_FOUND;
+  else if (_shell_screenshot_encode (priv->image,
+                                     format,
+                                     priv->compression_level,
+                                     stream, NULL, NULL) &&
+           (priv->fd == -1 || finish_memory_file (priv->fd)))
+    status = CAIRO_STATUS_SUCCESS;
   else
+    status = CAIRO_STATUS_WRITE_ERROR;
+
+  SHELL_PERF_LOG_SPAN_END (encode_span);
+  shell_perf_log_record (shell_perf_log_get_default (), write_done_event);
+
+  g_task_return_boolean (result, status == CAIRO_STATUS_SUCCESS);
+
+  g_clear_object (&stream);
+}
+
+static void
+batch_item_free (BatchItem *item)
+{
+  g_clear_pointer (&item->image, cairo_surface_destroy);
+  g_free (item->filename);
+  g_free (item->filename_used);
+  g_slice_free (BatchItem, item);
+}
+
+/* called in a thread of batch_pool */
+static void
+write_batch_item (gpointer data,
+                  gpointer user_data)
+{
+  BatchItem *item = data;
+  ShellScreenshotPrivate *priv = item->screenshot->priv;
+  GOutputStream *stream;
+  GTask *task = item->task;
+
+  if (item->image != NULL)
     {
-      GdkPixbuf *pixbuf;
+      stream = prepare_write_stream (item->filename,
+                                     _shell_screenshot_format_get_extension (item->format),
+                                     &item->filename_used);
+
+      item->success = (stream != NULL &&
+                       _shell_screenshot_encode (item->image,
+                                                 item->format,
+                                                 priv->compression_level,
+                                                 stream, NULL, NULL));
+      g_clear_object (&stream);
+    }
 
-      pixbuf = gdk_pixbuf_get_from_surface (priv->image,
-                                            0, 0,
-                                            cairo_image_surface_get_width (priv->image),
-                                            cairo_image_surface_get_height (priv->image));
+  /* The last one reports back to the main thread */
+  if (g_atomic_int_dec_and_test (&priv->batch_pending))
+    {
+      g_task_return_boolean (task, TRUE);
+      g_object_unref (task);
+    }
+}
 
-      if (gdk_pixbuf_save_to_stream (pixbuf, stream, "png", NULL, NULL,
-                                    "tEXt::Software", "gnome-screenshot", NULL))
-        status = CAIRO_STATUS_SUCCESS;
-      else
-        status = CAIRO_STATUS_WRITE_ERROR;
+static void
+on_batch_written (GObject      *source,
+                  GAsyncResult *result,
+                  gpointer      user_data)
+{
+  ShellScreenshot *screenshot = SHELL_SCREENSHOT (source);
+  ShellScreenshotPrivate *priv = screenshot->priv;
+  GPtrArray *filenames_used;
+  gboolean success = TRUE;
+  guint i;
 
-      g_object_unref (pixbuf);
+  filenames_used = g_ptr_array_new ();
+  for (i = 0; i < priv->batch->len; i++)
+    {
+      BatchItem *item = priv->batch->pdata[i];
+
+      success = success && item->success;
+      g_ptr_array_add (filenames_used,
+                       item->success ? item->filename_used : (char *) "");
     }
+  g_ptr_array_add (filenames_used, NULL);
 
+  if (priv->batch_callback)
+    priv->batch_callback (screenshot, success,
+                          (const char * const *) filenames_used->pdata);
 
-  g_task_return_boolean (result, status == CAIRO_STATUS_SUCCESS);
+  g_ptr_array_free (filenames_used, TRUE);
 
-  g_clear_object (&stream);
+  /* The items point into the image */
+  g_clear_pointer (&priv->batch, g_ptr_array_unref);
+  g_clear_pointer (&priv->image, cairo_surface_destroy);
+
+  meta_enable_unredirect_for_screen (shell_global_get_screen (priv->global));
 }
 
 static void
@@ -397,6 +627,60 @@ grab_area_screenshot (ClutterActor *stage,
   g_object_unref (result);
 }
 
+static void
+grab_batch_screenshot (ClutterActor    *stage,
+                       ShellScreenshot *screenshot)
+{
+  ShellScreenshotPrivate *priv = screenshot->priv;
+  GTask *task;
+  double scale = 1.0;
+  guint8 *data = NULL;
+  int stride = 0;
+  guint i;
+
+  do_grab_screenshot (screenshot,
+                      CLUTTER_STAGE (stage),
+                      priv->screenshot_area.x,
+                      priv->screenshot_area.y,
+                      priv->screenshot_area.width,
+                      priv->screenshot_area.height);
+
+  g_signal_handlers_disconnect_by_func (stage, (void *)grab_batch_screenshot, (gpointer)screenshot);
+
+  if (priv->image != NULL)
+    {
+      cairo_surface_flush (priv->image);
+      cairo_surface_get_device_scale (priv->image, &scale, NULL);
+      data = cairo_image_surface_get_data (priv->image);
+      stride = cairo_image_surface_get_stride (priv->image);
+    }
+
+  task = g_task_new (screenshot, NULL, on_batch_written, NULL);
+  priv->batch_pending = priv->batch->len;
+
+  for (i = 0; i < priv->batch->len; i++)
+    {
+      BatchItem *item = priv->batch->pdata[i];
+
+      item->task = task;
+
+      if (data != NULL)
+        {
+          int x = (item->area.x - priv->screenshot_area.x) * scale;
+          int y = (item->area.y - priv->screenshot_area.y) * scale;
+
+          item->image =
+            cairo_image_surface_create_for_data (data + y * stride + x * 4,
+                                                 cairo_image_surface_get_format (priv->image),
+                                                 item->area.width * scale,
+                                                 item->area.height * scale,
+                                                 stride);
+        }
+
+      g_thread_pool_push (batch_pool, item, NULL);
+    }
+}
+
 static void
 grab_window_screenshot (ClutterActor *stage,
                         ShellScreenshot *screenshot)
@@ -468,7 +752,7 @@ shell_screenshot_screenshot (ShellScreenshot *screenshot,
   ClutterActor *stage;
   ShellScreenshotPrivate *priv = screenshot->priv;
 
-  if (priv->filename != NULL) {
+  if (screenshot_in_progress (priv)) {
     if (callback)
       callback (screenshot, FALSE, NULL, "");
     return;
@@ -514,7 +798,7 @@ shell_screenshot_screenshot_area (ShellScreenshot *screenshot,
   ClutterActor *stage;
   ShellScreenshotPrivate *priv = screenshot->priv;
 
-  if (priv->filename != NULL) {
+  if (screenshot_in_progress (priv)) {
     if (callback)
       callback (screenshot, FALSE, NULL, "");
     return;
@@ -562,7 +846,7 @@ shell_screenshot_screenshot_window (ShellScreenshot *screenshot,
   MetaDisplay *display = meta_screen_get_display (screen);
   MetaWindow *window = meta_display_get_focus_window (display);
 
-  if (priv->filename != NULL || !window) {
+  if (screenshot_in_progress (priv) || !window) {
     if (callback)
       callback (screenshot, FALSE, NULL, "");
     return;
@@ -582,8 +866,207 @@ shell_screenshot_screenshot_window (ShellScreenshot *screenshot,
   clutter_actor_queue_redraw (stage);
 }
 
+/**
+ * shell_screenshot_screenshot_areas:
+ * @screenshot: the #ShellScreenshot
+ * @areas: (array length=n_values): the X, Y, width and height of each area
+ * @n_values: the number of values in @areas, four times the number of areas
+ * @filenames: (array zero-terminated=1): a filename for each area
+ * @callback: (scope async): function to call once all the screenshots
+ * are written, or failed
+ *
+ * Takes screenshots of several areas at once, and saves them in
+ * @filenames. The stage is captured a single time, for the extents of
+ * all the areas, and the screenshots are written concurrently; this
+ * is much faster than taking them one by one.
+ *
+ * Each screenshot is written in the format matching the extension of
+ * its filename, if it has the extension of one of the
+ * #ShellScreenshotFormat formats, and in the format set with
+ * shell_screenshot_set_format() otherwise.
+ */
+void
+shell_screenshot_screenshot_areas (ShellScreenshot              *screenshot,
+                                   const int                    *areas,
+                                   int                           n_values,
+                                   const char * const           *filenames,
+                                   ShellScreenshotBatchCallback  callback)
+{
+  ShellScreenshotPrivate *priv = screenshot->priv;
+  ClutterActor *stage;
+  cairo_region_t *region;
+  int n_areas, i;
+
+  n_areas = n_values / 4;
+
+  if (screenshot_in_progress (priv) ||
+      n_areas == 0 || n_values % 4 != 0 ||
+      (int) g_strv_length ((char **) filenames) != n_areas)
+    {
+      if (callback)
+        callback (screenshot, FALSE, (const char * const []) { NULL });
+      return;
+    }
+
+  priv->batch = g_ptr_array_new_with_free_func ((GDestroyNotify) batch_item_free);
+  priv->batch_callback = callback;
+
+  region = cairo_region_create ();
+
+  for (i = 0; i < n_areas; i++)
+    {
+      BatchItem *item = g_slice_new0 (BatchItem);
+
+      item->screenshot = screenshot;
+      item->area.x = areas[i * 4];
+      item->area.y = areas[i * 4 + 1];
+      item->area.width = areas[i * 4 + 2];
+      item->area.height = areas[i * 4 + 3];
+      item->filename = g_strdup (filenames[i]);
+      item->format = _shell_screenshot_format_for_filename (filenames[i], priv->format);
+      g_ptr_array_add (priv->batch, item);
+
+      cairo_region_union_rectangle (region, &item->area);
+    }
+
+  cairo_region_get_extents (region, &priv->screenshot_area);
+  cairo_region_destroy (region);
+
+  stage = CLUTTER_ACTOR (shell_global_get_stage (priv->global));
+
+  meta_disable_unredirect_for_screen (shell_global_get_screen (priv->global));
+
+  g_signal_connect_after (stage, "paint", G_CALLBACK (grab_batch_screenshot), (gpointer)screenshot);
+
+  clutter_actor_queue_redraw (stage);
+}
+
+/**
+ * shell_screenshot_screenshot_to_fd:
+ * @screenshot: the #ShellScreenshot
+ * @include_cursor: Whether to include the cursor or not
+ * @callback: (scope async): function to call with the file descriptor
+ * of the screenshot, or -1 on failure
+ *
+ * Takes a screenshot of the whole screen, like
+ * shell_screenshot_screenshot(), but writes it to a sealed memory
+ * file rather than to disk. The file descriptor is closed once
+ * @callback returns, so it has to be duplicated to be kept.
+ */
+void
+shell_screenshot_screenshot_to_fd (ShellScreenshot           *screenshot,
+                                   gboolean                   include_cursor,
+                                   ShellScreenshotFdCallback  callback)
+{
+  ClutterActor *stage;
+  ShellScreenshotPrivate *priv = screenshot->priv;
+
+  g_return_if_fail (callback != NULL);
+
+  if (screenshot_in_progress (priv)) {
+    callback (screenshot, FALSE, NULL, -1);
+    return;
+  }
+
+  priv->fd_callback = callback;
+  priv->include_cursor = include_cursor;
+
+  stage = CLUTTER_ACTOR (shell_global_get_stage (priv->global));
+
+  meta_disable_unredirect_for_screen (shell_global_get_screen (priv->global));
+
+  g_signal_connect_after (stage, "paint", G_CALLBACK (grab_screenshot), (gpointer)screenshot);
+
+  clutter_actor_queue_redraw (stage);
+}
+
+/**
+ * shell_screenshot_screenshot_area_to_fd:
+ * @screenshot: the #ShellScreenshot
+ * @x: The X coordinate of the area
+ * @y: The Y coordinate of the area
+ * @width: The width of the area
+ * @height: The height of the area
+ * @callback: (scope async): function to call with the file descriptor
+ * of the screenshot, or -1 on failure
+ *
+ * Takes a screenshot of the passed in area, like
+ * shell_screenshot_screenshot_area(), but writes it to a sealed
+ * memory file rather than to disk. The file descriptor is closed once
+ * @callback returns, so it has to be duplicated to be kept.
+ */
+void
+shell_screenshot_screenshot_area_to_fd (ShellScreenshot           *screenshot,
+                                        int                        x,
+                                        int                        y,
+                                        int                        width,
+                                        int                        height,
+                                        ShellScreenshotFdCallback  callback)
+{
+  ClutterActor *stage;
+  ShellScreenshotPrivate *priv = screenshot->priv;
+
+  g_return_if_fail (callback != NULL);
+
+  if (screenshot_in_progress (priv)) {
+    callback (screenshot, FALSE, NULL, -1);
+    return;
+  }
+
+  priv->screenshot_area.x = x;
+  priv->screenshot_area.y = y;
+  priv->screenshot_area.width = width;
+  priv->screenshot_area.height = height;
+  priv->fd_callback = callback;
+
+  stage = CLUTTER_ACTOR (shell_global_get_stage (priv->global));
+
+  meta_disable_unredirect_for_screen (shell_global_get_screen (priv->global));
+
+  g_signal_connect_after (stage, "paint", G_CALLBACK (grab_area_screenshot), (gpointer)screenshot);
+
+  clutter_actor_queue_redraw (stage);
+}
+
 ShellScreenshot *
 shell_screenshot_new (void)
 {
   return g_object_new (SHELL_TYPE_SCREENSHOT, NULL);
 }
+
+/**
+ * shell_screenshot_set_format:
+ * @screenshot: the #ShellScreenshot
+ * @format: the #ShellScreenshotFormat of the files to write
+ *
+ * Sets the format of the following screenshots; PNG by default. The
+ * extension of the files follows the format when they are named
+ * automatically. Files named with the extension of one of the formats
+ * are written in that format instead.
+ */
+void
+shell_screenshot_set_format (ShellScreenshot       *screenshot,
+                             ShellScreenshotFormat  format)
+{
+  g_return_if_fail (SHELL_IS_SCREENSHOT (screenshot));
+
+  screenshot->priv->format = format;
+}
+
+/**
+ * shell_screenshot_set_compression_level:
+ * @screenshot: the #ShellScreenshot
+ * @level: the zlib compression level, from 0 to 9, or -1 for the default
+ *
+ * Sets how much PNG screenshots are compressed. Lower levels are
+ * faster to write, and 0 stores the image uncompressed.
+ */
+void
+shell_screenshot_set_compression_level (ShellScreenshot *screenshot,
+                                        int              level)
+{
+  g_return_if_fail (SHELL_IS_SCREENSHOT (screenshot));
+  g_return_if_fail (level >= -1 && level <= 9);
+
+  screenshot->priv->compression_level = level;
+}
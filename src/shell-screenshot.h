@@ -10,17 +10,54 @@
  * areas or windows and write them out as png files.
  *
  */
+/**
+ * ShellScreenshotFormat:
+ * @SHELL_SCREENSHOT_FORMAT_PNG: a PNG image
+ * @SHELL_SCREENSHOT_FORMAT_QOI: a QOI image, which is much faster to
+ *   write than PNG, at a similar size
+ * @SHELL_SCREENSHOT_FORMAT_PAM: a netpbm PAM image; the uncompressed
+ *   pixels with a short header giving their size and layout
+ *
+ * The formats screenshots can be written in.
+ */
+typedef enum {
+  SHELL_SCREENSHOT_FORMAT_PNG,
+  SHELL_SCREENSHOT_FORMAT_QOI,
+  SHELL_SCREENSHOT_FORMAT_PAM
+} ShellScreenshotFormat;
+
 #define SHELL_TYPE_SCREENSHOT (shell_screenshot_get_type ())
 G_DECLARE_FINAL_TYPE (ShellScreenshot, shell_screenshot,
                       SHELL, SCREENSHOT, GObject)
 
 ShellScreenshot *shell_screenshot_new (void);
 
+void    shell_screenshot_set_format            (ShellScreenshot       *screenshot,
+                                                ShellScreenshotFormat  format);
+void    shell_screenshot_set_compression_level (ShellScreenshot       *screenshot,
+                                                int                    level);
+
 typedef void (*ShellScreenshotCallback)  (ShellScreenshot *screenshot,
                                           gboolean success,
                                           cairo_rectangle_int_t *screenshot_area,
                                           const gchar *filename_used);
 
+/**
+ * ShellScreenshotFdCallback:
+ * @screenshot: the #ShellScreenshot
+ * @success: whether the screenshot was written
+ * @screenshot_area: the area of the screenshot
+ * @fd: a file descriptor to read the screenshot from, or -1
+ *
+ * The callback of shell_screenshot_screenshot_to_fd() and
+ * shell_screenshot_screenshot_area_to_fd(); @fd is closed when it
+ * returns.
+ */
+typedef void (*ShellScreenshotFdCallback) (ShellScreenshot *screenshot,
+                                           gboolean success,
+                                           cairo_rectangle_int_t *screenshot_area,
+                                           int fd);
+
 void    shell_screenshot_screenshot_area      (ShellScreenshot *screenshot,
                                                 int x,
                                                 int y,
@@ -40,4 +77,34 @@ void    shell_screenshot_screenshot           (ShellScreenshot *screenshot,
                                                 const char *filename,
                                                 ShellScreenshotCallback callback);
 
+void    shell_screenshot_screenshot_area_to_fd (ShellScreenshot *screenshot,
+                                                int x,
+                                                int y,
+                                                int width,
+                                                int height,
+                                                ShellScreenshotFdCallback callback);
+
+void    shell_screenshot_screenshot_to_fd     (ShellScreenshot *screenshot,
+                                                gboolean include_cursor,
+                                                ShellScreenshotFdCallback callback);
+
+/**
+ * ShellScreenshotBatchCallback:
+ * @screenshot: the #ShellScreenshot
+ * @success: whether all the screenshots were written
+ * @filenames_used: (array zero-terminated=1): the files written, in
+ *   the order of the areas, or empty strings for those which failed
+ *
+ * The callback of shell_screenshot_screenshot_areas().
+ */
+typedef void (*ShellScreenshotBatchCallback) (ShellScreenshot *screenshot,
+                                              gboolean success,
+                                              const char * const *filenames_used);
+
+void    shell_screenshot_screenshot_areas     (ShellScreenshot *screenshot,
+                                                const int *areas,
+                                                int n_values,
+                                                const char * const *filenames,
+                                                ShellScreenshotBatchCallback callback);
+
 #endif /* ___SHELL_SCREENSHOT_H__ */
@@ -2,6 +2,8 @@
 
 #include "config.h"
 
+#include <math.h>
+#include <string.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 
@@ -462,6 +464,295 @@ shell_util_get_content_for_window_actor (MetaWindowActor *window_actor,
   return content;
 }
 
+/* Copying the captures is split across threads when they add up to more
+ * than this many bytes, which is about a 1080p monitor */
+#define COMPOSITE_THREAD_MIN_SIZE (8 * 1024 * 1024)
+#define COMPOSITE_MAX_THREADS 4
+
+typedef struct {
+  GMutex mutex;
+  GCond cond;
+  int n_pending;
+} CompositeTask;
+
+typedef struct {
+  CompositeTask *task;
+  const guint8 *src;
+  int src_stride;
+  guint8 *dest;
+  int dest_stride;
+  int row_size;
+  int n_rows;
+} CompositeCopy;
+
+static void
+composite_copy_rows (CompositeCopy *copy)
+{
+  int i;
+
+  if (copy->src_stride == copy->row_size &&
+      copy->dest_stride == copy->row_size)
+    {
+      memcpy (copy->dest, copy->src, (gsize) copy->row_size * copy->n_rows);
+      return;
+    }
+
+  for (i = 0; i < copy->n_rows; i++)
+    memcpy (copy->dest + i * copy->dest_stride,
+            copy->src + i * copy->src_stride,
+            copy->row_size);
+}
+
+static void
+composite_copy_thread_func (gpointer data,
+                            gpointer user_data)
+{
+  CompositeCopy *copy = data;
+  CompositeTask *task = copy->task;
+
+  composite_copy_rows (copy);
+
+  g_mutex_lock (&task->mutex);
+  if (--task->n_pending == 0)
+    g_cond_signal (&task->cond);
+  g_mutex_unlock (&task->mutex);
+}
+
+/* Only called from the main thread */
+static GThreadPool *
+get_composite_thread_pool (int *n_threads)
+{
+  static GThreadPool *pool = NULL;
+  static int pool_threads = 0;
+
+  if (pool_threads == 0)
+    {
+      pool_threads = MIN (g_get_num_processors (), COMPOSITE_MAX_THREADS);
+      if (pool_threads > 1)
+        pool = g_thread_pool_new (composite_copy_thread_func, NULL,
+                                  pool_threads, FALSE, NULL);
+    }
+
+  *n_threads = pool_threads;
+  return pool;
+}
+
+/* Copies the rows of the captures, splitting them across the worker
+ * threads if there are enough, and waits for them */
+static void
+composite_copies_run (GArray *copies,
+                      gsize   total_size)
+{
+  GThreadPool *pool;
+  CompositeTask task;
+  CompositeCopy *chunks;
+  int n_threads, n_chunks;
+  guint i;
+  int j;
+
+  pool = get_composite_thread_pool (&n_threads);
+  if (pool == NULL || total_size < COMPOSITE_THREAD_MIN_SIZE)
+    {
+      for (i = 0; i < copies->len; i++)
+        composite_copy_rows (&g_array_index (copies, CompositeCopy, i));
+      return;
+    }
+
+  g_mutex_init (&task.mutex);
+  g_cond_init (&task.cond);
+
+  chunks = g_new (CompositeCopy, copies->len * n_threads);
+  n_chunks = 0;
+
+  for (i = 0; i < copies->len; i++)
+    {
+      CompositeCopy *copy = &g_array_index (copies, CompositeCopy, i);
+      int rows_per_chunk = (copy->n_rows + n_threads - 1) / n_threads;
+
+      for (j = 0; j < copy->n_rows; j += rows_per_chunk)
+        {
+          CompositeCopy *chunk = &chunks[n_chunks++];
+
+          *chunk = *copy;
+          chunk->task = &task;
+          chunk->src = copy->src + j * copy->src_stride;
+          chunk->dest = copy->dest + j * copy->dest_stride;
+          chunk->n_rows = MIN (rows_per_chunk, copy->n_rows - j);
+        }
+    }
+
+  task.n_pending = n_chunks;
+  for (j = 0; j < n_chunks; j++)
+    g_thread_pool_push (pool, &chunks[j], NULL);
+
+  g_mutex_lock (&task.mutex);
+  while (task.n_pending > 0)
+    g_cond_wait (&task.cond, &task.mutex);
+  g_mutex_unlock (&task.mutex);
+
+  g_free (chunks);
+  g_mutex_clear (&task.mutex);
+  g_cond_clear (&task.cond);
+}
+
+static gboolean
+capture_overlaps (ClutterCapture *captures,
+                  int             n_captures,
+                  int             index)
+{
+  cairo_rectangle_int_t *rect = &captures[index].rect;
+  int i;
+
+  for (i = 0; i < n_captures; i++)
+    {
+      cairo_rectangle_int_t *other = &captures[i].rect;
+
+      if (i == index)
+        continue;
+
+      if (rect->x < other->x + other->width &&
+          other->x < rect->x + rect->width &&
+          rect->y < other->y + other->height &&
+          other->y < rect->y + rect->height)
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+/**
+ * shell_util_composite_capture_images_into:
+ * @captures: (array length=n_captures): the captures of the stage
+ * @n_captures: the number of captures
+ * @x: the x coordinate of @image on the stage
+ * @y: the y coordinate of @image on the stage
+ * @image: an image surface to composite into
+ *
+ * Composites the captures returned by clutter_stage_capture() into
+ * @image, at its device scale. Captures at that scale which don't
+ * overlap any other are copied row by row, on worker threads for
+ * large areas; only the others are drawn with cairo, and scaled.
+ * The parts of @image not covered by any capture are left untouched.
+ */
+void
+shell_util_composite_capture_images_into (ClutterCapture  *captures,
+                                          int              n_captures,
+                                          int              x,
+                                          int              y,
+                                          cairo_surface_t *image)
+{
+  double target_scale = 1.0;
+  cairo_format_t format;
+  guint8 *data;
+  int stride, image_width, image_height;
+  GArray *copies;
+  gboolean *scaled;
+  gboolean have_scaled = FALSE;
+  gsize total_size = 0;
+  int i;
+
+  cairo_surface_get_device_scale (image, &target_scale, NULL);
+  cairo_surface_flush (image);
+
+  format = cairo_image_surface_get_format (image);
+  data = cairo_image_surface_get_data (image);
+  stride = cairo_image_surface_get_stride (image);
+  image_width = cairo_image_surface_get_width (image);
+  image_height = cairo_image_surface_get_height (image);
+
+  copies = g_array_sized_new (FALSE, FALSE, sizeof (CompositeCopy), n_captures);
+  scaled = g_new0 (gboolean, n_captures);
+
+  for (i = 0; i < n_captures; i++)
+    {
+      ClutterCapture *capture = &captures[i];
+      CompositeCopy copy = { 0, };
+      double capture_scale = 1.0;
+      int dest_x, dest_y, src_x, src_y, width, height;
+
+      cairo_surface_get_device_scale (capture->image, &capture_scale, NULL);
+
+      if (capture_scale != target_scale ||
+          cairo_image_surface_get_format (capture->image) != format ||
+          (format != CAIRO_FORMAT_ARGB32 && format != CAIRO_FORMAT_RGB24) ||
+          capture_overlaps (captures, n_captures, i))
+        {
+          scaled[i] = have_scaled = TRUE;
+          continue;
+        }
+
+      dest_x = (int) round ((capture->rect.x - x) * target_scale);
+      dest_y = (int) round ((capture->rect.y - y) * target_scale);
+      src_x = MAX (0, -dest_x);
+      src_y = MAX (0, -dest_y);
+      width = MIN (cairo_image_surface_get_width (capture->image), image_width - dest_x) - src_x;
+      height = MIN (cairo_image_surface_get_height (capture->image), image_height - dest_y) - src_y;
+
+      if (width <= 0 || height <= 0)
+        continue;
+
+      cairo_surface_flush (capture->image);
+
+      copy.src_stride = cairo_image_surface_get_stride (capture->image);
+      copy.src = (cairo_image_surface_get_data (capture->image) +
+                  src_y * copy.src_stride + src_x * 4);
+      copy.dest_stride = stride;
+      copy.dest = data + (dest_y + src_y) * stride + (dest_x + src_x) * 4;
+      copy.row_size = width * 4;
+      copy.n_rows = height;
+      g_array_append_val (copies, copy);
+
+      total_size += (gsize) copy.row_size * copy.n_rows;
+    }
+
+  composite_copies_run (copies, total_size);
+  g_array_free (copies, TRUE);
+
+  cairo_surface_mark_dirty (image);
+
+  if (have_scaled)
+    {
+      cairo_t *cr = cairo_create (image);
+
+      for (i = 0; i < n_captures; i++)
+        {
+          ClutterCapture *capture = &captures[i];
+
+          if (!scaled[i])
+            continue;
+
+          cairo_save (cr);
+
+          cairo_translate (cr,
+                           capture->rect.x - x,
+                           capture->rect.y - y);
+          cairo_set_source_surface (cr, capture->image, 0, 0);
+          cairo_paint (cr);
+
+          cairo_restore (cr);
+        }
+
+      cairo_destroy (cr);
+    }
+
+  g_free (scaled);
+}
+
+/**
+ * shell_util_composite_capture_images:
+ * @captures: (array length=n_captures): the captures of the stage
+ * @n_captures: the number of captures
+ * @x: the x coordinate of the area on the stage
+ * @y: the y coordinate of the area on the stage
+ * @width: the width of the area
+ * @height: the height of the area
+ *
+ * Composites the captures returned by clutter_stage_capture() into a
+ * new image of the area, at the largest scale among them; see
+ * shell_util_composite_capture_images_into().
+ *
+ * Returns: (transfer full): a new image surface
+ */
 cairo_surface_t *
 shell_util_composite_capture_images (ClutterCapture  *captures,
                                      int              n_captures,
@@ -474,7 +765,6 @@ shell_util_composite_capture_images (ClutterCapture  *captures,
   double target_scale;
   cairo_format_t format;
   cairo_surface_t *image;
-  cairo_t *cr;
 
   g_assert (n_captures > 0);
 
@@ -494,23 +784,8 @@ shell_util_composite_capture_images (ClutterCapture  *captures,
                                       height * target_scale);
   cairo_surface_set_device_scale (image, target_scale, target_scale);
 
-  cr = cairo_create (image);
-
-  for (i = 0; i < n_captures; i++)
-    {
-      ClutterCapture *capture = &captures[i];
-
-      cairo_save (cr);
-
-      cairo_translate (cr,
-                       capture->rect.x - x,
-                       capture->rect.y - y);
-      cairo_set_source_surface (cr, capture->image, 0, 0);
-      cairo_paint (cr);
-
-      cairo_restore (cr);
-    }
-  cairo_destroy (cr);
+  shell_util_composite_capture_images_into (captures, n_captures,
+                                            x, y, image);
 
   return image;
 }
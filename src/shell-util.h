@@ -59,6 +59,11 @@ cairo_surface_t * shell_util_composite_capture_images (ClutterCapture  *captures
                                                        int              y,
                                                        int              width,
                                                        int              height);
+void              shell_util_composite_capture_images_into (ClutterCapture  *captures,
+                                                            int              n_captures,
+                                                            int              x,
+                                                            int              y,
+                                                            cairo_surface_t *image);
 
 G_END_DECLS
 
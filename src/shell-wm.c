@@ -9,6 +9,7 @@
 
 #include "shell-wm-private.h"
 #include "shell-global.h"
+#include "shell-perf-log.h"
 
 struct _ShellWM {
   GObject parent;
@@ -43,6 +44,21 @@ G_DEFINE_TYPE(ShellWM, shell_wm, G_TYPE_OBJECT);
 
 static guint shell_wm_signals [LAST_SIGNAL] = { 0 };
 
+/* Spans measuring the JS handlers of the signals starting window
+ * effects; 0 for the other signals.
+ */
+static guint shell_wm_spans [LAST_SIGNAL] = { 0 };
+
+static void
+define_span (guint       signal,
+             const char *name,
+             const char *description)
+{
+  shell_wm_spans[signal] =
+    shell_perf_log_define_span (shell_perf_log_get_default (),
+                                name, description);
+}
+
 static void
 shell_wm_init (ShellWM *wm)
 {
@@ -202,6 +218,19 @@ shell_wm_class_init (ShellWMClass *klass)
                   0,
                   NULL, NULL, NULL,
                   META_TYPE_INHIBIT_SHORTCUTS_DIALOG, 1, META_TYPE_WINDOW);
+
+  define_span (MINIMIZE, "wm.minimize",
+               "Handling the minimize signal");
+  define_span (UNMINIMIZE, "wm.unminimize",
+               "Handling the unminimize signal");
+  define_span (SIZE_CHANGE, "wm.sizeChange",
+               "Handling the size-change signal");
+  define_span (MAP, "wm.map",
+               "Handling the map signal");
+  define_span (DESTROY, "wm.destroy",
+               "Handling the destroy signal");
+  define_span (SWITCH_WORKSPACE, "wm.switchWorkspace",
+               "Handling the switch-workspace signal");
 }
 
 void
@@ -210,8 +239,13 @@ _shell_wm_switch_workspace (ShellWM      *wm,
                             gint          to,
                             MetaMotionDirection direction)
 {
+  ShellPerfLog *perf_log = shell_perf_log_get_default ();
+  guint span_id;
+
+  span_id = shell_perf_log_begin_span (perf_log, shell_wm_spans[SWITCH_WORKSPACE]);
   g_signal_emit (wm, shell_wm_signals[SWITCH_WORKSPACE], 0,
                  from, to, direction);
+  shell_perf_log_end_span (perf_log, shell_wm_spans[SWITCH_WORKSPACE], span_id);
 }
 
 /**
@@ -362,14 +396,24 @@ void
 _shell_wm_minimize (ShellWM         *wm,
                     MetaWindowActor *actor)
 {
+  ShellPerfLog *perf_log = shell_perf_log_get_default ();
+  guint span_id;
+
+  span_id = shell_perf_log_begin_span (perf_log, shell_wm_spans[MINIMIZE]);
   g_signal_emit (wm, shell_wm_signals[MINIMIZE], 0, actor);
+  shell_perf_log_end_span (perf_log, shell_wm_spans[MINIMIZE], span_id);
 }
 
 void
 _shell_wm_unminimize (ShellWM         *wm,
                       MetaWindowActor *actor)
 {
+  ShellPerfLog *perf_log = shell_perf_log_get_default ();
+  guint span_id;
+
+  span_id = shell_perf_log_begin_span (perf_log, shell_wm_spans[UNMINIMIZE]);
   g_signal_emit (wm, shell_wm_signals[UNMINIMIZE], 0, actor);
+  shell_perf_log_end_span (perf_log, shell_wm_spans[UNMINIMIZE], span_id);
 }
 
 void
@@ -386,21 +430,36 @@ _shell_wm_size_change (ShellWM         *wm,
                        MetaRectangle   *old_frame_rect,
                        MetaRectangle   *old_buffer_rect)
 {
+  ShellPerfLog *perf_log = shell_perf_log_get_default ();
+  guint span_id;
+
+  span_id = shell_perf_log_begin_span (perf_log, shell_wm_spans[SIZE_CHANGE]);
   g_signal_emit (wm, shell_wm_signals[SIZE_CHANGE], 0, actor, which_change, old_frame_rect, old_buffer_rect);
+  shell_perf_log_end_span (perf_log, shell_wm_spans[SIZE_CHANGE], span_id);
 }
 
 void
 _shell_wm_map (ShellWM         *wm,
                MetaWindowActor *actor)
 {
+  ShellPerfLog *perf_log = shell_perf_log_get_default ();
+  guint span_id;
+
+  span_id = shell_perf_log_begin_span (perf_log, shell_wm_spans[MAP]);
   g_signal_emit (wm, shell_wm_signals[MAP], 0, actor);
+  shell_perf_log_end_span (perf_log, shell_wm_spans[MAP], span_id);
 }
 
 void
 _shell_wm_destroy (ShellWM         *wm,
                    MetaWindowActor *actor)
 {
+  ShellPerfLog *perf_log = shell_perf_log_get_default ();
+  guint span_id;
+
+  span_id = shell_perf_log_begin_span (perf_log, shell_wm_spans[DESTROY]);
   g_signal_emit (wm, shell_wm_signals[DESTROY], 0, actor);
+  shell_perf_log_end_span (perf_log, shell_wm_spans[DESTROY], span_id);
 }
 
 gboolean
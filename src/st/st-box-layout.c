@@ -386,6 +386,7 @@ st_box_layout_paint (ClutterActor *actor)
   ClutterActorBox content_box;
   ClutterActor *child;
   CoglFramebuffer *fb = cogl_get_draw_framebuffer ();
+  ST_PROFILER_BEGIN ();
 
   get_border_paint_offsets (self, &x, &y);
   if (x != 0 || y != 0)
@@ -402,7 +403,10 @@ st_box_layout_paint (ClutterActor *actor)
     }
 
   if (clutter_actor_get_n_children (actor) == 0)
-    return;
+    {
+      ST_PROFILER_END (actor, ST_PROFILER_PAINT);
+      return;
+    }
 
   clutter_actor_get_allocation_box (actor, &allocation_box);
   st_theme_node_get_content_box (theme_node, &allocation_box, &content_box);
@@ -429,6 +433,8 @@ st_box_layout_paint (ClutterActor *actor)
 
   if (priv->hadjustment || priv->vadjustment)
     cogl_framebuffer_pop_clip (fb);
+
+  ST_PROFILER_END (actor, ST_PROFILER_PAINT);
 }
 
 static void
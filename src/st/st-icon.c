@@ -159,6 +159,7 @@ static void
 st_icon_paint (ClutterActor *actor)
 {
   StIconPrivate *priv = ST_ICON (actor)->priv;
+  ST_PROFILER_BEGIN ();
 
   st_widget_paint_background (ST_WIDGET (actor));
 
@@ -180,6 +181,8 @@ st_icon_paint (ClutterActor *actor)
 
       clutter_actor_paint (priv->icon_texture);
     }
+
+  ST_PROFILER_END (actor, ST_PROFILER_PAINT);
 }
 
 static void
@@ -191,6 +191,7 @@ st_label_paint (ClutterActor *actor)
   StLabelPrivate *priv = ST_LABEL (actor)->priv;
   StThemeNode *theme_node = st_widget_get_theme_node (ST_WIDGET (actor));
   StShadow *shadow_spec = st_theme_node_get_text_shadow (theme_node);
+  ST_PROFILER_BEGIN ();
 
   st_widget_paint_background (ST_WIDGET (actor));
 
@@ -221,6 +222,8 @@ st_label_paint (ClutterActor *actor)
     }
 
   clutter_actor_paint (priv->label);
+
+  ST_PROFILER_END (actor, ST_PROFILER_PAINT);
 }
 
 static void
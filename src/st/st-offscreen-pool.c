@@ -0,0 +1,289 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * st-offscreen-pool.c: Shared pool of offscreen textures
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Effects and transitions render into offscreen textures which are
+ * typically only needed for a short time, but needed again and again
+ * with the same sizes (scrolling a faded list, hovering buttons). Instead
+ * of allocating and freeing GPU memory each time, textures are handed
+ * back to the pool when they are no longer needed and recycled for the
+ * next request of the same size. Idle textures are released, least
+ * recently used first, once the pool grows past its memory budget.
+ *
+ * Callers which can render into a part of a texture pass @allow_larger
+ * and get a texture rounded up to the next size bucket, which makes
+ * reuse across slightly different sizes possible.
+ */
+
+#include "st-offscreen-pool.h"
+
+#define DEFAULT_MEMORY_BUDGET (32 * 1024 * 1024)
+#define SIZE_BUCKET 64
+
+typedef struct {
+  CoglTexture     *texture;
+  CoglOffscreen   *offscreen;
+  CoglPixelFormat  format;
+  guint            width;
+  guint            height;
+  gsize            bytes;
+  gboolean         in_use;
+  GList            link;
+} PoolEntry;
+
+typedef struct {
+  /* CoglTexture => PoolEntry */
+  GHashTable *entries;
+  /* Idle entries, most recently released first */
+  GQueue      idle;
+  gsize       memory_budget;
+
+  StOffscreenPoolStatistics statistics;
+} StOffscreenPool;
+
+static StOffscreenPool *
+get_pool (void)
+{
+  static StOffscreenPool *pool = NULL;
+
+  if (G_UNLIKELY (pool == NULL))
+    {
+      pool = g_new0 (StOffscreenPool, 1);
+      pool->entries = g_hash_table_new (NULL, NULL);
+      g_queue_init (&pool->idle);
+      pool->memory_budget = DEFAULT_MEMORY_BUDGET;
+    }
+
+  return pool;
+}
+
+static guint
+round_to_bucket (guint size)
+{
+  return (size + SIZE_BUCKET - 1) & ~(SIZE_BUCKET - 1);
+}
+
+static void
+pool_entry_free (StOffscreenPool *pool,
+                 PoolEntry       *entry)
+{
+  g_hash_table_remove (pool->entries, entry->texture);
+  pool->statistics.bytes_resident -= entry->bytes;
+
+  if (entry->offscreen)
+    cogl_object_unref (entry->offscreen);
+  cogl_object_unref (entry->texture);
+
+  g_slice_free (PoolEntry, entry);
+}
+
+static void
+pool_trim (StOffscreenPool *pool)
+{
+  while (pool->statistics.bytes_resident > pool->memory_budget &&
+         pool->idle.tail != NULL)
+    {
+      PoolEntry *entry = pool->idle.tail->data;
+
+      g_queue_unlink (&pool->idle, &entry->link);
+      pool->statistics.bytes_idle -= entry->bytes;
+
+      pool_entry_free (pool, entry);
+    }
+}
+
+/**
+ * st_offscreen_pool_acquire: (skip)
+ * @width: the minimum width of the texture
+ * @height: the minimum height of the texture
+ * @format: the internal format of the texture
+ * @allow_larger: whether the caller can cope with a texture which is
+ *   larger than requested
+ *
+ * Gets a texture suitable for rendering into from the pool, allocating
+ * a new one if no idle texture of the right size is available. The
+ * contents of the texture are undefined.
+ *
+ * Returns: (transfer full): a #CoglTexture, or %NULL if allocating
+ *   failed. Hand it back with st_offscreen_pool_release() when done.
+ */
+CoglTexture *
+st_offscreen_pool_acquire (guint            width,
+                           guint            height,
+                           CoglPixelFormat  format,
+                           gboolean         allow_larger)
+{
+  StOffscreenPool *pool = get_pool ();
+  PoolEntry *entry;
+  GList *l;
+
+  g_return_val_if_fail (width > 0 && height > 0, NULL);
+
+  if (allow_larger)
+    {
+      width = round_to_bucket (width);
+      height = round_to_bucket (height);
+    }
+
+  pool->statistics.n_acquired++;
+
+  for (l = pool->idle.head; l; l = l->next)
+    {
+      entry = l->data;
+
+      if (entry->width == width &&
+          entry->height == height &&
+          entry->format == format)
+        {
+          g_queue_unlink (&pool->idle, &entry->link);
+          pool->statistics.bytes_idle -= entry->bytes;
+          pool->statistics.n_reused++;
+
+          entry->in_use = TRUE;
+
+          return cogl_object_ref (entry->texture);
+        }
+    }
+
+  entry = g_slice_new0 (PoolEntry);
+  entry->texture = cogl_texture_new_with_size (width, height,
+                                               COGL_TEXTURE_NO_SLICING,
+                                               format);
+  if (entry->texture == NULL)
+    {
+      g_slice_free (PoolEntry, entry);
+      return NULL;
+    }
+
+  entry->format = format;
+  entry->width = width;
+  entry->height = height;
+  entry->bytes = (gsize) width * height * 4;
+  entry->in_use = TRUE;
+  entry->link.data = entry;
+
+  g_hash_table_insert (pool->entries, entry->texture, entry);
+
+  pool->statistics.bytes_allocated += entry->bytes;
+  pool->statistics.bytes_resident += entry->bytes;
+
+  /* Make room for the new texture by dropping idle ones */
+  pool_trim (pool);
+
+  return cogl_object_ref (entry->texture);
+}
+
+/**
+ * st_offscreen_pool_get_offscreen: (skip)
+ * @texture: a texture returned by st_offscreen_pool_acquire()
+ *
+ * Gets a framebuffer rendering to @texture. The framebuffer is kept
+ * with the texture in the pool, so it doesn't need to be recreated
+ * when the texture is reused.
+ *
+ * Returns: (transfer none): a #CoglOffscreen, or %NULL if it couldn't
+ *   be allocated
+ */
+CoglOffscreen *
+st_offscreen_pool_get_offscreen (CoglTexture *texture)
+{
+  StOffscreenPool *pool = get_pool ();
+  PoolEntry *entry;
+  CoglError *error = NULL;
+
+  entry = g_hash_table_lookup (pool->entries, texture);
+  g_return_val_if_fail (entry != NULL && entry->in_use, NULL);
+
+  if (entry->offscreen == NULL)
+    {
+      entry->offscreen = cogl_offscreen_new_with_texture (entry->texture);
+
+      if (!cogl_framebuffer_allocate (COGL_FRAMEBUFFER (entry->offscreen), &error))
+        {
+          g_warning ("Failed to allocate offscreen framebuffer: %s", error->message);
+          cogl_error_free (error);
+          cogl_object_unref (entry->offscreen);
+          entry->offscreen = NULL;
+        }
+    }
+
+  return entry->offscreen;
+}
+
+/**
+ * st_offscreen_pool_release: (skip)
+ * @texture: a texture returned by st_offscreen_pool_acquire()
+ *
+ * Hands @texture back to the pool, dropping the reference returned by
+ * st_offscreen_pool_acquire(). The texture must not be rendered to
+ * anymore by the caller, since it may be given to someone else.
+ */
+void
+st_offscreen_pool_release (CoglTexture *texture)
+{
+  StOffscreenPool *pool = get_pool ();
+  PoolEntry *entry;
+
+  g_return_if_fail (texture != NULL);
+
+  entry = g_hash_table_lookup (pool->entries, texture);
+  if (entry == NULL)
+    {
+      cogl_object_unref (texture);
+      return;
+    }
+
+  g_return_if_fail (entry->in_use);
+
+  entry->in_use = FALSE;
+  g_queue_push_head_link (&pool->idle, &entry->link);
+  pool->statistics.bytes_idle += entry->bytes;
+
+  cogl_object_unref (texture);
+
+  pool_trim (pool);
+}
+
+/**
+ * st_offscreen_pool_set_memory_budget:
+ * @bytes: the amount of texture memory the pool may hold on to
+ *
+ * Sets how large the pool may grow before idle textures are released.
+ * Textures which are in use are never released, so the pool may exceed
+ * the budget while they are.
+ */
+void
+st_offscreen_pool_set_memory_budget (gsize bytes)
+{
+  StOffscreenPool *pool = get_pool ();
+
+  pool->memory_budget = bytes;
+  pool_trim (pool);
+}
+
+/**
+ * st_offscreen_pool_get_statistics: (skip)
+ * @statistics: (out caller-allocates): return location for the statistics
+ *
+ * Gets the allocation and reuse counters of the pool.
+ */
+void
+st_offscreen_pool_get_statistics (StOffscreenPoolStatistics *statistics)
+{
+  *statistics = get_pool ()->statistics;
+}
@@ -0,0 +1,62 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * st-offscreen-pool.h: Shared pool of offscreen textures
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if !defined(ST_H_INSIDE) && !defined(ST_COMPILATION)
+#error "Only <st/st.h> can be included directly.h"
+#endif
+
+#ifndef __ST_OFFSCREEN_POOL_H__
+#define __ST_OFFSCREEN_POOL_H__
+
+#include <clutter/clutter.h>
+
+G_BEGIN_DECLS
+
+/**
+ * StOffscreenPoolStatistics:
+ * @n_acquired: number of textures handed out by the pool
+ * @n_reused: number of those which were recycled instead of allocated
+ * @bytes_allocated: total size of the textures allocated by the pool
+ * @bytes_resident: size of the textures currently owned by the pool,
+ *   whether they are in use or idle
+ * @bytes_idle: size of the idle textures kept for reuse
+ *
+ * Counters describing how well offscreen textures get reused.
+ */
+typedef struct {
+  guint64 n_acquired;
+  guint64 n_reused;
+  guint64 bytes_allocated;
+  guint64 bytes_resident;
+  guint64 bytes_idle;
+} StOffscreenPoolStatistics;
+
+CoglTexture   *st_offscreen_pool_acquire       (guint            width,
+                                                guint            height,
+                                                CoglPixelFormat  format,
+                                                gboolean         allow_larger);
+CoglOffscreen *st_offscreen_pool_get_offscreen (CoglTexture     *texture);
+void           st_offscreen_pool_release       (CoglTexture     *texture);
+
+void st_offscreen_pool_set_memory_budget (gsize bytes);
+
+void st_offscreen_pool_get_statistics (StOffscreenPoolStatistics *statistics);
+
+G_END_DECLS
+
+#endif /* __ST_OFFSCREEN_POOL_H__ */
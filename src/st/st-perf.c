@@ -0,0 +1,137 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * st-perf.c: Reporting of performance events
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * St can't use the shell's performance log directly, so events are
+ * declared as static StPerfEvent structures and reported through the
+ * hooks installed by the application. Each event is defined the first
+ * time it is recorded after hooks have been set, and its handle is
+ * remembered in the structure afterwards. Spans, declared as StPerfSpan,
+ * are handled the same way.
+ */
+
+#include "st-perf.h"
+#include "st-private.h"
+
+/* Stored in StPerfEvent.handle for events which couldn't be defined */
+#define INVALID_HANDLE G_MAXSIZE
+
+static StPerfHooks perf_hooks;
+static gpointer perf_hooks_data;
+static gboolean have_perf_hooks;
+
+/**
+ * st_perf_set_hooks: (skip)
+ * @hooks: the functions to report events with
+ * @user_data: data passed to the functions in @hooks
+ *
+ * Sets the functions St uses to report performance events. This should
+ * be called once, at startup, before any threads are started.
+ */
+void
+st_perf_set_hooks (const StPerfHooks *hooks,
+                   gpointer           user_data)
+{
+  perf_hooks = *hooks;
+  perf_hooks_data = user_data;
+  have_perf_hooks = TRUE;
+}
+
+static guint
+resolve_event (StPerfEvent *event)
+{
+  if (g_once_init_enter (&event->handle))
+    {
+      guint handle = perf_hooks.define_event (event->name,
+                                              event->description,
+                                              event->signature,
+                                              perf_hooks_data);
+
+      g_once_init_leave (&event->handle, handle != 0 ? handle : INVALID_HANDLE);
+    }
+
+  return event->handle != INVALID_HANDLE ? event->handle : 0;
+}
+
+static guint
+resolve_span (StPerfSpan *span)
+{
+  if (g_once_init_enter (&span->handle))
+    {
+      guint handle = perf_hooks.define_span (span->name,
+                                             span->description,
+                                             perf_hooks_data);
+
+      g_once_init_leave (&span->handle, handle != 0 ? handle : INVALID_HANDLE);
+    }
+
+  return span->handle != INVALID_HANDLE ? span->handle : 0;
+}
+
+void
+_st_perf_record (StPerfEvent *event)
+{
+  guint handle;
+
+  if (!have_perf_hooks)
+    return;
+
+  handle = resolve_event (event);
+  if (handle != 0)
+    perf_hooks.record (handle, perf_hooks_data);
+}
+
+void
+_st_perf_record_x (StPerfEvent *event,
+                   gint64       arg)
+{
+  guint handle;
+
+  if (!have_perf_hooks)
+    return;
+
+  handle = resolve_event (event);
+  if (handle != 0)
+    perf_hooks.record_x (handle, arg, perf_hooks_data);
+}
+
+guint
+_st_perf_span_begin (StPerfSpan *span)
+{
+  guint handle;
+
+  if (!have_perf_hooks)
+    return 0;
+
+  handle = resolve_span (span);
+  if (handle == 0)
+    return 0;
+
+  return perf_hooks.begin_span (handle, perf_hooks_data);
+}
+
+void
+_st_perf_span_end (StPerfSpan *span,
+                   guint       id)
+{
+  /* An id is only handed out once the span has been resolved */
+  if (id == 0)
+    return;
+
+  perf_hooks.end_span (span->handle, id, perf_hooks_data);
+}
@@ -0,0 +1,80 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * st-perf.h: Reporting of performance events
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if !defined(ST_H_INSIDE) && !defined(ST_COMPILATION)
+#error "Only <st/st.h> can be included directly.h"
+#endif
+
+#ifndef __ST_PERF_H__
+#define __ST_PERF_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _StPerfHooks StPerfHooks;
+
+/**
+ * StPerfHooks:
+ * @define_event: defines an event with the given name, description
+ *   and signature (as for shell_perf_log_define_event()), returning
+ *   a non-zero handle for it, or 0 if the event can't be recorded
+ * @record: records an event without arguments
+ * @record_x: records an event with one 64-bit integer argument
+ * @define_span: defines a span with the given name and description
+ *   (as for shell_perf_log_define_span()), returning a non-zero
+ *   handle for it, or 0 if the span can't be recorded
+ * @begin_span: records the start of a span, returning an id to
+ *   pass to @end_span
+ * @end_span: records the end of a span
+ *
+ * Functions through which St reports performance events. St doesn't
+ * keep a log of its own; these are provided by the application. They
+ * may be called from any thread.
+ */
+struct _StPerfHooks
+{
+  guint (* define_event) (const char *name,
+                          const char *description,
+                          const char *signature,
+                          gpointer    user_data);
+  void  (* record)       (guint       event,
+                          gpointer    user_data);
+  void  (* record_x)     (guint       event,
+                          gint64      arg,
+                          gpointer    user_data);
+
+  guint (* define_span)  (const char *name,
+                          const char *description,
+                          gpointer    user_data);
+  guint (* begin_span)   (guint       span,
+                          gpointer    user_data);
+  void  (* end_span)     (guint       span,
+                          guint       id,
+                          gpointer    user_data);
+};
+
+/**
+ * st_perf_set_hooks: (skip)
+ */
+void st_perf_set_hooks (const StPerfHooks *hooks,
+                        gpointer           user_data);
+
+G_END_DECLS
+
+#endif /* __ST_PERF_H__ */
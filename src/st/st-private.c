@@ -98,32 +98,38 @@ _st_actor_get_preferred_height (ClutterActor *actor,
   clutter_actor_get_preferred_height (actor, for_width, min_height_p, natural_height_p);
 }
 
-/**
- * _st_set_text_from_style:
- * @text: Target #ClutterText
- * @theme_node: Source #StThemeNode
- *
- * Set various GObject properties of the @text object using
- * CSS information from @theme_node.
+G_DEFINE_QUARK (st-text-decoration, st_text_decoration)
+G_DEFINE_QUARK (st-text-decoration-attributes, st_text_decoration_attributes)
+
+/* ClutterText throws away its cached layouts and queues a relayout
+ * whenever attributes are set, even if they are the same as before;
+ * remember what we set last so that restyles which don't change the
+ * text decoration (hover, focus, ...) leave the layout alone.
  */
-void
-_st_set_text_from_style (ClutterText *text,
-                         StThemeNode *theme_node)
+static gboolean
+text_decoration_changed (ClutterText      *text,
+                         StTextDecoration  decoration)
 {
+  PangoAttrList *attribs = clutter_text_get_attributes (text);
 
-  ClutterColor color;
-  StTextDecoration decoration;
-  PangoAttrList *attribs = NULL;
-  const PangoFontDescription *font;
-  StTextAlign align;
+  if (attribs == NULL)
+    return decoration != 0;
 
-  st_theme_node_get_foreground_color (theme_node, &color);
-  clutter_text_set_color (text, &color);
+  /* Attributes we didn't set get replaced */
+  if (attribs != g_object_get_qdata (G_OBJECT (text),
+                                     st_text_decoration_attributes_quark ()))
+    return TRUE;
 
-  font = st_theme_node_get_font (theme_node);
-  clutter_text_set_font_description (text, (PangoFontDescription *) font);
+  return decoration != GPOINTER_TO_UINT (g_object_get_qdata (G_OBJECT (text),
+                                                             st_text_decoration_quark ()));
+}
+
+static void
+set_text_decoration (ClutterText      *text,
+                     StTextDecoration  decoration)
+{
+  PangoAttrList *attribs = NULL;
 
-  decoration = st_theme_node_get_text_decoration (theme_node);
   if (decoration)
     {
       attribs = pango_attr_list_new ();
@@ -145,8 +151,45 @@ _st_set_text_from_style (ClutterText *text,
 
   clutter_text_set_attributes (text, attribs);
 
+  /* Keep a reference, so that the pointer can't be reused by other
+   * attributes set on the text later */
+  g_object_set_qdata_full (G_OBJECT (text), st_text_decoration_attributes_quark (),
+                           attribs ? pango_attr_list_ref (attribs) : NULL,
+                           (GDestroyNotify) pango_attr_list_unref);
+  g_object_set_qdata (G_OBJECT (text), st_text_decoration_quark (),
+                      GUINT_TO_POINTER (decoration));
+
   if (attribs)
     pango_attr_list_unref (attribs);
+}
+
+/**
+ * _st_set_text_from_style:
+ * @text: Target #ClutterText
+ * @theme_node: Source #StThemeNode
+ *
+ * Set various GObject properties of the @text object using
+ * CSS information from @theme_node.
+ */
+void
+_st_set_text_from_style (ClutterText *text,
+                         StThemeNode *theme_node)
+{
+
+  ClutterColor color;
+  StTextDecoration decoration;
+  const PangoFontDescription *font;
+  StTextAlign align;
+
+  st_theme_node_get_foreground_color (theme_node, &color);
+  clutter_text_set_color (text, &color);
+
+  font = st_theme_node_get_font (theme_node);
+  clutter_text_set_font_description (text, (PangoFontDescription *) font);
+
+  decoration = st_theme_node_get_text_decoration (theme_node);
+  if (text_decoration_changed (text, decoration))
+    set_text_decoration (text, decoration);
 
   align = st_theme_node_get_text_align (theme_node);
   if (align == ST_TEXT_ALIGN_JUSTIFY)
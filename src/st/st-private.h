@@ -41,6 +41,73 @@ G_BEGIN_DECLS
         (G_PARAM_READABLE | G_PARAM_WRITABLE | \
          G_PARAM_STATIC_NICK | G_PARAM_STATIC_NAME | G_PARAM_STATIC_BLURB)
 
+/* A performance event reported through the hooks set with
+ * st_perf_set_hooks(); declare these static and initialize them
+ * with ST_PERF_EVENT().
+ */
+typedef struct {
+  const char *name;
+  const char *description;
+  const char *signature;
+  gsize       handle;
+} StPerfEvent;
+
+#define ST_PERF_EVENT(name, description, signature) { name, description, signature, 0 }
+
+void _st_perf_record   (StPerfEvent *event);
+void _st_perf_record_x (StPerfEvent *event,
+                        gint64       arg);
+
+/* A span measuring the duration of an operation, declared static
+ * and initialized with ST_PERF_SPAN(). Record it by bracketing the
+ * operation with ST_PERF_SPAN_BEGIN() and ST_PERF_SPAN_END() in the
+ * same scope.
+ */
+typedef struct {
+  const char *name;
+  const char *description;
+  gsize       handle;
+} StPerfSpan;
+
+#define ST_PERF_SPAN(name, description) { name, description, 0 }
+
+#define ST_PERF_SPAN_BEGIN(span) \
+  guint span##_id = _st_perf_span_begin (&span)
+#define ST_PERF_SPAN_END(span) \
+  _st_perf_span_end (&span, span##_id)
+
+guint _st_perf_span_begin (StPerfSpan *span);
+void  _st_perf_span_end   (StPerfSpan *span,
+                           guint       id);
+
+/* Per-actor profiling, see st-profiler.c. Bracket the measured code
+ * with ST_PROFILER_BEGIN() and ST_PROFILER_END() in the same scope;
+ * when the profiler is off each costs a single predictable branch.
+ */
+typedef enum {
+  ST_PROFILER_PAINT,
+  ST_PROFILER_ALLOCATE,
+  ST_PROFILER_PREFERRED_WIDTH,
+  ST_PROFILER_PREFERRED_HEIGHT,
+  ST_PROFILER_STYLE,
+
+  ST_PROFILER_N_CATEGORIES
+} StProfilerCategory;
+
+extern gboolean _st_profiler_enabled;
+
+#define ST_PROFILER_BEGIN() \
+  gint64 _st_profiler_start = G_UNLIKELY (_st_profiler_enabled) ? _st_profiler_begin () : 0
+#define ST_PROFILER_END(actor, category) G_STMT_START { \
+  if (G_UNLIKELY (_st_profiler_start != 0))             \
+    _st_profiler_end (CLUTTER_ACTOR (actor), category, _st_profiler_start); \
+} G_STMT_END
+
+gint64 _st_profiler_begin (void);
+void   _st_profiler_end   (ClutterActor      *actor,
+                           StProfilerCategory category,
+                           gint64             start);
+
 G_END_DECLS
 
 ClutterActor *_st_widget_get_dnd_clone (StWidget *widget);
@@ -0,0 +1,294 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * st-profiler.c: Per-actor paint and layout cost profiler
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * When enabled, the time spent painting, allocating, measuring and
+ * restyling widgets is added up per actor class, and per named actor
+ * (as 'Class#name', like in stylesheets). Since these nest, only the
+ * self time of each call is counted, that is the time not spent in
+ * nested calls that are measured themselves. Time spent in actors
+ * which aren't measured, like a ClutterText inside a StLabel, goes to
+ * the closest measured ancestor.
+ *
+ * The times are collected for each frame, delimited by calls to
+ * st_profiler_end_frame(), and in total since the profiler was enabled.
+ */
+
+#include <time.h>
+
+#include "st-profiler.h"
+#include "st-private.h"
+
+typedef struct {
+  char   *name;
+  gint64  frame[ST_PROFILER_N_CATEGORIES];
+  gint64  last[ST_PROFILER_N_CATEGORIES];
+  gint64  total[ST_PROFILER_N_CATEGORIES];
+  guint   frame_calls;
+  guint   last_calls;
+  guint   total_calls;
+} StProfilerEntry;
+
+gboolean _st_profiler_enabled = FALSE;
+
+/* name => StProfilerEntry */
+static GHashTable *entries;
+/* For each call being measured, the time spent in nested calls */
+static GArray *stack;
+/* Reused to build the names to look up */
+static GString *name_buffer;
+
+static void
+entry_free (gpointer data)
+{
+  StProfilerEntry *entry = data;
+
+  g_free (entry->name);
+  g_slice_free (StProfilerEntry, entry);
+}
+
+static gint64
+get_time (void)
+{
+  struct timespec ts;
+
+  /* g_get_monotonic_time() is too coarse for the paint of single actors */
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+
+  return (gint64) ts.tv_sec * G_GINT64_CONSTANT (1000000000) + ts.tv_nsec;
+}
+
+/**
+ * st_profiler_set_enabled:
+ * @enabled: whether to profile widgets
+ *
+ * Turns the profiler on or off. Turning it on discards the times
+ * collected before; turning it off keeps them, so they can still be
+ * retrieved with st_profiler_get_top().
+ */
+void
+st_profiler_set_enabled (gboolean enabled)
+{
+  if (enabled == _st_profiler_enabled)
+    return;
+
+  if (enabled)
+    {
+      if (entries == NULL)
+        {
+          entries = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                           NULL, entry_free);
+          stack = g_array_new (FALSE, FALSE, sizeof (gint64));
+          name_buffer = g_string_new (NULL);
+        }
+
+      g_hash_table_remove_all (entries);
+      g_array_set_size (stack, 0);
+    }
+
+  _st_profiler_enabled = enabled;
+}
+
+/**
+ * st_profiler_get_enabled:
+ *
+ * Returns: whether the profiler is enabled
+ */
+gboolean
+st_profiler_get_enabled (void)
+{
+  return _st_profiler_enabled;
+}
+
+gint64
+_st_profiler_begin (void)
+{
+  gint64 child_time = 0;
+
+  g_array_append_val (stack, child_time);
+
+  /* 0 means nothing is being measured */
+  return MAX (get_time (), 1);
+}
+
+void
+_st_profiler_end (ClutterActor      *actor,
+                  StProfilerCategory category,
+                  gint64             start)
+{
+  StProfilerEntry *entry;
+  const char *actor_name;
+  gint64 elapsed, self_time;
+
+  /* The profiler was restarted while this call was measured */
+  if (stack->len == 0)
+    return;
+
+  elapsed = get_time () - start;
+  self_time = elapsed - g_array_index (stack, gint64, stack->len - 1);
+  g_array_set_size (stack, stack->len - 1);
+
+  if (stack->len > 0)
+    g_array_index (stack, gint64, stack->len - 1) += elapsed;
+
+  if (!_st_profiler_enabled)
+    return;
+
+  g_string_assign (name_buffer, G_OBJECT_TYPE_NAME (actor));
+  actor_name = clutter_actor_get_name (actor);
+  if (actor_name)
+    g_string_append_printf (name_buffer, "#%s", actor_name);
+
+  entry = g_hash_table_lookup (entries, name_buffer->str);
+  if (entry == NULL)
+    {
+      entry = g_slice_new0 (StProfilerEntry);
+      entry->name = g_strdup (name_buffer->str);
+      g_hash_table_insert (entries, entry->name, entry);
+    }
+
+  entry->frame[category] += self_time;
+  entry->frame_calls++;
+}
+
+/**
+ * st_profiler_end_frame:
+ *
+ * Marks the end of a frame; the times collected since the previous
+ * call make up the last frame for st_profiler_get_top().
+ */
+void
+st_profiler_end_frame (void)
+{
+  GHashTableIter iter;
+  StProfilerEntry *entry;
+  int i;
+
+  if (!_st_profiler_enabled)
+    return;
+
+  g_hash_table_iter_init (&iter, entries);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &entry))
+    {
+      for (i = 0; i < ST_PROFILER_N_CATEGORIES; i++)
+        {
+          entry->last[i] = entry->frame[i];
+          entry->total[i] += entry->frame[i];
+          entry->frame[i] = 0;
+        }
+
+      entry->last_calls = entry->frame_calls;
+      entry->total_calls += entry->frame_calls;
+      entry->frame_calls = 0;
+    }
+}
+
+static gint64
+entry_sum (StProfilerEntry *entry,
+           gboolean         last_frame)
+{
+  gint64 *times = last_frame ? entry->last : entry->total;
+  gint64 sum = 0;
+  int i;
+
+  for (i = 0; i < ST_PROFILER_N_CATEGORIES; i++)
+    sum += times[i];
+
+  return sum;
+}
+
+static gint
+compare_last_frame (gconstpointer a,
+                    gconstpointer b)
+{
+  gint64 sum_a = entry_sum (*(StProfilerEntry **) a, TRUE);
+  gint64 sum_b = entry_sum (*(StProfilerEntry **) b, TRUE);
+
+  return sum_a < sum_b ? 1 : sum_a > sum_b ? -1 : 0;
+}
+
+static gint
+compare_total (gconstpointer a,
+               gconstpointer b)
+{
+  gint64 sum_a = entry_sum (*(StProfilerEntry **) a, FALSE);
+  gint64 sum_b = entry_sum (*(StProfilerEntry **) b, FALSE);
+
+  return sum_a < sum_b ? 1 : sum_a > sum_b ? -1 : 0;
+}
+
+/**
+ * st_profiler_get_top:
+ * @n_entries: the maximum number of entries to return
+ * @last_frame: whether to return the times of the last frame, rather
+ *   than the times since the profiler was enabled
+ *
+ * Gets the actor classes and named actors which took the most time,
+ * most expensive first. Each entry is a tuple of the name, the total
+ * time and the times spent painting, allocating, getting the preferred
+ * width, getting the preferred height and recomputing the style, all
+ * in nanoseconds, followed by the number of calls.
+ *
+ * Returns: (transfer floating): a #GVariant of type a(sttttttu)
+ */
+GVariant *
+st_profiler_get_top (guint    n_entries,
+                     gboolean last_frame)
+{
+  GVariantBuilder builder;
+  GPtrArray *sorted;
+  GHashTableIter iter;
+  StProfilerEntry *entry;
+  guint i;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sttttttu)"));
+
+  if (entries == NULL)
+    return g_variant_builder_end (&builder);
+
+  sorted = g_ptr_array_new ();
+
+  g_hash_table_iter_init (&iter, entries);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &entry))
+    if (entry_sum (entry, last_frame) > 0)
+      g_ptr_array_add (sorted, entry);
+
+  g_ptr_array_sort (sorted, last_frame ? compare_last_frame : compare_total);
+
+  for (i = 0; i < sorted->len && i < n_entries; i++)
+    {
+      gint64 *times;
+
+      entry = sorted->pdata[i];
+      times = last_frame ? entry->last : entry->total;
+
+      g_variant_builder_add (&builder, "(sttttttu)",
+                             entry->name,
+                             (guint64) entry_sum (entry, last_frame),
+                             (guint64) times[ST_PROFILER_PAINT],
+                             (guint64) times[ST_PROFILER_ALLOCATE],
+                             (guint64) times[ST_PROFILER_PREFERRED_WIDTH],
+                             (guint64) times[ST_PROFILER_PREFERRED_HEIGHT],
+                             (guint64) times[ST_PROFILER_STYLE],
+                             last_frame ? entry->last_calls : entry->total_calls);
+    }
+
+  g_ptr_array_free (sorted, TRUE);
+
+  return g_variant_builder_end (&builder);
+}
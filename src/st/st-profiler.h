@@ -0,0 +1,40 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * st-profiler.h: Per-actor paint and layout cost profiler
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if !defined(ST_H_INSIDE) && !defined(ST_COMPILATION)
+#error "Only <st/st.h> can be included directly.h"
+#endif
+
+#ifndef __ST_PROFILER_H__
+#define __ST_PROFILER_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+void      st_profiler_set_enabled (gboolean enabled);
+gboolean  st_profiler_get_enabled (void);
+
+void      st_profiler_end_frame   (void);
+
+GVariant *st_profiler_get_top     (guint    n_entries,
+                                   gboolean last_frame);
+
+G_END_DECLS
+
+#endif /* __ST_PROFILER_H__ */
@@ -25,6 +25,7 @@
 #include "st-theme-node.h"
 #include "st-scroll-bar.h"
 #include "st-scrollable.h"
+#include "st-offscreen-pool.h"
 
 #include <clutter/clutter.h>
 #include <cogl/cogl.h>
@@ -43,6 +44,9 @@ struct _StScrollViewFade
   StAdjustment *vadjustment;
   StAdjustment *hadjustment;
 
+  /* our reference to the pooled texture used by the offscreen effect */
+  CoglTexture *texture;
+
   guint fade_edges : 1;
 
   float vfade_offset;
@@ -66,10 +70,21 @@ st_scroll_view_fade_create_texture (ClutterOffscreenEffect *effect,
                                     gfloat                  min_width,
                                     gfloat                  min_height)
 {
-  return cogl_texture_new_with_size (min_width,
-                                     min_height,
-                                     COGL_TEXTURE_NO_SLICING,
-                                     COGL_PIXEL_FORMAT_RGBA_8888_PRE);
+  StScrollViewFade *self = ST_SCROLL_VIEW_FADE (effect);
+
+  /* The parent class has already dropped its reference to the previous
+   * texture at this point */
+  if (self->texture)
+    st_offscreen_pool_release (self->texture);
+
+  self->texture = st_offscreen_pool_acquire (min_width,
+                                             min_height,
+                                             COGL_PIXEL_FORMAT_RGBA_8888_PRE,
+                                             FALSE);
+  if (self->texture == NULL)
+    return NULL;
+
+  return cogl_object_ref (self->texture);
 }
 
 static char *
@@ -258,6 +273,20 @@ st_scroll_view_fade_dispose (GObject *gobject)
   G_OBJECT_CLASS (st_scroll_view_fade_parent_class)->dispose (gobject);
 }
 
+static void
+st_scroll_view_fade_finalize (GObject *gobject)
+{
+  StScrollViewFade *self = ST_SCROLL_VIEW_FADE (gobject);
+  CoglTexture *texture = self->texture;
+
+  /* ClutterOffscreenEffect only drops its reference to the texture
+   * when it is finalized; until then it may still be painted */
+  G_OBJECT_CLASS (st_scroll_view_fade_parent_class)->finalize (gobject);
+
+  if (texture)
+    st_offscreen_pool_release (texture);
+}
+
 static void
 st_scroll_view_vfade_set_offset (StScrollViewFade *self,
                                  float fade_offset)
@@ -371,6 +400,7 @@ st_scroll_view_fade_class_init (StScrollViewFadeClass *klass)
   ClutterActorMetaClass *meta_class = CLUTTER_ACTOR_META_CLASS (klass);
 
   gobject_class->dispose = st_scroll_view_fade_dispose;
+  gobject_class->finalize = st_scroll_view_fade_finalize;
   gobject_class->get_property = st_scroll_view_fade_get_property;
   gobject_class->set_property = st_scroll_view_fade_set_property;
 
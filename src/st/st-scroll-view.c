@@ -62,6 +62,7 @@
 #include "st-scroll-bar.h"
 #include "st-scrollable.h"
 #include "st-scroll-view-fade.h"
+#include "st-private.h"
 #include <clutter/clutter.h>
 #include <math.h>
 
@@ -276,6 +277,7 @@ static void
 st_scroll_view_paint (ClutterActor *actor)
 {
   StScrollViewPrivate *priv = ST_SCROLL_VIEW (actor)->priv;
+  ST_PROFILER_BEGIN ();
 
   st_widget_paint_background (ST_WIDGET (actor));
 
@@ -285,6 +287,8 @@ st_scroll_view_paint (ClutterActor *actor)
     clutter_actor_paint (priv->hscroll);
   if (priv->vscrollbar_visible)
     clutter_actor_paint (priv->vscroll);
+
+  ST_PROFILER_END (actor, ST_PROFILER_PAINT);
 }
 
 static void
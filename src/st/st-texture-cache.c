@@ -57,6 +57,14 @@ enum
 };
 
 static guint signals[LAST_SIGNAL] = { 0, };
+
+/* Recorded in the worker threads decoding images */
+static StPerfEvent decode_start_event =
+  ST_PERF_EVENT ("st.textureDecodeStart", "Start of decoding an image in a worker thread", "");
+static StPerfEvent decode_done_event =
+  ST_PERF_EVENT ("st.textureDecodeDone", "Finished decoding an image, with the decoded size in bytes", "x");
+static StPerfSpan decode_span =
+  ST_PERF_SPAN ("st.textureLoad", "Decoding an image in a worker thread");
 G_DEFINE_TYPE(StTextureCache, st_texture_cache, G_TYPE_OBJECT);
 
 /* We want to preserve the aspect ratio by default, also the default
@@ -442,8 +450,15 @@ load_pixbuf_thread (GTask        *result,
   g_assert (data != NULL);
   g_assert (data->file != NULL);
 
+  _st_perf_record (&decode_start_event);
+  ST_PERF_SPAN_BEGIN (decode_span);
+
   pixbuf = impl_load_pixbuf_file (data->file, data->width, data->height, data->scale, &error);
 
+  ST_PERF_SPAN_END (decode_span);
+  _st_perf_record_x (&decode_done_event,
+                     pixbuf ? gdk_pixbuf_get_byte_length (pixbuf) : 0);
+
   if (error != NULL)
     g_task_return_error (result, error);
   else if (pixbuf)
@@ -1092,12 +1107,16 @@ load_sliced_image (GTask        *result,
   GError *error = NULL;
   gchar *buffer = NULL;
   gsize length;
+  gsize decoded_bytes = 0;
 
   g_assert (!cancellable);
 
   data = task_data;
   g_assert (data);
 
+  _st_perf_record (&decode_start_event);
+  ST_PERF_SPAN_BEGIN (decode_span);
+
   loader = gdk_pixbuf_loader_new ();
   g_signal_connect (loader, "size-prepared", G_CALLBACK (on_loader_size_prepared), data);
 
@@ -1119,6 +1138,7 @@ load_sliced_image (GTask        *result,
   pix = gdk_pixbuf_loader_get_pixbuf (loader);
   width = gdk_pixbuf_get_width (pix);
   height = gdk_pixbuf_get_height (pix);
+  decoded_bytes = gdk_pixbuf_get_byte_length (pix);
   for (y = 0; y < height; y += data->grid_height * data->scale_factor)
     {
       for (x = 0; x < width; x += data->grid_width * data->scale_factor)
@@ -1132,6 +1152,9 @@ load_sliced_image (GTask        *result,
     }
 
  out:
+  ST_PERF_SPAN_END (decode_span);
+  _st_perf_record_x (&decode_done_event, decoded_bytes);
+
   /* We don't need the original pixbuf anymore, which is owned by the loader,
    * though the subpixbufs will hold a reference. */
   g_object_unref (loader);
@@ -1413,3 +1436,48 @@ st_texture_cache_get_default (void)
     instance = g_object_new (ST_TYPE_TEXTURE_CACHE, NULL);
   return instance;
 }
+
+/**
+ * st_texture_cache_get_statistics:
+ * @cache: A #StTextureCache
+ * @n_entries: (out) (allow-none): return location for the number of
+ *   cached images
+ * @resident_bytes: (out) (allow-none): return location for the memory
+ *   they take up, in bytes
+ *
+ * Gets how much the cache holds on to. The size of textures is
+ * estimated from their dimensions, at 4 bytes per pixel.
+ */
+void
+st_texture_cache_get_statistics (StTextureCache *cache,
+                                 guint          *n_entries,
+                                 guint64        *resident_bytes)
+{
+  GHashTableIter iter;
+  gpointer key, value;
+  guint64 bytes = 0;
+
+  g_hash_table_iter_init (&iter, cache->priv->keyed_cache);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      if (g_str_has_prefix (key, CACHE_PREFIX_FILE_FOR_CAIRO))
+        {
+          cairo_surface_t *surface = value;
+
+          bytes += (guint64) cairo_image_surface_get_stride (surface) *
+                   cairo_image_surface_get_height (surface);
+        }
+      else
+        {
+          CoglTexture *texture = value;
+
+          bytes += (guint64) cogl_texture_get_width (texture) *
+                   cogl_texture_get_height (texture) * 4;
+        }
+    }
+
+  if (n_entries)
+    *n_entries = g_hash_table_size (cache->priv->keyed_cache);
+  if (resident_bytes)
+    *resident_bytes = bytes;
+}
@@ -106,4 +106,8 @@ CoglTexture * st_texture_cache_load (StTextureCache       *cache,
                                      void                 *data,
                                      GError              **error);
 
+void st_texture_cache_get_statistics (StTextureCache *cache,
+                                      guint          *n_entries,
+                                      guint64        *resident_bytes);
+
 #endif /* __ST_TEXTURE_CACHE_H__ */
@@ -28,6 +28,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 #include "st-shadow.h"
@@ -37,6 +38,188 @@
 #include "st-texture-cache.h"
 #include "st-theme-node-private.h"
 
+/****
+ * Draw batching
+ ****/
+
+/* Rectangles drawn while painting a node are accumulated here and
+ * submitted with a single draw call for as long as they share the same
+ * framebuffer and pipeline. The batch has to be flushed before its
+ * pipeline is modified, before anything is drawn around it, and at the
+ * end of st_theme_node_paint(); it never outlives a paint of a node, so
+ * the framebuffer and pipeline are not referenced.
+ */
+typedef struct {
+  CoglFramebuffer *framebuffer;
+  CoglPipeline    *pipeline;
+  gboolean         textured;
+  GArray          *coords;
+} StPaintBatch;
+
+static StPaintBatch paint_batch;
+static guint64 paint_n_draw_calls;
+static guint64 paint_n_rectangles;
+
+static void
+st_paint_batch_flush (void)
+{
+  int n_rectangles;
+
+  if (paint_batch.pipeline == NULL)
+    return;
+
+  if (paint_batch.textured)
+    {
+      n_rectangles = paint_batch.coords->len / 8;
+      cogl_framebuffer_draw_textured_rectangles (paint_batch.framebuffer,
+                                                 paint_batch.pipeline,
+                                                 (float *) paint_batch.coords->data,
+                                                 n_rectangles);
+    }
+  else
+    {
+      n_rectangles = paint_batch.coords->len / 4;
+      cogl_framebuffer_draw_rectangles (paint_batch.framebuffer,
+                                        paint_batch.pipeline,
+                                        (float *) paint_batch.coords->data,
+                                        n_rectangles);
+    }
+
+  paint_n_draw_calls++;
+  paint_n_rectangles += n_rectangles;
+
+  g_array_set_size (paint_batch.coords, 0);
+  paint_batch.framebuffer = NULL;
+  paint_batch.pipeline = NULL;
+}
+
+static void
+st_paint_batch_add (CoglFramebuffer *framebuffer,
+                    CoglPipeline    *pipeline,
+                    gboolean         textured,
+                    const float     *coords,
+                    int              n_rectangles)
+{
+  if (paint_batch.framebuffer != framebuffer ||
+      paint_batch.pipeline != pipeline ||
+      paint_batch.textured != textured)
+    {
+      st_paint_batch_flush ();
+
+      if (G_UNLIKELY (paint_batch.coords == NULL))
+        paint_batch.coords = g_array_sized_new (FALSE, FALSE, sizeof (float), 8 * 16);
+
+      paint_batch.framebuffer = framebuffer;
+      paint_batch.pipeline = pipeline;
+      paint_batch.textured = textured;
+    }
+
+  g_array_append_vals (paint_batch.coords, coords,
+                       n_rectangles * (textured ? 8 : 4));
+}
+
+static void
+st_paint_batch_add_rectangles (CoglFramebuffer *framebuffer,
+                               CoglPipeline    *pipeline,
+                               const float     *verts,
+                               int              n_rectangles)
+{
+  st_paint_batch_add (framebuffer, pipeline, FALSE, verts, n_rectangles);
+}
+
+static void
+st_paint_batch_add_rectangle (CoglFramebuffer *framebuffer,
+                              CoglPipeline    *pipeline,
+                              float            x1,
+                              float            y1,
+                              float            x2,
+                              float            y2)
+{
+  float verts[4] = { x1, y1, x2, y2 };
+
+  st_paint_batch_add (framebuffer, pipeline, FALSE, verts, 1);
+}
+
+static void
+st_paint_batch_add_textured_rectangles (CoglFramebuffer *framebuffer,
+                                        CoglPipeline    *pipeline,
+                                        const float     *coords,
+                                        int              n_rectangles)
+{
+  st_paint_batch_add (framebuffer, pipeline, TRUE, coords, n_rectangles);
+}
+
+static void
+st_paint_batch_add_textured_rectangle (CoglFramebuffer *framebuffer,
+                                       CoglPipeline    *pipeline,
+                                       float            x1,
+                                       float            y1,
+                                       float            x2,
+                                       float            y2,
+                                       float            tx1,
+                                       float            ty1,
+                                       float            tx2,
+                                       float            ty2)
+{
+  float coords[8] = { x1, y1, x2, y2, tx1, ty1, tx2, ty2 };
+
+  st_paint_batch_add (framebuffer, pipeline, TRUE, coords, 1);
+}
+
+/* Must be called before @pipeline is modified */
+static void
+st_paint_batch_release_pipeline (CoglPipeline *pipeline)
+{
+  if (paint_batch.pipeline == pipeline)
+    st_paint_batch_flush ();
+}
+
+/* Like cogl_pipeline_set_color4ub(), but only breaks the batch if the
+ * color actually changes */
+static void
+st_paint_batch_set_color4ub (CoglPipeline *pipeline,
+                             guint8        red,
+                             guint8        green,
+                             guint8        blue,
+                             guint8        alpha)
+{
+  if (paint_batch.pipeline == pipeline)
+    {
+      CoglColor color;
+
+      cogl_pipeline_get_color (pipeline, &color);
+      if (cogl_color_get_red_byte (&color) == red &&
+          cogl_color_get_green_byte (&color) == green &&
+          cogl_color_get_blue_byte (&color) == blue &&
+          cogl_color_get_alpha_byte (&color) == alpha)
+        return;
+
+      st_paint_batch_flush ();
+    }
+
+  cogl_pipeline_set_color4ub (pipeline, red, green, blue, alpha);
+}
+
+/**
+ * st_theme_node_get_paint_statistics:
+ * @n_draw_calls: (out) (allow-none): return location for the number of
+ *   draw calls
+ * @n_rectangles: (out) (allow-none): return location for the number of
+ *   rectangles
+ *
+ * Gets the number of draw calls submitted for painting theme nodes,
+ * and the number of rectangles drawn by them, since startup.
+ */
+void
+st_theme_node_get_paint_statistics (guint64 *n_draw_calls,
+                                    guint64 *n_rectangles)
+{
+  if (n_draw_calls)
+    *n_draw_calls = paint_n_draw_calls;
+  if (n_rectangles)
+    *n_rectangles = paint_n_rectangles;
+}
+
 /****
  * Rounded corners
  ****/
@@ -415,6 +598,264 @@ st_theme_node_lookup_corner (StThemeNode    *node,
   return material;
 }
 
+/* Corners with the same spec get the same texture from the cache; make
+ * them share the pipeline too, so that they end up in a single batch.
+ */
+static void
+st_theme_node_share_corner_materials (StThemeNodePaintState *state)
+{
+  int corner_id, other_id;
+
+  for (corner_id = 1; corner_id < 4; corner_id++)
+    {
+      CoglTexture *texture;
+
+      if (state->corner_material[corner_id] == COGL_INVALID_HANDLE)
+        continue;
+
+      texture = cogl_pipeline_get_layer_texture (state->corner_material[corner_id], 0);
+
+      for (other_id = 0; other_id < corner_id; other_id++)
+        {
+          if (state->corner_material[other_id] == COGL_INVALID_HANDLE ||
+              state->corner_material[other_id] == state->corner_material[corner_id])
+            continue;
+
+          if (cogl_pipeline_get_layer_texture (state->corner_material[other_id], 0) == texture)
+            {
+              cogl_handle_unref (state->corner_material[corner_id]);
+              state->corner_material[corner_id] = cogl_handle_ref (state->corner_material[other_id]);
+              break;
+            }
+        }
+    }
+}
+
+/****
+ * Analytic rounded rectangles
+ ****/
+
+/* Background color, border and rounded corners of a node are drawn in
+ * a single quad by evaluating the signed distance to the border box and
+ * to the padding box. The texture coordinates span [0, 1] over the quad,
+ * colors are premultiplied and the pipeline color carries the paint
+ * opacity.
+ */
+static const gchar *rounded_rect_declarations =
+  "uniform vec2 st_size;\n"
+  "uniform vec4 st_radius;\n"
+  "uniform float st_border_width;\n"
+  "uniform vec4 st_background_color;\n"
+  "uniform vec4 st_border_color;\n"
+  "\n"
+  "float\n"
+  "st_rounded_rect_distance (vec2 p, vec2 half_size, vec4 radius)\n"
+  "{\n"
+  "  float r = p.x < 0.0 ? (p.y < 0.0 ? radius.x : radius.w)\n"
+  "                      : (p.y < 0.0 ? radius.y : radius.z);\n"
+  "  vec2 q = abs (p) - half_size + r;\n"
+  "  return min (max (q.x, q.y), 0.0) + length (max (q, 0.0)) - r;\n"
+  "}\n";
+
+static const gchar *rounded_rect_source =
+  "vec2 half_size = 0.5 * st_size;\n"
+  "vec2 p = cogl_tex_coord_in[0].st * st_size - half_size;\n"
+  "float outer = st_rounded_rect_distance (p, half_size, st_radius);\n"
+  "float inner = st_rounded_rect_distance (p, half_size - st_border_width,\n"
+  "                                        max (st_radius - st_border_width, 0.0));\n"
+  "vec4 color = mix (st_border_color, st_background_color,\n"
+  "                  clamp (0.5 - inner, 0.0, 1.0));\n"
+  "cogl_color_out = color * clamp (0.5 - outer, 0.0, 1.0) * cogl_color_in.a;\n";
+
+static int rounded_rect_size_location = -1;
+static int rounded_rect_radius_location = -1;
+static int rounded_rect_border_width_location = -1;
+static int rounded_rect_background_color_location = -1;
+static int rounded_rect_border_color_location = -1;
+
+static CoglPipeline *
+st_theme_node_create_rounded_rect_pipeline (void)
+{
+  static CoglPipeline *rounded_rect_pipeline_template = NULL;
+
+  if (G_UNLIKELY (rounded_rect_pipeline_template == NULL))
+    {
+      CoglContext *ctx =
+        clutter_backend_get_cogl_context (clutter_get_default_backend ());
+      CoglSnippet *snippet;
+
+      rounded_rect_pipeline_template = cogl_pipeline_new (ctx);
+
+      /* The layer is only there to get texture coordinates passed
+       * through to the fragment stage; it is never sampled. */
+      cogl_pipeline_set_layer_null_texture (rounded_rect_pipeline_template,
+                                            0, /* layer */
+                                            COGL_TEXTURE_TYPE_2D);
+
+      snippet = cogl_snippet_new (COGL_SNIPPET_HOOK_FRAGMENT,
+                                  rounded_rect_declarations,
+                                  NULL);
+      cogl_snippet_set_replace (snippet, rounded_rect_source);
+      cogl_pipeline_add_snippet (rounded_rect_pipeline_template, snippet);
+      cogl_object_unref (snippet);
+
+      rounded_rect_size_location =
+        cogl_pipeline_get_uniform_location (rounded_rect_pipeline_template, "st_size");
+      rounded_rect_radius_location =
+        cogl_pipeline_get_uniform_location (rounded_rect_pipeline_template, "st_radius");
+      rounded_rect_border_width_location =
+        cogl_pipeline_get_uniform_location (rounded_rect_pipeline_template, "st_border_width");
+      rounded_rect_background_color_location =
+        cogl_pipeline_get_uniform_location (rounded_rect_pipeline_template, "st_background_color");
+      rounded_rect_border_color_location =
+        cogl_pipeline_get_uniform_location (rounded_rect_pipeline_template, "st_border_color");
+    }
+
+  return cogl_pipeline_copy (rounded_rect_pipeline_template);
+}
+
+/*
+ * st_theme_node_can_paint_rounded_rect:
+ * @node: a #StThemeNode
+ * @width: The width of the box
+ * @height: The height of the box
+ *
+ * Checks whether the borders, corners and background color of @node can
+ * be drawn with the analytic rounded rectangle shader instead of
+ * per-corner textures. This requires GLSL, uniform border widths and
+ * colors (which the shader assumes), and corners which don't extend past
+ * the middle of the box.
+ */
+static gboolean
+st_theme_node_can_paint_rounded_rect (StThemeNode *node,
+                                      float        width,
+                                      float        height)
+{
+  static int glsl_supported = -1;
+  guint border_radius[4];
+  int side_id, corner_id;
+  gboolean has_border_radius = FALSE;
+
+  if (G_UNLIKELY (glsl_supported == -1))
+    glsl_supported = clutter_feature_available (CLUTTER_FEATURE_SHADERS_GLSL);
+
+  if (!glsl_supported)
+    return FALSE;
+
+  for (side_id = 1; side_id < 4; side_id++)
+    {
+      if (node->border_width[side_id] != node->border_width[ST_SIDE_TOP])
+        return FALSE;
+
+      if (node->border_width[side_id] > 0 &&
+          !clutter_color_equal (&node->border_color[side_id],
+                                &node->border_color[ST_SIDE_TOP]))
+        return FALSE;
+    }
+
+  st_theme_node_reduce_border_radius (node, width, height, border_radius);
+
+  for (corner_id = 0; corner_id < 4; corner_id++)
+    {
+      if (border_radius[corner_id] * 2 > width ||
+          border_radius[corner_id] * 2 > height)
+        return FALSE;
+
+      if (border_radius[corner_id] > 0)
+        has_border_radius = TRUE;
+    }
+
+  /* Square boxes are cheaper to draw with plain rectangles */
+  return has_border_radius;
+}
+
+static void
+color_to_premultiplied_floats (const ClutterColor *color,
+                               float              *out)
+{
+  float alpha = color->alpha / 255.;
+
+  out[0] = color->red / 255. * alpha;
+  out[1] = color->green / 255. * alpha;
+  out[2] = color->blue / 255. * alpha;
+  out[3] = alpha;
+}
+
+static void
+st_theme_node_paint_rounded_rect (StThemeNode     *node,
+                                  CoglFramebuffer *framebuffer,
+                                  float            width,
+                                  float            height,
+                                  guint8           paint_opacity)
+{
+  guint border_radius[4];
+  float size[2], radius[4];
+  float background_color[4], border_color[4];
+  int border_width;
+  int corner_id;
+
+  if (paint_opacity == 0)
+    return;
+
+  if (node->rounded_rect_pipeline == COGL_INVALID_HANDLE)
+    node->rounded_rect_pipeline = st_theme_node_create_rounded_rect_pipeline ();
+
+  st_theme_node_reduce_border_radius (node, width, height, border_radius);
+  for (corner_id = 0; corner_id < 4; corner_id++)
+    radius[corner_id] = border_radius[corner_id];
+
+  size[0] = width;
+  size[1] = height;
+
+  border_width = node->border_width[ST_SIDE_TOP];
+
+  color_to_premultiplied_floats (&node->background_color, background_color);
+
+  if (border_width > 0)
+    {
+      ClutterColor effective_border;
+
+      over (&node->border_color[ST_SIDE_TOP], &node->background_color, &effective_border);
+      color_to_premultiplied_floats (&effective_border, border_color);
+    }
+  else
+    {
+      /* Avoid blending the background against an invisible border
+       * along the antialiased edge. */
+      memcpy (border_color, background_color, sizeof (border_color));
+    }
+
+  if (background_color[3] == 0 && border_color[3] == 0)
+    return;
+
+  st_paint_batch_release_pipeline (node->rounded_rect_pipeline);
+
+  cogl_pipeline_set_uniform_float (node->rounded_rect_pipeline,
+                                   rounded_rect_size_location,
+                                   2, 1, size);
+  cogl_pipeline_set_uniform_float (node->rounded_rect_pipeline,
+                                   rounded_rect_radius_location,
+                                   4, 1, radius);
+  cogl_pipeline_set_uniform_1f (node->rounded_rect_pipeline,
+                                rounded_rect_border_width_location,
+                                border_width);
+  cogl_pipeline_set_uniform_float (node->rounded_rect_pipeline,
+                                   rounded_rect_background_color_location,
+                                   4, 1, background_color);
+  cogl_pipeline_set_uniform_float (node->rounded_rect_pipeline,
+                                   rounded_rect_border_color_location,
+                                   4, 1, border_color);
+
+  cogl_pipeline_set_color4ub (node->rounded_rect_pipeline,
+                              paint_opacity, paint_opacity,
+                              paint_opacity, paint_opacity);
+
+  st_paint_batch_add_textured_rectangle (framebuffer,
+                                         node->rounded_rect_pipeline,
+                                         0, 0, width, height,
+                                         0, 0, 1, 1);
+}
+
 static void
 get_background_scale (StThemeNode *node,
                       gdouble      painting_area_width,
@@ -1416,6 +1857,9 @@ st_theme_node_load_background_image (StThemeNode *node)
 
 static void st_theme_node_prerender_shadow (StThemeNodePaintState *state);
 
+static StPerfSpan render_resources_span =
+  ST_PERF_SPAN ("st.renderResources", "Rendering the background, border and shadow textures of a theme node");
+
 static void
 st_theme_node_render_resources (StThemeNodePaintState *state,
                                 StThemeNode           *node,
@@ -1430,6 +1874,8 @@ st_theme_node_render_resources (StThemeNodePaintState *state,
 
   g_return_if_fail (width > 0 && height > 0);
 
+  ST_PERF_SPAN_BEGIN (render_resources_span);
+
   /* FIXME - need to separate this into things that need to be recomputed on
    * geometry change versus things that can be cached regardless, such as
    * a background image.
@@ -1483,14 +1929,20 @@ st_theme_node_render_resources (StThemeNodePaintState *state,
     }
   }
 
-  state->corner_material[ST_CORNER_TOPLEFT] =
-    st_theme_node_lookup_corner (node, width, height, ST_CORNER_TOPLEFT);
-  state->corner_material[ST_CORNER_TOPRIGHT] =
-    st_theme_node_lookup_corner (node, width, height, ST_CORNER_TOPRIGHT);
-  state->corner_material[ST_CORNER_BOTTOMRIGHT] =
-    st_theme_node_lookup_corner (node, width, height, ST_CORNER_BOTTOMRIGHT);
-  state->corner_material[ST_CORNER_BOTTOMLEFT] =
-    st_theme_node_lookup_corner (node, width, height, ST_CORNER_BOTTOMLEFT);
+  /* Corners drawn by the rounded rectangle shader don't need textures */
+  if (!st_theme_node_can_paint_rounded_rect (node, width, height))
+    {
+      state->corner_material[ST_CORNER_TOPLEFT] =
+        st_theme_node_lookup_corner (node, width, height, ST_CORNER_TOPLEFT);
+      state->corner_material[ST_CORNER_TOPRIGHT] =
+        st_theme_node_lookup_corner (node, width, height, ST_CORNER_TOPRIGHT);
+      state->corner_material[ST_CORNER_BOTTOMRIGHT] =
+        st_theme_node_lookup_corner (node, width, height, ST_CORNER_BOTTOMRIGHT);
+      state->corner_material[ST_CORNER_BOTTOMLEFT] =
+        st_theme_node_lookup_corner (node, width, height, ST_CORNER_BOTTOMLEFT);
+
+      st_theme_node_share_corner_materials (state);
+    }
 
   /* Use cairo to prerender the node if there is a gradient, or
    * background image with borders and/or rounded corners,
@@ -1536,6 +1988,8 @@ st_theme_node_render_resources (StThemeNodePaintState *state,
           node->cached_textures = TRUE;
         }
     }
+
+  ST_PERF_SPAN_END (render_resources_span);
 }
 
 static void
@@ -1547,9 +2001,21 @@ st_theme_node_update_resources (StThemeNodePaintState *state,
   gboolean had_prerendered_texture = FALSE;
   gboolean had_box_shadow = FALSE;
   StShadow *box_shadow_spec;
+  int corner_id;
 
   g_return_if_fail (width > 0 && height > 0);
 
+  /* The corners may now be drawn by the rounded rectangle shader, or
+   * have a different radius; they are looked up again below if needed */
+  for (corner_id = 0; corner_id < 4; corner_id++)
+    {
+      if (state->corner_material[corner_id] != COGL_INVALID_HANDLE)
+        {
+          cogl_handle_unref (state->corner_material[corner_id]);
+          state->corner_material[corner_id] = COGL_INVALID_HANDLE;
+        }
+    }
+
   /* Free handles we can't reuse */
   if (state->prerendered_texture != COGL_INVALID_HANDLE)
     {
@@ -1582,14 +2048,14 @@ st_theme_node_update_resources (StThemeNodePaintState *state,
       state->prerendered_texture = st_theme_node_prerender_background (node, width, height);
       state->prerendered_pipeline = _st_create_texture_pipeline (state->prerendered_texture);
     }
-  else
-    {
-      int corner_id;
 
+  if (!st_theme_node_can_paint_rounded_rect (node, width, height))
+    {
       for (corner_id = 0; corner_id < 4; corner_id++)
-        if (state->corner_material[corner_id] == COGL_INVALID_HANDLE)
-          state->corner_material[corner_id] =
-            st_theme_node_lookup_corner (node, width, height, corner_id);
+        state->corner_material[corner_id] =
+          st_theme_node_lookup_corner (node, width, height, corner_id);
+
+      st_theme_node_share_corner_materials (state);
     }
 
   if (had_box_shadow)
@@ -1604,16 +2070,16 @@ paint_material_with_opacity (CoglHandle       material,
                              ClutterActorBox *coords,
                              guint8           paint_opacity)
 {
-  cogl_pipeline_set_color4ub (material,
-                              paint_opacity, paint_opacity, paint_opacity, paint_opacity);
+  st_paint_batch_set_color4ub (material,
+                               paint_opacity, paint_opacity, paint_opacity, paint_opacity);
 
   if (coords)
-    cogl_framebuffer_draw_textured_rectangle (framebuffer, material,
-                                              box->x1, box->y1, box->x2, box->y2,
-                                              coords->x1, coords->y1, coords->x2, coords->y2);
+    st_paint_batch_add_textured_rectangle (framebuffer, material,
+                                           box->x1, box->y1, box->x2, box->y2,
+                                           coords->x1, coords->y1, coords->x2, coords->y2);
   else
-    cogl_framebuffer_draw_rectangle (framebuffer, material,
-                                     box->x1, box->y1, box->x2, box->y2);
+    st_paint_batch_add_rectangle (framebuffer, material,
+                                  box->x1, box->y1, box->x2, box->y2);
 }
 
 static void
@@ -1654,6 +2120,12 @@ st_theme_node_paint_borders (StThemeNodePaintState *state,
   width = box->x2 - box->x1;
   height = box->y2 - box->y1;
 
+  if (st_theme_node_can_paint_rounded_rect (node, width, height))
+    {
+      st_theme_node_paint_rounded_rect (node, framebuffer, width, height, paint_opacity);
+      return;
+    }
+
   /* TODO - support non-uniform border colors */
   get_arbitrary_border_color (node, &border_color);
 
@@ -1691,11 +2163,11 @@ st_theme_node_paint_borders (StThemeNodePaintState *state,
       if (alpha > 0)
         {
           st_theme_node_ensure_color_pipeline (node);
-          cogl_pipeline_set_color4ub (node->color_pipeline,
-                                      effective_border.red * alpha / 255,
-                                      effective_border.green * alpha / 255,
-                                      effective_border.blue * alpha / 255,
-                                      alpha);
+          st_paint_batch_set_color4ub (node->color_pipeline,
+                                       effective_border.red * alpha / 255,
+                                       effective_border.green * alpha / 255,
+                                       effective_border.blue * alpha / 255,
+                                       alpha);
 
           /* NORTH */
           skip_corner_1 = border_radius[ST_CORNER_TOPLEFT] > 0;
@@ -1738,9 +2210,9 @@ st_theme_node_paint_borders (StThemeNodePaintState *state,
           rects[15] = skip_corner_2 ? height - max_width_radius[ST_CORNER_BOTTOMLEFT]
                              : height - border_width[ST_SIDE_BOTTOM];
 
-          cogl_framebuffer_draw_rectangles (framebuffer,
-                                            node->color_pipeline,
-					    rects, 4);
+          st_paint_batch_add_rectangles (framebuffer,
+                                         node->color_pipeline,
+                                         rects, 4);
         }
     }
 
@@ -1752,27 +2224,27 @@ st_theme_node_paint_borders (StThemeNodePaintState *state,
           if (state->corner_material[corner_id] == COGL_INVALID_HANDLE)
             continue;
 
-          cogl_pipeline_set_color4ub (state->corner_material[corner_id],
-                                      paint_opacity, paint_opacity,
-                                      paint_opacity, paint_opacity);
+          st_paint_batch_set_color4ub (state->corner_material[corner_id],
+                                       paint_opacity, paint_opacity,
+                                       paint_opacity, paint_opacity);
 
           switch (corner_id)
             {
               case ST_CORNER_TOPLEFT:
-                cogl_framebuffer_draw_textured_rectangle (framebuffer,
+                st_paint_batch_add_textured_rectangle (framebuffer,
                   state->corner_material[corner_id], 0, 0,
                   max_width_radius[ST_CORNER_TOPLEFT], max_width_radius[ST_CORNER_TOPLEFT],
                   0, 0, 0.5, 0.5);
                 break;
               case ST_CORNER_TOPRIGHT:
-                cogl_framebuffer_draw_textured_rectangle (framebuffer,
+                st_paint_batch_add_textured_rectangle (framebuffer,
                   state->corner_material[corner_id],
                   width - max_width_radius[ST_CORNER_TOPRIGHT], 0,
                   width, max_width_radius[ST_CORNER_TOPRIGHT],
                   0.5, 0, 1, 0.5);
                 break;
               case ST_CORNER_BOTTOMRIGHT:
-                cogl_framebuffer_draw_textured_rectangle (framebuffer,
+                st_paint_batch_add_textured_rectangle (framebuffer,
                   state->corner_material[corner_id],
                   width - max_width_radius[ST_CORNER_BOTTOMRIGHT],
                   height - max_width_radius[ST_CORNER_BOTTOMRIGHT],
@@ -1780,7 +2252,7 @@ st_theme_node_paint_borders (StThemeNodePaintState *state,
                   0.5, 0.5, 1, 1);
                 break;
               case ST_CORNER_BOTTOMLEFT:
-                cogl_framebuffer_draw_textured_rectangle (framebuffer,
+                st_paint_batch_add_textured_rectangle (framebuffer,
                   state->corner_material[corner_id],
                   0, height - max_width_radius[ST_CORNER_BOTTOMLEFT],
                   max_width_radius[ST_CORNER_BOTTOMLEFT], height,
@@ -1798,11 +2270,11 @@ st_theme_node_paint_borders (StThemeNodePaintState *state,
   if (alpha > 0)
     {
       st_theme_node_ensure_color_pipeline (node);
-      cogl_pipeline_set_color4ub (node->color_pipeline,
-                                  node->background_color.red * alpha / 255,
-                                  node->background_color.green * alpha / 255,
-                                  node->background_color.blue * alpha / 255,
-                                  alpha);
+      st_paint_batch_set_color4ub (node->color_pipeline,
+                                   node->background_color.red * alpha / 255,
+                                   node->background_color.green * alpha / 255,
+                                   node->background_color.blue * alpha / 255,
+                                   alpha);
 
       /* We add padding to each corner, so that all corners end up as if they
        * had a border-radius of max_border_radius, which allows us to treat
@@ -1889,9 +2361,9 @@ st_theme_node_paint_borders (StThemeNodePaintState *state,
                 g_assert_not_reached();
                 break;
             }
-          cogl_framebuffer_draw_rectangles (framebuffer,
-                                            node->color_pipeline,
-                                            verts, n_rects);
+          st_paint_batch_add_rectangles (framebuffer,
+                                         node->color_pipeline,
+                                         verts, n_rects);
         }
 
       /* Once we've drawn the borders and corners, if the corners are bigger
@@ -1906,23 +2378,23 @@ st_theme_node_paint_borders (StThemeNodePaintState *state,
        * necessary, then the main rectangle
        */
       if (max_border_radius > border_width[ST_SIDE_TOP])
-        cogl_framebuffer_draw_rectangle (framebuffer, node->color_pipeline,
-                                         MAX(max_border_radius, border_width[ST_SIDE_LEFT]),
-                                         border_width[ST_SIDE_TOP],
-                                         width - MAX(max_border_radius, border_width[ST_SIDE_RIGHT]),
-                                         max_border_radius);
+        st_paint_batch_add_rectangle (framebuffer, node->color_pipeline,
+                                      MAX(max_border_radius, border_width[ST_SIDE_LEFT]),
+                                      border_width[ST_SIDE_TOP],
+                                      width - MAX(max_border_radius, border_width[ST_SIDE_RIGHT]),
+                                      max_border_radius);
       if (max_border_radius > border_width[ST_SIDE_BOTTOM])
-        cogl_framebuffer_draw_rectangle (framebuffer, node->color_pipeline,
-                                         MAX(max_border_radius, border_width[ST_SIDE_LEFT]),
-                                         height - max_border_radius,
-                                         width - MAX(max_border_radius, border_width[ST_SIDE_RIGHT]),
-                                         height - border_width[ST_SIDE_BOTTOM]);
-
-      cogl_framebuffer_draw_rectangle (framebuffer, node->color_pipeline,
-                                       border_width[ST_SIDE_LEFT],
-                                       MAX(border_width[ST_SIDE_TOP], max_border_radius),
-                                       width - border_width[ST_SIDE_RIGHT],
-                                       height - MAX(border_width[ST_SIDE_BOTTOM], max_border_radius));
+        st_paint_batch_add_rectangle (framebuffer, node->color_pipeline,
+                                      MAX(max_border_radius, border_width[ST_SIDE_LEFT]),
+                                      height - max_border_radius,
+                                      width - MAX(max_border_radius, border_width[ST_SIDE_RIGHT]),
+                                      height - border_width[ST_SIDE_BOTTOM]);
+
+      st_paint_batch_add_rectangle (framebuffer, node->color_pipeline,
+                                    border_width[ST_SIDE_LEFT],
+                                    MAX(border_width[ST_SIDE_TOP], max_border_radius),
+                                    width - border_width[ST_SIDE_RIGHT],
+                                    height - MAX(border_width[ST_SIDE_BOTTOM], max_border_radius));
     }
 }
 
@@ -2041,6 +2513,7 @@ st_theme_node_paint_sliced_shadow (StThemeNodePaintState *state,
                             box_shadow_spec->color.alpha * paint_opacity / 255);
   cogl_color_premultiply (&color);
 
+  st_paint_batch_release_pipeline (state->box_shadow_pipeline);
   cogl_pipeline_set_layer_combine_constant (state->box_shadow_pipeline, 0, &color);
 
   idx = 0;
@@ -2169,8 +2642,8 @@ st_theme_node_paint_sliced_shadow (StThemeNodePaintState *state,
         }
     }
 
-  cogl_framebuffer_draw_textured_rectangles (framebuffer, state->box_shadow_pipeline,
-                                             rectangles, idx / 8);
+  st_paint_batch_add_textured_rectangles (framebuffer, state->box_shadow_pipeline,
+                                          rectangles, idx / 8);
 
 #if 0
   /* Visual feedback on shadow's 9-slice and orignal offscreen buffer,
@@ -2280,6 +2753,7 @@ st_theme_node_prerender_shadow (StThemeNodePaintState *state)
       cogl_framebuffer_clear4f (offscreen, COGL_BUFFER_BIT_COLOR, 0, 0, 0, 0);
 
       st_theme_node_paint_borders (state, offscreen, &box, 0xFF);
+      st_paint_batch_flush ();
 
       state->box_shadow_pipeline = _st_create_shadow_pipeline (st_theme_node_get_box_shadow (node),
                                                                buffer);
@@ -2330,8 +2804,8 @@ st_theme_node_paint_sliced_border_image (StThemeNode           *node,
     ey = border_bottom;          /* FIXME ? */
 
   pipeline = node->border_slices_pipeline;
-  cogl_pipeline_set_color4ub (pipeline,
-                              paint_opacity, paint_opacity, paint_opacity, paint_opacity);
+  st_paint_batch_set_color4ub (pipeline,
+                               paint_opacity, paint_opacity, paint_opacity, paint_opacity);
 
   {
     float rectangles[] =
@@ -2382,7 +2856,7 @@ st_theme_node_paint_sliced_border_image (StThemeNode           *node,
       1.0, 1.0
     };
 
-    cogl_framebuffer_draw_textured_rectangles (framebuffer, pipeline, rectangles, 9);
+    st_paint_batch_add_textured_rectangles (framebuffer, pipeline, rectangles, 9);
   }
 }
 
@@ -2412,11 +2886,11 @@ st_theme_node_paint_outline (StThemeNode           *node,
   alpha = paint_opacity * outline_color.alpha / 255;
 
   st_theme_node_ensure_color_pipeline (node);
-  cogl_pipeline_set_color4ub (node->color_pipeline,
-                              effective_outline.red * alpha / 255,
-                              effective_outline.green * alpha / 255,
-                              effective_outline.blue * alpha / 255,
-                              alpha);
+  st_paint_batch_set_color4ub (node->color_pipeline,
+                               effective_outline.red * alpha / 255,
+                               effective_outline.green * alpha / 255,
+                               effective_outline.blue * alpha / 255,
+                               alpha);
 
   /* The outline is drawn just outside the border, which means just
    * outside the allocation box. This means that in some situations
@@ -2448,7 +2922,7 @@ st_theme_node_paint_outline (StThemeNode           *node,
   rects[14] = 0;
   rects[15] = height;
 
-  cogl_framebuffer_draw_rectangles (framebuffer, node->color_pipeline, rects, 4);
+  st_paint_batch_add_rectangles (framebuffer, node->color_pipeline, rects, 4);
 }
 
 static gboolean
@@ -2488,6 +2962,48 @@ st_theme_node_needs_new_box_shadow_for_size (StThemeNodePaintState *state,
   return FALSE;
 }
 
+/*
+ * _st_theme_node_paints_nothing:
+ * @node: a #StThemeNode
+ *
+ * Checks whether painting @node would leave the framebuffer untouched,
+ * which is commonly the case for the normal state of widgets that only
+ * get a background when hovered.
+ *
+ * Returns: %TRUE if st_theme_node_paint() wouldn't draw anything
+ */
+gboolean
+_st_theme_node_paints_nothing (StThemeNode *node)
+{
+  ClutterColor outline_color;
+  int side_id;
+
+  _st_theme_node_ensure_background (node);
+  _st_theme_node_ensure_geometry (node);
+
+  if (node->background_color.alpha > 0 ||
+      node->background_gradient_type != ST_GRADIENT_NONE)
+    return FALSE;
+
+  for (side_id = 0; side_id < 4; side_id++)
+    if (node->border_width[side_id] > 0 && node->border_color[side_id].alpha > 0)
+      return FALSE;
+
+  if (st_theme_node_get_outline_width (node) > 0)
+    {
+      st_theme_node_get_outline_color (node, &outline_color);
+      if (outline_color.alpha > 0)
+        return FALSE;
+    }
+
+  if (st_theme_node_get_background_image (node) != NULL ||
+      st_theme_node_get_border_image (node) != NULL ||
+      st_theme_node_get_box_shadow (node) != NULL)
+    return FALSE;
+
+  return TRUE;
+}
+
 void
 st_theme_node_paint (StThemeNode           *node,
                      StThemeNodePaintState *state,
@@ -2615,6 +3131,8 @@ st_theme_node_paint (StThemeNode           *node,
 
       get_background_position (node, &allocation, &background_box, &texture_coords);
 
+      st_paint_batch_flush ();
+
       if (has_visible_outline || node->background_repeat)
         cogl_framebuffer_push_rectangle_clip (framebuffer,
                                               allocation.x1, allocation.y1,
@@ -2645,9 +3163,13 @@ st_theme_node_paint (StThemeNode           *node,
                                    &texture_coords,
                                    paint_opacity);
 
+      st_paint_batch_flush ();
+
       if (has_visible_outline || node->background_repeat)
         cogl_framebuffer_pop_clip (framebuffer);
     }
+
+  st_paint_batch_flush ();
 }
 
 static void
@@ -113,6 +113,7 @@ struct _StThemeNode {
   CoglPipeline *background_pipeline;
   CoglPipeline *background_shadow_pipeline;
   CoglPipeline *color_pipeline;
+  CoglPipeline *rounded_rect_pipeline;
 
   StThemeNodePaintState cached_state;
 };
@@ -122,6 +123,8 @@ void _st_theme_node_ensure_geometry (StThemeNode *node);
 void _st_theme_node_apply_margins (StThemeNode *node,
                                    ClutterActor *actor);
 
+gboolean _st_theme_node_paints_nothing (StThemeNode *node);
+
 G_END_DECLS
 
 #endif /* __ST_THEME_NODE_PRIVATE_H__ */
@@ -20,6 +20,8 @@
  */
 
 #include "st-theme-node-transition.h"
+#include "st-theme-node-private.h"
+#include "st-offscreen-pool.h"
 
 enum {
   COMPLETED,
@@ -198,6 +200,56 @@ st_theme_node_transition_update (StThemeNodeTransition *transition,
     }
 }
 
+static gboolean
+acquire_offscreen (guint       width,
+                   guint       height,
+                   CoglHandle *texture,
+                   CoglHandle *offscreen)
+{
+  /* The offscreens of finished transitions are recycled through the
+   * pool; we only render into the top-left part of the texture, so it
+   * may be larger than requested. */
+  *texture = st_offscreen_pool_acquire (width, height,
+                                        COGL_PIXEL_FORMAT_ANY, TRUE);
+  if (*texture == COGL_INVALID_HANDLE)
+    return FALSE;
+
+  *offscreen = st_offscreen_pool_get_offscreen (*texture);
+  if (*offscreen == COGL_INVALID_HANDLE)
+    {
+      st_offscreen_pool_release (*texture);
+      *texture = COGL_INVALID_HANDLE;
+      return FALSE;
+    }
+
+  cogl_handle_ref (*offscreen);
+  cogl_framebuffer_set_viewport (*offscreen, 0, 0, width, height);
+
+  return TRUE;
+}
+
+static void
+release_offscreen (CoglHandle *texture,
+                   CoglHandle *offscreen)
+{
+  if (*offscreen != COGL_INVALID_HANDLE)
+    cogl_handle_unref (*offscreen);
+  if (*texture != COGL_INVALID_HANDLE)
+    st_offscreen_pool_release (*texture);
+
+  *texture = COGL_INVALID_HANDLE;
+  *offscreen = COGL_INVALID_HANDLE;
+}
+
+static void
+release_framebuffers (StThemeNodeTransition *transition)
+{
+  StThemeNodeTransitionPrivate *priv = transition->priv;
+
+  release_offscreen (&priv->old_texture, &priv->old_offscreen);
+  release_offscreen (&priv->new_texture, &priv->new_offscreen);
+}
+
 static void
 calculate_offscreen_box (StThemeNodeTransition *transition,
                          const ClutterActorBox *allocation)
@@ -241,7 +293,6 @@ setup_framebuffers (StThemeNodeTransition *transition,
 {
   StThemeNodeTransitionPrivate *priv = transition->priv;
   guint width, height;
-  CoglError *catch_error = NULL;
 
   /* template material to avoid unnecessary shader compilation */
   static CoglHandle material_template = COGL_INVALID_HANDLE;
@@ -252,43 +303,14 @@ setup_framebuffers (StThemeNodeTransition *transition,
   g_return_val_if_fail (width  > 0, FALSE);
   g_return_val_if_fail (height > 0, FALSE);
 
-  if (priv->old_texture)
-    cogl_handle_unref (priv->old_texture);
-  priv->old_texture = cogl_texture_new_with_size (width, height,
-                                                  COGL_TEXTURE_NO_SLICING,
-                                                  COGL_PIXEL_FORMAT_ANY);
-
-  if (priv->new_texture)
-    cogl_handle_unref (priv->new_texture);
-  priv->new_texture = cogl_texture_new_with_size (width, height,
-                                                  COGL_TEXTURE_NO_SLICING,
-                                                  COGL_PIXEL_FORMAT_ANY);
+  release_framebuffers (transition);
 
-  if (priv->old_texture == COGL_INVALID_HANDLE)
+  if (!acquire_offscreen (width, height, &priv->old_texture, &priv->old_offscreen))
     return FALSE;
 
-  if (priv->new_texture == COGL_INVALID_HANDLE)
-    return FALSE;
-
-  if (priv->old_offscreen)
-    cogl_handle_unref (priv->old_offscreen);
-  priv->old_offscreen = cogl_offscreen_new_with_texture (priv->old_texture);
-  if (!cogl_framebuffer_allocate (COGL_FRAMEBUFFER (priv->old_offscreen), &catch_error))
+  if (!acquire_offscreen (width, height, &priv->new_texture, &priv->new_offscreen))
     {
-      cogl_object_unref (priv->old_offscreen);
-      cogl_error_free (catch_error);
-      priv->old_offscreen = COGL_INVALID_HANDLE;
-      return FALSE;
-    }
-
-  if (priv->new_offscreen)
-    cogl_handle_unref (priv->new_offscreen);
-  priv->new_offscreen = cogl_offscreen_new_with_texture (priv->new_texture);
-  if (!cogl_framebuffer_allocate (COGL_FRAMEBUFFER (priv->new_offscreen), &catch_error))
-    {
-      cogl_object_unref (priv->new_offscreen);
-      cogl_error_free (catch_error);
-      priv->new_offscreen = COGL_INVALID_HANDLE;
+      release_framebuffers (transition);
       return FALSE;
     }
 
@@ -352,14 +374,38 @@ st_theme_node_transition_paint (StThemeNodeTransition *transition,
   CoglFramebuffer *fb = cogl_get_draw_framebuffer ();
 
   CoglColor constant;
-  float tex_coords[] = {
-    0.0, 0.0, 1.0, 1.0,
-    0.0, 0.0, 1.0, 1.0,
-  };
+  float tex_coords[8];
+  float s_max, t_max;
 
   g_return_if_fail (ST_IS_THEME_NODE (priv->old_theme_node));
   g_return_if_fail (ST_IS_THEME_NODE (priv->new_theme_node));
 
+  /* Crossfading to or from a node which doesn't paint anything is the
+   * same as fading the other node, so skip the offscreens and paint
+   * it directly. Otherwise the overlapping parts of both nodes would
+   * be blended against each other, which is what the offscreens are
+   * there to avoid.
+   */
+  if (_st_theme_node_paints_nothing (priv->old_theme_node) ||
+      _st_theme_node_paints_nothing (priv->new_theme_node))
+    {
+      gdouble progress = clutter_timeline_get_progress (priv->timeline);
+
+      if (priv->old_offscreen != COGL_INVALID_HANDLE)
+        {
+          release_framebuffers (transition);
+          priv->needs_setup = TRUE;
+        }
+
+      if (_st_theme_node_paints_nothing (priv->old_theme_node))
+        st_theme_node_paint (priv->new_theme_node, &priv->new_paint_state,
+                             fb, allocation, paint_opacity * progress);
+      else
+        st_theme_node_paint (priv->old_theme_node, &priv->old_paint_state,
+                             fb, allocation, paint_opacity * (1.0 - progress));
+      return;
+    }
+
   if (!clutter_actor_box_equal (allocation, &priv->last_allocation))
     priv->needs_setup = TRUE;
 
@@ -374,6 +420,17 @@ st_theme_node_transition_paint (StThemeNodeTransition *transition,
         return;
     }
 
+  /* Pooled textures may be larger than the area we rendered to */
+  s_max = (float) (guint) (priv->offscreen_box.x2 - priv->offscreen_box.x1) /
+          cogl_texture_get_width (priv->new_texture);
+  t_max = (float) (guint) (priv->offscreen_box.y2 - priv->offscreen_box.y1) /
+          cogl_texture_get_height (priv->new_texture);
+
+  tex_coords[0] = tex_coords[4] = 0.0;
+  tex_coords[1] = tex_coords[5] = 0.0;
+  tex_coords[2] = tex_coords[6] = s_max;
+  tex_coords[3] = tex_coords[7] = t_max;
+
   cogl_color_init_from_4f (&constant, 0., 0., 0.,
                            clutter_timeline_get_progress (priv->timeline));
   cogl_pipeline_set_layer_combine_constant (priv->material, 1, &constant);
@@ -393,7 +450,8 @@ st_theme_node_transition_paint (StThemeNodeTransition *transition,
 static void
 st_theme_node_transition_dispose (GObject *object)
 {
-  StThemeNodeTransitionPrivate *priv = ST_THEME_NODE_TRANSITION (object)->priv;
+  StThemeNodeTransition *transition = ST_THEME_NODE_TRANSITION (object);
+  StThemeNodeTransitionPrivate *priv = transition->priv;
 
   if (priv->old_theme_node)
     {
@@ -407,29 +465,7 @@ st_theme_node_transition_dispose (GObject *object)
       priv->new_theme_node = NULL;
     }
 
-  if (priv->old_texture)
-    {
-      cogl_handle_unref (priv->old_texture);
-      priv->old_texture = NULL;
-    }
-
-  if (priv->new_texture)
-    {
-      cogl_handle_unref (priv->new_texture);
-      priv->new_texture = NULL;
-    }
-
-  if (priv->old_offscreen)
-    {
-      cogl_handle_unref (priv->old_offscreen);
-      priv->old_offscreen = NULL;
-    }
-
-  if (priv->new_offscreen)
-    {
-      cogl_handle_unref (priv->new_offscreen);
-      priv->new_offscreen = NULL;
-    }
+  release_framebuffers (transition);
 
   if (priv->material)
     {
@@ -280,6 +280,9 @@ void st_theme_node_paint (StThemeNode            *node,
 void st_theme_node_invalidate_background_image (StThemeNode *node);
 void st_theme_node_invalidate_border_image (StThemeNode *node);
 
+void st_theme_node_get_paint_statistics (guint64 *n_draw_calls,
+                                         guint64 *n_rectangles);
+
 gchar * st_theme_node_to_string (StThemeNode *node);
 
 void st_theme_node_paint_state_init (StThemeNodePaintState *state);
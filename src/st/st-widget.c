@@ -134,6 +134,11 @@ G_DEFINE_TYPE_WITH_PRIVATE (StWidget, st_widget, CLUTTER_TYPE_ACTOR);
 
 static void st_widget_recompute_style (StWidget    *widget,
                                        StThemeNode *old_theme_node);
+
+/* Only recorded for the outermost widget of a restyle; includes the
+ * style-changed handlers, and so restyling the children */
+static StPerfSpan recompute_style_span =
+  ST_PERF_SPAN ("st.recomputeStyle", "Recomputing the style of a widget and its children");
 static gboolean st_widget_real_navigate_focus (StWidget         *widget,
                                                ClutterActor     *from,
                                                GtkDirectionType  direction);
@@ -379,6 +384,7 @@ st_widget_get_preferred_width (ClutterActor *self,
                                gfloat       *min_width_p,
                                gfloat       *natural_width_p)
 {
+  ST_PROFILER_BEGIN ();
   StThemeNode *theme_node = st_widget_get_theme_node (ST_WIDGET (self));
 
   st_theme_node_adjust_for_width (theme_node, &for_height);
@@ -386,6 +392,8 @@ st_widget_get_preferred_width (ClutterActor *self,
   CLUTTER_ACTOR_CLASS (st_widget_parent_class)->get_preferred_width (self, for_height, min_width_p, natural_width_p);
 
   st_theme_node_adjust_preferred_width (theme_node, min_width_p, natural_width_p);
+
+  ST_PROFILER_END (self, ST_PROFILER_PREFERRED_WIDTH);
 }
 
 static void
@@ -394,6 +402,7 @@ st_widget_get_preferred_height (ClutterActor *self,
                                 gfloat       *min_height_p,
                                 gfloat       *natural_height_p)
 {
+  ST_PROFILER_BEGIN ();
   StThemeNode *theme_node = st_widget_get_theme_node (ST_WIDGET (self));
 
   st_theme_node_adjust_for_width (theme_node, &for_width);
@@ -401,6 +410,8 @@ st_widget_get_preferred_height (ClutterActor *self,
   CLUTTER_ACTOR_CLASS (st_widget_parent_class)->get_preferred_height (self, for_width, min_height_p, natural_height_p);
 
   st_theme_node_adjust_preferred_height (theme_node, min_height_p, natural_height_p);
+
+  ST_PROFILER_END (self, ST_PROFILER_PREFERRED_HEIGHT);
 }
 
 static void
@@ -408,6 +419,7 @@ st_widget_allocate (ClutterActor          *actor,
                     const ClutterActorBox *box,
                     ClutterAllocationFlags flags)
 {
+  ST_PROFILER_BEGIN ();
   StThemeNode *theme_node = st_widget_get_theme_node (ST_WIDGET (actor));
   ClutterActorBox content_box;
 
@@ -427,6 +439,8 @@ st_widget_allocate (ClutterActor          *actor,
                                    CLUTTER_CONTAINER (actor),
                                    &content_box,
                                    flags);
+
+  ST_PROFILER_END (actor, ST_PROFILER_ALLOCATE);
 }
 
 /**
@@ -466,10 +480,14 @@ st_widget_paint_background (StWidget *widget)
 static void
 st_widget_paint (ClutterActor *actor)
 {
+  ST_PROFILER_BEGIN ();
+
   st_widget_paint_background (ST_WIDGET (actor));
 
   /* Chain up so we paint children. */
   CLUTTER_ACTOR_CLASS (st_widget_parent_class)->paint (actor);
+
+  ST_PROFILER_END (actor, ST_PROFILER_PAINT);
 }
 
 static void
@@ -1588,7 +1606,10 @@ static void
 st_widget_recompute_style (StWidget    *widget,
                            StThemeNode *old_theme_node)
 {
+  static guint recompute_depth = 0;
   StWidgetPrivate *priv = st_widget_get_instance_private (widget);
+  guint span_id = recompute_depth++ == 0 ? _st_perf_span_begin (&recompute_style_span) : 0;
+  ST_PROFILER_BEGIN ();
   StThemeNode *new_theme_node = st_widget_get_theme_node (widget);
   int transition_duration;
   gboolean paint_equal;
@@ -1597,7 +1618,7 @@ st_widget_recompute_style (StWidget    *widget,
   if (new_theme_node == old_theme_node)
     {
       priv->is_style_dirty = FALSE;
-      return;
+      goto out;
     }
 
   _st_theme_node_apply_margins (new_theme_node, CLUTTER_ACTOR (widget));
@@ -1658,6 +1679,11 @@ st_widget_recompute_style (StWidget    *widget,
 
   g_signal_emit (widget, signals[STYLE_CHANGED], 0);
   priv->is_style_dirty = FALSE;
+
+ out:
+  ST_PROFILER_END (widget, ST_PROFILER_STYLE);
+  recompute_depth--;
+  _st_perf_span_end (&recompute_style_span, span_id);
 }
 
 /**